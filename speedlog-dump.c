@@ -0,0 +1,212 @@
+// Speedometer Program
+// speedlog-dump
+// Inputs: Binary event logs written by speedometer
+// Outputs: The events in the logs as CSV or JSON, displayed to cout
+// Operation: To turn the event logs into something people and spreadsheets can read, optionally keeping only the events
+//between two times. The logs are memory mapped, so even big ones are read without copying them
+
+#define _GNU_SOURCE				//for strptime()
+
+#include "speedlog.h"
+
+#include <stdint.h>
+#include <stdio.h>				//for the printf() function
+#include <stdlib.h>				//for strtod()
+#include <string.h>				//for strcmp() and memcmp()
+#include <time.h>				//for localtime() and strftime()
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>			//for mmap()
+#include <sys/stat.h>			//for fstat(), to find the size of a log
+
+#define NS_PER_SECOND 1000000000ULL
+
+//The different ways the events can be written out
+enum outputFormat {OUTPUT_CSV, OUTPUT_JSON};
+
+//All function declarations
+int parseTime(const char* text, uint64_t* timestamp);
+
+const char* eventName(int type);
+
+void formatTime(uint64_t timestamp, char* buffer, size_t size);
+
+void printRecord(const struct speedlogRecord* record, enum outputFormat format, int* printed);
+
+int dumpFile(const char* fileName, uint64_t startTime, uint64_t endTime, enum outputFormat format, int* printed);
+
+int main(const int argc, const char* const argv[])	{
+	enum outputFormat format = OUTPUT_CSV;
+	uint64_t startTime = 0;
+	uint64_t endTime = UINT64_MAX;
+	int firstFile = 1;
+
+	//-j writes JSON instead of CSV, and -s and -e keep only the events from and before the given times
+	for(; firstFile < argc && argv[firstFile][0] == '-'; firstFile++)	{
+		if(strcmp(argv[firstFile], "-j") == 0)
+			format = OUTPUT_JSON;
+		else if(strcmp(argv[firstFile], "-s") == 0 && firstFile + 1 < argc && parseTime(argv[firstFile + 1], &startTime) == 0)
+			firstFile++;
+		else if(strcmp(argv[firstFile], "-e") == 0 && firstFile + 1 < argc && parseTime(argv[firstFile + 1], &endTime) == 0)
+			firstFile++;
+		else
+			break;
+	}
+
+	if(firstFile >= argc)	{
+		fprintf(stderr, "Usage: %s [-j] [-s <start time>] [-e <end time>] <event log>...\n", argv[0]);
+		fprintf(stderr, "Times are seconds since 1970 or local times like \"2024-03-01 14:30:00\"\n");
+		return -1;
+	}
+
+	int printed = 0;
+	int result = 0;
+
+	if(format == OUTPUT_CSV)
+		printf("time,timestamp_ns,event,direction,speed,speeding,off_the_charts,lane\n");
+	else
+		printf("[");
+
+	//Older logs should be given first, so that the events come out in the order they were reported
+	for(int i = firstFile; i < argc; i++)	{
+		if(dumpFile(argv[i], startTime, endTime, format, &printed) < 0)
+			result = -1;
+	}
+
+	if(format == OUTPUT_JSON)
+		printf("%s]\n", printed ? "\n" : "");
+
+	return result;
+}
+
+//This function reads a time given on the command line, either in seconds since 1970 or as a local date and time.
+//Returns 0 on success and -1 if it is not a time
+int parseTime(const char* text, uint64_t* timestamp)	{
+	struct tm date;
+	memset(&date, 0, sizeof(date));
+
+	const char* end = strptime(text, "%Y-%m-%d %H:%M:%S", &date);
+	if(!end)	{
+		memset(&date, 0, sizeof(date));
+		end = strptime(text, "%Y-%m-%d", &date);
+	}
+
+	if(end && *end == 0)	{
+		date.tm_isdst = -1;
+		time_t seconds = mktime(&date);
+		if(seconds < 0)
+			return -1;
+
+		*timestamp = (uint64_t)seconds * NS_PER_SECOND;
+		return 0;
+	}
+
+	char* numberEnd;
+	double seconds = strtod(text, &numberEnd);
+	if(numberEnd == text || *numberEnd != 0 || seconds < 0)
+		return -1;
+
+	*timestamp = seconds * NS_PER_SECOND;
+	return 0;
+}
+
+//This function gives the name an event type is written out with
+const char* eventName(int type)	{
+	switch(type)	{
+		case SPEEDLOG_TRANSIT:
+			return "transit";
+		case SPEEDLOG_LOST:
+			return "lost";
+		case SPEEDLOG_LASER_BLOCKED:
+			return "laser_blocked";
+		case SPEEDLOG_HALL_BLOCKED:
+			return "hall_blocked";
+		default:
+			return "unknown";
+	}
+}
+
+//This function writes a timestamp as a local date and time with milliseconds, like "2024-03-01 14:30:00.250"
+void formatTime(uint64_t timestamp, char* buffer, size_t size)	{
+	time_t seconds = timestamp / NS_PER_SECOND;
+	struct tm date;
+	localtime_r(&seconds, &date);
+
+	size_t length = strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &date);
+	snprintf(buffer + length, size - length, ".%03u", (unsigned)(timestamp % NS_PER_SECOND / 1000000));
+}
+
+//This function writes out one event. printed counts the events written so far, so that the JSON objects can be
+//separated by commas
+void printRecord(const struct speedlogRecord* record, enum outputFormat format, int* printed)	{
+	char time[40];
+	formatTime(record->timestamp, time, sizeof(time));
+
+	const char* direction = (record->direction == 0) ? "right" : (record->direction == 1) ? "left" : "";
+	int speeding = (record->flags & SPEEDLOG_SPEEDING) != 0;
+	int offTheCharts = (record->flags & SPEEDLOG_OFF_THE_CHARTS) != 0;
+	int lane = SPEEDLOG_LANE(record->flags) + 1;
+
+	if(format == OUTPUT_CSV)	{
+		printf("%s,%llu,%s,%s,%.3f,%d,%d,%d\n", time, (unsigned long long)record->timestamp, eventName(record->type), direction, record->speed, speeding, offTheCharts, lane);
+	}
+	else	{
+		printf("%s\n  {\"time\": \"%s\", \"timestamp_ns\": %llu, \"event\": \"%s\", \"direction\": ", *printed ? "," : "", time, (unsigned long long)record->timestamp, eventName(record->type));
+
+		if(direction[0])
+			printf("\"%s\"", direction);
+		else
+			printf("null");
+
+		printf(", \"speed\": %.3f, \"speeding\": %s, \"off_the_charts\": %s, \"lane\": %d}", record->speed, speeding ? "true" : "false", offTheCharts ? "true" : "false", lane);
+	}
+
+	(*printed)++;
+}
+
+//This function writes out every event of one log between startTime and endTime (both in nanoseconds since 1970,
+//endTime not included). Returns 0 on success and -1 if the file is not an event log
+int dumpFile(const char* fileName, uint64_t startTime, uint64_t endTime, enum outputFormat format, int* printed)	{
+	int fd = open(fileName, O_RDONLY);
+	if(fd < 0)	{
+		perror(fileName);
+		return -1;
+	}
+
+	struct stat fileInfo;
+	if(fstat(fd, &fileInfo) < 0 || fileInfo.st_size < (off_t)sizeof(struct speedlogHeader))	{
+		fprintf(stderr, "%s: not an event log\n", fileName);
+		close(fd);
+		return -1;
+	}
+
+	//The whole file is mapped and read straight out of the page cache, front to back
+	const uint8_t* contents = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(contents == MAP_FAILED)	{
+		perror(fileName);
+		return -1;
+	}
+
+	madvise((void*)contents, fileInfo.st_size, MADV_SEQUENTIAL);
+
+	const struct speedlogHeader* header = (const struct speedlogHeader*)contents;
+	if(memcmp(header->magic, SPEEDLOG_MAGIC, sizeof(header->magic)) != 0 || header->version != SPEEDLOG_VERSION || header->recordSize != sizeof(struct speedlogRecord))	{
+		fprintf(stderr, "%s: not an event log this version of speedlog-dump can read\n", fileName);
+		munmap((void*)contents, fileInfo.st_size);
+		return -1;
+	}
+
+	//A record that was only half written when the program stopped is left out
+	size_t numRecords = (fileInfo.st_size - sizeof(struct speedlogHeader)) / sizeof(struct speedlogRecord);
+	const struct speedlogRecord* records = (const struct speedlogRecord*)(contents + sizeof(struct speedlogHeader));
+
+	for(size_t i = 0; i < numRecords; i++)	{
+		if(records[i].timestamp >= startTime && records[i].timestamp < endTime)
+			printRecord(&records[i], format, printed);
+	}
+
+	munmap((void*)contents, fileInfo.st_size);
+	return 0;
+}
@@ -0,0 +1,49 @@
+// Speedometer Program
+// The binary event log written by speedometer and read back by speedlog-dump
+//Every file starts with a speedlogHeader and is followed by speedlogRecords, one for every event, in the order they
+//were reported. A transit is only reported once it is sure which way the person went, so a record can come after one
+//with a later timestamp. Everything is stored in the byte order of the Pi (little endian)
+
+#ifndef SPEEDLOG_H
+#define SPEEDLOG_H
+
+#include <stdint.h>
+
+//The first 8 bytes of every event log, and the version of the records that follow
+#define SPEEDLOG_MAGIC "SPEEDLOG"
+#define SPEEDLOG_VERSION 1
+
+//The kinds of events in the log
+#define SPEEDLOG_TRANSIT 0			//Someone walked through the hall, speed is how fast
+#define SPEEDLOG_LOST 1				//Someone walked into the hall and was never seen leaving
+#define SPEEDLOG_LASER_BLOCKED 2	//A laser has been blocked for too long
+#define SPEEDLOG_HALL_BLOCKED 3		//Someone has been in the hall for too long
+
+//The direction of an event that does not have one
+#define SPEEDLOG_NO_DIRECTION 0xFF
+
+//The flags of a transit
+#define SPEEDLOG_SPEEDING 0x1			//They were over the speed limit of their direction
+#define SPEEDLOG_OFF_THE_CHARTS 0x2		//They were too fast to measure, so there is no speed
+
+//The lane of every event, from 0, is kept in the top 8 bits of its flags
+#define SPEEDLOG_LANE_SHIFT 8
+#define SPEEDLOG_LANE(flags) ((flags) >> SPEEDLOG_LANE_SHIFT)
+
+struct speedlogHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+};
+
+//One event. timestamp is the wall clock time of the event in nanoseconds since 1970, direction is 0 for walking
+//right (laser 1 to laser 2), 1 for walking left or SPEEDLOG_NO_DIRECTION, and speed is in m/s
+struct speedlogRecord {
+	uint64_t timestamp;
+	uint8_t type;
+	uint8_t direction;
+	uint16_t flags;
+	float speed;
+};
+
+#endif
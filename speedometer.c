@@ -6,9 +6,12 @@
 //The purpose of this code is to measure the speeds of people passing through a hallway and print to a stats file information about how many
 //many people have sped through the hall as well as other general information about the people passing through the hall
 
+#define _GNU_SOURCE				//for pthread_setaffinity_np() and the CPU_SET macros
+
 #include "gpiolib_addr.h"	//For functions pertaining to the GPIO pins on the Raspberry Pi
 #include "gpiolib_reg.h"
 #include "gpiolib_reg.c"
+#include "speedlog.h"		//For the records of the binary event log
 
 #include <stdint.h>
 #include <stdio.h>				//for the printf() function
@@ -17,42 +20,102 @@
 #include <unistd.h> 			//needed for sleep
 #include <sys/ioctl.h> 			//needed for the ioctl function
 #include <stdlib.h> 			//for atoi
+#include <errno.h>				//for errno
 #include <time.h> 				//for time_t and the time() function
 #include <sys/time.h>           //for gettimeofday()
-
-//Below is a macro that had been defined to output appropriate logging messages
-
-//file        - will be the file pointer to the log file
+#include <string.h>				//for strcmp() and memset()
+#include <limits.h>				//for PATH_MAX
+#include <ctype.h>				//for isspace(), used to read the config file
+#include <strings.h>			//for strcasecmp(), so the units in the config file can be given in any case
+#include <stddef.h>				//for offsetof(), used to find where each setting of the config file goes
+#include <signal.h>				//for SIGHUP, which makes the program read its config file again
+#include <sys/signalfd.h>		//for picking SIGHUP up on the config watcher thread
+#include <sys/inotify.h>		//for noticing changes to the config file
+#include <poll.h>				//for poll(), used to wait on the GPIO edge events
+#include <linux/gpio.h>			//for the gpiochip line event ioctls
+#include <pthread.h>			//for the sampler thread
+#include <sched.h>				//for pinning the sampler thread to a CPU
+#include <stdatomic.h>			//for the lock-free ring between the sampler and the state machine
+#include <sys/eventfd.h>		//for waking the state machine up when the sampler has new edges
+#include <math.h>				//for log(), used to make up synthetic traffic
+#include <stdarg.h>				//for the variable arguments of logMessage()
+#include <sys/uio.h>			//for writev(), used by the log writer thread
+#include <sys/stat.h>			//for fstat(), used to count the bytes the pipeline benchmark writes
+#include <sys/mman.h>			//for mlockall(), used in real-time mode
+#include <sys/socket.h>			//for the socket the metrics are served on
+#include <sys/un.h>				//for the address of that Unix domain socket
+
+//The edge detector of the stream compares several samples at once with the vector instructions of the CPU, when it has
+//them: SSE2 on a PC and NEON on a Pi built with -mfpu=neon (always there on 64 bit ARM)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define EDGE_KERNEL "sse2"
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EDGE_KERNEL "neon"
+#else
+#define EDGE_KERNEL "64 bit words"
+#endif
+
+//Below is a macro that had been defined to output appropriate logging messages. The message is only queued here,
+//the log writer thread writes it to the log file later on
+
+//file        - will be the logger of the log file
 //time        - will be the current time at which the message is being printed
 //programName - will be the name of the program, in this case it will be either speedometer to represnt main or measureSpeed if it is in the function
 //sev 		  - will be the severity level of the message
 //str         - will be a string that contains the message that will be printed to the file.
 #define PRINT_MSG(file, time, programName, sev, str) \
 	do{ \
-			fprintf(logFile, "%s : %s : %s : %s", time, programName, sev, str); \
-			fflush(logFile); \
+			logMessage(file, "%s : %s : %s : %s", time, programName, sev, str); \
 	}while(0)
 
 
-//Defines a macro to print a value to the log file. 
-#define PRINT_VALUE(file, val)	\
-	do{	\
-		fprintf(logFile, " %f\n", val);	\
-		fflush(logFile);	\
-	}while(0)
+//All the times used to measure a person are CLOCK_MONOTONIC times in nanoseconds, taken at the edge
+typedef uint64_t timestamp_ns;
 
+#define NS_PER_SECOND 1000000000ULL
+#define NS_PER_MS 1000000ULL
 
-//Defining constants such as pins to be used for inputs and outputs (as well as float max)
+//Defining constants such as pins to be used for inputs and outputs (as well as float max). The laser and warning LED
+//pins are those of the first lane unless the config file gives others
 #define FLT_MAX 3.402823466e+38F 
 #define LASER1_PIN_NUM 4
 #define LASER2_PIN_NUM 18 
+
+//The bits of the level register that belong to the lasers of the first lane
+#define LASER1_MASK (1 << LASER1_PIN_NUM)
+#define LASER2_MASK (1 << LASER2_PIN_NUM)
+#define LASER_PIN_MASK (LASER1_MASK | LASER2_MASK)
 #define RUNNING_LED_PIN 17
 #define WARNING_LED_PIN 22
 
+//The most lanes, each a pair of lasers across its own hall or doorway, the program can watch at once, and so the most
+//laser lines the capture engine can request
+#define MAX_LANES 8
+#define MAX_LASER_LINES (2 * MAX_LANES)
+
+//The most LEDs the LED scheduler can look after
+#define MAX_SCHEDULED_LEDS 4
+
+//The number of times and the time, in nanoseconds, the warning LED stays on and then off when it blinks
+#define WARNING_BLINKS 3
+#define WARNING_BLINK_PERIOD (200 * NS_PER_MS)
+
 //Define defaults for values obtained from the config file
 #define DEFAULT_SPEED_LIMIT 1
 #define DEFAULT_LASER_DISTANCE 3
 #define DEFAULT_STATS_FREQUENCY 60
+#define DEFAULT_WATCHDOG_TIMEOUT 15
+
+//This is the longest a line of the config file can be, and the most characters, with the null terminator, a file
+//name in it can have
+#define CONFIG_LINE_SIZE 512
+#define CONFIG_NAME_SIZE 256
+
+//This is how long, in milliseconds, the config file has to be left alone after a change before it is read again, so
+//that a file being saved in pieces is read once it is all there
+#define CONFIG_SETTLE_TIME 200
 
 //This is the max amount of time, in seconds, a person is allowed to remain in the hallway before a warning is issued
 #define MAX_TIME_IN_HALL 10
@@ -60,6 +123,227 @@
 //This is the max amount of time, in seconds, a person is allowed to block the laser before a warning is issued
 #define LASER_BLOCK_TIME 5
 
+//This is the amount of time, in seconds, after which a person who entered the hall but was never seen leaving
+//it is given up on, for example because they turned around or were hidden behind someone else
+#define TRANSIT_TIMEOUT 30
+
+//This is how far, in metres, a person walks while they break a laser. How long someone takes to walk into the hall
+//gives their speed, and so about when they should get to the other laser
+#define PERSON_DEPTH 0.35
+
+//Someone walking the other way can break the far laser while people are in the hall, so it is only taken for someone
+//leaving if they took no more than EXIT_TIME_TOLERANCE times as long, or as short, to get to it as they were expected
+//to, and broke it for no more than EXIT_BLOCK_TOLERANCE times as long, or as short, as the laser they came in through
+#define EXIT_TIME_TOLERANCE 1.5
+#define EXIT_BLOCK_TOLERANCE 1.25
+
+//This is where the statistics of both directions together are kept, after the ones of each direction
+#define BOTH_DIRECTIONS 2
+
+//This is the number of measurements that fit in a page of the measurement store, and the number of pages
+//the store starts out with
+#define MEASUREMENTS_PER_PAGE 256
+#define PREALLOCATED_PAGES 4
+
+//The speed sketches count speeds in mm/s. Below 2^SKETCH_SUB_BUCKET_BITS mm/s every value has its own bucket, above
+//that each power of two is split into 2^SKETCH_SUB_BUCKET_BITS buckets, so a percentile is never off by more than
+//about 1.6%. Anything at or over 2^SKETCH_MAX_BITS mm/s (65 m/s) is counted in the top bucket
+#define SKETCH_SUB_BUCKET_BITS 6
+#define SKETCH_SUB_BUCKETS (1 << SKETCH_SUB_BUCKET_BITS)
+#define SKETCH_MAX_BITS 16
+#define SKETCH_BUCKETS (SKETCH_SUB_BUCKETS * (SKETCH_MAX_BITS - SKETCH_SUB_BUCKET_BITS + 1))
+
+//The histogram in the stats file has HISTOGRAM_BINS bins HISTOGRAM_BIN_WIDTH m/s wide, the last one taking everything faster
+#define HISTOGRAM_BINS 8
+#define HISTOGRAM_BIN_WIDTH 0.5
+
+//How often the windows are rolled up into hourly and daily totals, in seconds
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+
+//This is the most people walking in the same direction that can be followed through the hall at once
+#define MAX_TRANSITS_PER_DIRECTION 32
+
+//This is the most reports the tracker can hand back for a single laser event
+#define MAX_TRACKER_REPORTS 8
+
+//The most reads of a laser the glitch filter can take the majority of, and the most changes of the lasers it can let
+//through for a single laser event
+#define MAX_MAJORITY_SAMPLES 31
+#define MAX_GLITCH_COMMITS 4
+
+//The glitch benchmark adds this many flickers a minute to each laser of its synthetic traffic, each up to
+//GLITCH_BENCHMARK_WIDTH microseconds long, and filters them with the widths and majority below
+#define GLITCH_BENCHMARK_PEOPLE 20000
+#define GLITCH_BENCHMARK_RATE 30
+#define GLITCH_BENCHMARK_WIDTH 2000
+#define GLITCH_BENCHMARK_MIN_PULSE 5000
+#define GLITCH_BENCHMARK_MAJORITY 3
+
+//The glitch benchmark fails if fewer than this share of the people measured on the clean lasers filtered are measured
+//the same on the flickering ones, or the flickering ones give more than the rest of it in extra people. A bag swinging through a laser just after it is restored moves the restore on by up
+//to twice GLITCH_BENCHMARK_WIDTH, which is well inside the 10 ms the times are matched within
+#define GLITCH_BENCHMARK_MATCHED 0.999
+
+//This is the number of people walked through the hall by each run of the tracker benchmark
+#define BENCHMARK_PEOPLE 200000
+
+//This is the most speeds the stats benchmark puts in one window, and the fraction of the average and spread by which the
+//stats worked out two ways can differ, on top of a micrometre a second
+#define STATS_BENCHMARK_SPEEDS 1000000
+#define STATS_TOLERANCE 0.001f
+
+//The benchmarks check that every person of the synthetic traffic is measured within this fraction of their speed
+#define BENCHMARK_SPEED_TOLERANCE 0.001
+
+//This is the number of LED writes the in-memory LED recorder keeps, the older ones only being counted
+#define LED_RECORDER_SIZE 256
+
+//This is the average time, in seconds, between two people of the synthetic traffic played back with -s
+#define SIMULATION_HEADWAY 2.0
+
+//The slowest and fastest walkers of the synthetic traffic, in m/s
+#define SYNTHETIC_MIN_SPEED 0.8
+#define SYNTHETIC_MAX_SPEED 2.5
+
+//This is the number of people walked through the whole program by each run of the pipeline benchmark
+#define PIPELINE_BENCHMARK_PEOPLE 100000
+
+//The pipeline benchmark checks that every speed in the event log is within this fraction of the speed someone walked at.
+//The edges are timed on the virtual clock, so only the float the speed is kept in rounds it
+#define PIPELINE_SPEED_TOLERANCE 0.0001
+
+//The pipeline benchmark matches every transit in the event log to whoever left within this many nanoseconds of it. The
+//event log keeps wall clock times, which are only as close to the virtual clock as the two clocks could be read together
+#define PIPELINE_MATCH_TOLERANCE NS_PER_MS
+
+//This is the number of times the pipeline is run with and without timing its loop, to find what the timing costs
+#define INSTRUMENTATION_BENCHMARK_RUNS 9
+
+//This is the number of people walked through the whole program by the LED benchmark, one every LED_BENCHMARK_HEADWAY
+//seconds so that each of them has the hall and the warning LED to themselves
+#define LED_BENCHMARK_PEOPLE 8
+#define LED_BENCHMARK_HEADWAY 10
+
+//The LED benchmark checks that every LED write is within this many nanoseconds of when it should be. The state machine
+//waits in whole milliseconds, so a blink can be switched up to a millisecond late on the virtual clock
+#define LED_BENCHMARK_TOLERANCE NS_PER_MS
+
+//This is the gpiochip character device the laser lines are requested from when capturing edges
+#define GPIO_CHIP_DEVICE "/dev/gpiochip0"
+
+//This is the longest time, in milliseconds, the capture engine will wait for an edge before handing
+//control back to the state machine so it can check its timers and ping the watchdog
+#define CAPTURE_TIMEOUT_MS 100
+
+//This is the time, in microseconds, between two reads of the level register when polling, unless the config file
+//gives IDLE_POLL_PERIOD and ACTIVE_POLL_PERIOD
+#define POLL_PERIOD_US 1000
+
+//When polling, a read of the level register that comes more than this many periods after the one before is counted
+//as late, as a person could have broken a laser and left it again in between
+#define LATE_POLL_PERIODS 2
+
+//The poll benchmark polls synthetic traffic of POLL_BENCHMARK_PEOPLE, one every POLL_BENCHMARK_HEADWAY seconds on
+//average, played back on the real clock across lasers POLL_BENCHMARK_DISTANCE metres apart, reading the level register
+//every POLL_BENCHMARK_IDLE_US microseconds while nobody is about
+#define POLL_BENCHMARK_PEOPLE 4
+#define POLL_BENCHMARK_HEADWAY 3.0
+#define POLL_BENCHMARK_DISTANCE 1.0
+#define POLL_BENCHMARK_IDLE_US 10000
+
+//With -P every thread is given a stack of REALTIME_STACK_SIZE bytes, so that locking the memory of the program does not
+//lock 8 MB for each of them, and the thread that reads the lasers touches REALTIME_STACK_PREFAULT bytes of its stack
+//before it starts
+#define REALTIME_STACK_SIZE (1024 * 1024)
+#define REALTIME_STACK_PREFAULT (64 * 1024)
+
+//The jitter benchmark wakes up JITTER_BENCHMARK_WAKEUPS times, every JITTER_BENCHMARK_PERIOD_US microseconds, for each
+//way of sleeping, at JITTER_BENCHMARK_PRIORITY when it is real-time
+#define JITTER_BENCHMARK_WAKEUPS 2000
+#define JITTER_BENCHMARK_PERIOD_US 1000
+#define JITTER_BENCHMARK_PRIORITY 50
+
+//The stream the level register is sampled into with -r holds STREAM_SAMPLES reads, written STREAM_BLOCK_SAMPLES at
+//a time. Both must be powers of 2
+#define STREAM_SAMPLES 262144
+#define STREAM_BLOCK_SAMPLES 256
+
+//A read of the streamed level register that comes this many periods late is taken as a gap in the stream, for example
+//because the streamer thread was not running
+#define STREAM_GAP_PERIODS 8
+
+//The slowest and fastest rates, in reads per second, the level register can be streamed at
+#define STREAM_MIN_RATE 1000
+#define STREAM_MAX_RATE 2000000
+
+//The stream benchmark scans a synthetic buffer of this many samples, and plays synthetic traffic through a stream
+//sampled at STREAM_BENCHMARK_RATE reads per second
+#define STREAM_BENCHMARK_SAMPLES (1 << 22)
+#define STREAM_BENCHMARK_RATE 20000
+#define STREAM_BENCHMARK_PEOPLE 200
+
+//The most edges the edge detector finds in one go before handing them out. It stops scanning once it has found them
+#define EDGE_BATCH_SIZE 64
+
+//The lane benchmark samples synthetic traffic on every lane at LANE_BENCHMARK_RATE reads per second into a buffer of
+//LANE_BENCHMARK_SAMPLES, one person walking through each lane every LANE_BENCHMARK_HEADWAY seconds on average
+#define LANE_BENCHMARK_SAMPLES (1 << 22)
+#define LANE_BENCHMARK_RATE 2000
+#define LANE_BENCHMARK_HEADWAY 2.0
+
+//This is the number of edges the ring between the sampler thread and the state machine can hold. It must be
+//a power of 2
+#define EVENT_RING_SIZE 1024
+
+//This is the number of messages the logger can hold while they wait to be written, and the longest a message can be
+#define LOG_RECORDS 512
+#define LOG_RECORD_SIZE 256
+
+//As soon as this many messages are waiting the log writer thread writes them, without waiting for the flush interval
+#define LOG_BATCH_RECORDS 64
+
+//This is the default longest time, in milliseconds, a message waits before it is written to the log file
+#define DEFAULT_LOG_FLUSH_INTERVAL 1000
+
+//The latency histograms have one bucket for each power of 2 nanoseconds
+#define LATENCY_BUCKETS 40
+
+//The binary event log is written this many records at a time, and when it grows past its size it is moved to
+//<name>.1, the older ones moving up to <name>.EVENT_LOG_ROTATIONS before the oldest is thrown away. Up to
+//EVENT_LOG_RECORDS records can wait for the writer thread
+#define EVENT_LOG_BATCH 64
+#define EVENT_LOG_ROTATIONS 4
+#define EVENT_LOG_RECORDS 1024
+
+//This is the default size, in kilobytes, the binary event log can grow to before it is rotated
+#define DEFAULT_EVENT_LOG_SIZE 1024
+
+//This is the size of the buffers getTime writes the time to, as "MM-DD-YYYY  HH:MM:SS.mmm"
+#define TIME_BUFFER_SIZE 30
+
+//This is the number of times each thread of the time benchmark formats the time, and the number of threads
+#define TIME_BENCHMARK_CALLS 1000000
+#define TIME_BENCHMARK_THREADS 4
+
+//This is how often, in seconds, the metrics file is written, and the most it can hold for every lane
+#define METRICS_INTERVAL 5
+#define METRICS_BUFFER_SIZE (16384 * MAX_LANES)
+
+//measureSpeed times every turn of its loop for the busy time, but only one turn in every METRICS_SAMPLE_TURNS from
+//start to end for the loop period and decision latency
+#define METRICS_SAMPLE_TURNS 64
+
+//This is how often, in milliseconds, measureSpeed hands a copy of its metrics to the metrics server, and the longest,
+//also in milliseconds, the server waits for a scraper to send its request or take the metrics
+#define METRICS_PUBLISH_INTERVAL 100
+#define METRICS_SCRAPE_TIMEOUT 1000
+
+//The histograms in the metrics file have a bucket for each power of 2 nanoseconds from 2^METRICS_FIRST_BUCKET
+//(about 1 us) to 2^METRICS_LAST_BUCKET (about 1 s), the smaller and bigger ones being added to the ends
+#define METRICS_FIRST_BUCKET 10
+#define METRICS_LAST_BUCKET 30
+
 //These define the different levels of severity to easily be accessed by PRINT_MSG later on
 #define SEVERITY_DEBUG "severity"
 #define SEVERITY_INFO "info"
@@ -67,873 +351,7592 @@
 #define SEVERITY_ERROR "error"
 #define SEVERITY_CRITICAL "critical"
 
+//The different ways the capture engine can watch the lasers. CAPTURE_EDGE waits on the kernel's line
+//events, CAPTURE_POLL reads the level register every poll period, CAPTURE_STREAM scans a stream the level register
+//is sampled into at a fixed rate and CAPTURE_REPLAY asks a GPIO backend that plays back a trace of the lasers, so that
+//the program can be run on a computer without the lasers attached
+enum captureMode { CAPTURE_POLL, CAPTURE_EDGE, CAPTURE_STREAM, CAPTURE_REPLAY };
+
+//A snapshot of the lasers right after one of them changed. levels holds the level register bits of the
+//laser pins (1 = receiving a laser) and timestamp is the CLOCK_MONOTONIC time of the edge in nanoseconds
+struct laserEvent {
+	timestamp_ns timestamp;
+	uint32_t levels;
+};
+
+//One read of the level register. levels holds only the bits of the laser pins, all read at the same instant,
+//and timestamp is the CLOCK_MONOTONIC time of the read in nanoseconds
+struct laserSample {
+	timestamp_ns timestamp;
+	uint32_t levels;
+};
+
+//A GPIO backend. Everything that reads or writes the GPIO pins goes through one of these, so the same program can
+//run on the registers of the Pi or on a trace of the lasers. readLevels gives the whole level register, now gives
+//the time on the backend's clock in nanoseconds and nextEdge, which only backends that play back a trace have,
+//works the same way as captureNextEvent
+struct gpioBackend {
+	const char* name;
+	uint32_t (*readLevels)(struct gpioBackend* backend);
+	void (*setToOutput)(struct gpioBackend* backend, int pinNumber);
+	void (*writePin)(struct gpioBackend* backend, int pinNumber, int on);
+	timestamp_ns (*now)(struct gpioBackend* backend);
+	int (*nextEdge)(struct gpioBackend* backend, struct laserEvent* event, int timeoutMs);
+};
+
+//The backend for the registers of the Pi, mapped into memory by gpiolib
+struct mmioBackend {
+	struct gpioBackend backend;
+	GPIO_Handle gpio;
+};
+
+//One write to an output pin, as kept by the LED recorder
+struct ledWrite {
+	timestamp_ns timestamp;
+	int pin;
+	int on;
+};
+
+//A backend that keeps the output pins in memory and records every write to them, the last LED_RECORDER_SIZE in
+//writes. inputs is what reading the level register gives back and clock, if it is not NULL, is the backend whose
+//clock the writes are timed with
+struct ledRecorder {
+	struct gpioBackend backend;
+	struct gpioBackend* clock;
+	uint32_t inputs;
+	uint32_t outputPins;
+	uint32_t outputs;
+	struct ledWrite writes[LED_RECORDER_SIZE];
+	uint64_t numWrites;
+};
+
+//A backend that plays back a trace of the lasers on a virtual clock. The clock only moves when the state machine
+//waits, and then jumps straight to the next edge or to the end of the wait, so a trace is played back as fast as the
+//program can handle it and always gives the same results. The LEDs are written to an LED recorder
+struct replayBackend {
+	struct gpioBackend backend;
+	struct ledRecorder leds;
+
+	//The levels of the lasers after each edge, the edges being timed on the virtual clock, and the bits of the level
+	//register the lasers of the trace are on
+	struct laserEvent* edges;
+	size_t numEdges;
+	size_t nextEdge;
+	uint32_t levels;
+	uint32_t laserMask;
+
+	//The virtual clock starts at the real time the trace was loaded, so that the times it gives look like real ones
+	timestamp_ns startTime;
+	timestamp_ns now;
+};
+
+//A circular buffer the level register is sampled into at a fixed rate, the way a DMA engine would fill it, so that an
+//edge is timed by where it is in the buffer rather than by when user space got round to looking. It is filled a block
+//of STREAM_BLOCK_SAMPLES at a time by the streamer thread, or by hand, and head, the number of samples written so far,
+//only moves on once a whole block is there. blockTimes holds when the first and the last sample of each block were
+//taken, the samples in between being spread evenly. readyFd is an eventfd written after every block
+struct sampleStream {
+	uint32_t* samples;
+	timestamp_ns (*blockTimes)[2];
+	size_t size;
+	timestamp_ns period;
+	int readyFd;
+
+	_Alignas(64) atomic_size_t head;
+	atomic_int finished;
+
+	//The streamer thread, the backend it reads, the CPU it is pinned to (-1 for any) and the real-time priority it runs
+	//at (0 for none). realtime is 1 once it is running at that priority and -1 if it could not be given it. lateSamples
+	//counts the reads that came more than a period late and gaps the times they came STREAM_GAP_PERIODS late
+	struct gpioBackend* gpio;
+	int cpu;
+	int priority;
+	atomic_int realtime;
+	pthread_t thread;
+	int started;
+	atomic_int running;
+	atomic_ullong lateSamples;
+	atomic_ullong gaps;
+};
+
+//The edges the edge detector found in a run of samples of the level register. samples holds where each edge is in the
+//run, levels the levels of the pins being watched after it and rising and falling the pins that went up and down in it.
+//changedPins are all of the pins that changed in the run and firstEdges the sample each of them first changed in
+struct edgeBatch {
+	size_t numEdges;
+	size_t samples[EDGE_BATCH_SIZE];
+	uint32_t levels[EDGE_BATCH_SIZE];
+	uint32_t rising[EDGE_BATCH_SIZE];
+	uint32_t falling[EDGE_BATCH_SIZE];
+	uint32_t changedPins;
+	size_t firstEdges[32];
+};
+
+//Everything the capture engine needs to remember between two calls of captureNextEvent
+struct laserCapture {
+	enum captureMode mode;
+	struct gpioBackend* gpio;
+
+	//The bits of the level register of every laser being watched, and their last known levels
+	uint32_t laserMask;
+	uint32_t levels;
+
+	//Edge mode: the pin and line event file descriptor of each laser and an event read ahead from each of them
+	int numLines;
+	int linePins[MAX_LASER_LINES];
+	int lineFds[MAX_LASER_LINES];
+	struct gpioevent_data pendingEvents[MAX_LASER_LINES];
+	int hasPendingEvent[MAX_LASER_LINES];
+
+	//Polling mode: when the level register was last read, how many times it has been read, how many of those reads
+	//were late and the longest time between two reads. The counts are written by the sampler thread and can be read
+	//from any other thread
+	timestamp_ns lastPoll;
+	atomic_ullong polls;
+	atomic_ullong latePolls;
+	atomic_ullong longestPollGap;
+
+	//Polling mode, continued: the time between reads while every hall is empty and while someone is in one, and
+	//whether to spin instead of sleeping between reads while someone is. busyLanes has a bit for every lane whose hall
+	//is not empty, set by the lane's state machine. The reads are due at nextPoll, every pollPeriod, and pollActive is
+	//whether that is the active period. Counted alongside the reads are the time spent at each rate, how late the
+	//sampler woke up for them and the CPU time the sampler thread has used
+	timestamp_ns idlePeriod;
+	timestamp_ns activePeriod;
+	int pollSpin;
+	atomic_uint busyLanes;
+	timestamp_ns nextPoll;
+	timestamp_ns pollPeriod;
+	int pollActive;
+	atomic_ullong idleTime;
+	atomic_ullong activeTime;
+	atomic_ullong wakeups;
+	atomic_ullong wakeLatency;
+	atomic_ullong longestWakeLatency;
+	atomic_ullong cpuTime;
+
+	//Stream mode: the stream being scanned, the number of its samples scanned so far and the times the scanner fell
+	//a whole buffer behind and had to skip samples. The edges found by the last scan that have not been handed out yet
+	//wait in batchEvents
+	struct sampleStream* stream;
+	size_t scanned;
+	atomic_ullong overruns;
+	struct laserEvent batchEvents[EDGE_BATCH_SIZE];
+	size_t numBatchEvents;
+	size_t nextBatchEvent;
+};
+
+//A lock-free ring of edges with a single producer, the sampler thread, and a single consumer, the state
+//machine. head and tail only ever grow and are kept on their own cache lines so the two threads do not fight
+//over them. overflows counts the edges dropped because the ring was full and highWater is the most edges
+//that have ever been waiting in it
+struct eventRing {
+	struct laserEvent events[EVENT_RING_SIZE];
+	_Alignas(64) atomic_size_t head;
+	_Alignas(64) atomic_size_t tail;
+	_Alignas(64) atomic_size_t overflows;
+	atomic_size_t highWater;
+};
+
+//What the sampler thread keeps for the state machine of one lane: the ring its edges are pushed into and an eventfd
+//the sampler writes to after every one of them, so that the state machine can sleep while its lane is quiet. mask is
+//the bits of the level register of the lane's lasers and levels the levels of the last edge handed to the state machine.
+//busy is whether the state machine last said someone was in its hall
+struct samplerLane {
+	struct eventRing ring;
+	int wakeFd;
+	uint32_t mask;
+	uint32_t levels;
+	int busy;
+
+	//When samplerNextEvent last woke up from waiting for the sampler, in real time, or 0 if it did not have to wait
+	timestamp_ns wokenAt;
+};
+
+//The thread that watches the lasers and everything the state machines need to talk to it. One capture engine
+//watches the lasers of every lane, so one read of the level register serves them all, and each edge is handed
+//to the lanes whose lasers it changed
+struct samplerThread {
+	struct laserCapture* capture;
+	struct samplerLane lanes[MAX_LANES];
+	int numLanes;
+
+	//The levels of the last edge the capture engine handed over
+	uint32_t levels;
+
+	//The CPU the sampler is pinned to, or -1 to let the scheduler choose, and the real-time priority it runs at, or 0
+	//for none. realtime is 1 once it is running at that priority and -1 if it could not be given it
+	int cpu;
+	int priority;
+	atomic_int realtime;
+
+	//The state machine of every lane starts the sampler once its own lasers are there, so starting it is locked
+	pthread_mutex_t startLock;
+	pthread_t thread;
+	int started;
+	atomic_int running;
+	atomic_int finished;
+};
+
+//What one LED is doing. solidOn is the state the LED rests in and, while blinksLeft is not 0, the LED is
+//blinking instead and switches every period nanoseconds, the next time being deadline
+struct ledEffect {
+	int pin;
+	int lit;
+	int solidOn;
+	int blinksLeft;
+	timestamp_ns period;
+	timestamp_ns deadline;
+};
+
+//The LED scheduler owns the LEDs, so that blinking them never holds up the state machine
+struct ledScheduler {
+	struct gpioBackend* gpio;
+	struct ledEffect effects[MAX_SCHEDULED_LEDS];
+	int numLeds;
+};
+
+//The two ways a person can walk through the hall. MOVING_RIGHT enters at laser 1 and leaves at laser 2
+enum travelDirection { MOVING_RIGHT, MOVING_LEFT };
+
+//How far a person has made it through the hall. TRANSIT_ENTERING and TRANSIT_EXITING mean they are breaking
+//the laser they came in through or are leaving through, TRANSIT_IN_HALL means they are between the lasers and
+//TRANSIT_OUT that they have left, but someone else could still turn out to have been the one leaving
+enum transitStage { TRANSIT_ENTERING, TRANSIT_IN_HALL, TRANSIT_EXITING, TRANSIT_OUT };
+
+//What the hall is doing, for the time it spends doing each. While several people are in the hall it is in the
+//stage the furthest along of them has reached
+enum hallState { HALL_EMPTY, HALL_ENTERING, HALL_IN_HALL, HALL_EXITING, HALL_STATES };
+
+//One person on their way through the hall. inHallTime and leftTime are when they stopped breaking the laser they came
+//in through and the one they left through
+struct transit {
+	enum transitStage stage;
+	timestamp_ns enteringTime;
+	timestamp_ns inHallTime;
+	timestamp_ns exitingTime;
+	timestamp_ns leftTime;
+	int warningIssued;
+};
+
+//The people walking in one direction, in the order they entered the hall
+struct transitQueue {
+	struct transit transits[MAX_TRANSITS_PER_DIRECTION];
+	int first;
+	int count;
+};
+
+//The transit tracker follows every person in the hall at once, up to MAX_TRANSITS_PER_DIRECTION each way.
+//Exits are matched to entries in the order people came in, one queue per direction
+struct transitTracker {
+	struct transitQueue queues[2];
+
+	//The levels of the last event, the level register bit of each laser, and when each laser was broken
+	//(0 if it is not) and last warned about
+	uint32_t levels;
+	uint32_t laserMasks[2];
+	timestamp_ns brokenSince[2];
+	timestamp_ns blockWarningTime[2];
+
+	//The distance between the lasers, in metres, and how long each laser's photodiode takes to answer, in nanoseconds,
+	//which is taken off the times of its edges
+	float distance;
+	int64_t latency[2];
+
+	long completed;
+	long lost;
+
+	//The reports that did not fit in the list handed back by trackEvent
+	long droppedReports;
+};
+
+//One person measured walking through the hall. direction is the way they walked and speed is in m/s
+struct speedMeasurement {
+	timestamp_ns timestamp;
+	enum travelDirection direction;
+	float speed;
+};
+
+//A fixed-size block of measurements. Pages are chained together in the order they were filled
+struct measurementPage {
+	struct measurementPage* next;
+	struct speedMeasurement measurements[MEASUREMENTS_PER_PAGE];
+};
+
+//The measurements of the current stats window. The store grows a page at a time, taking its pages from a
+//pool that is refilled with every page in use when the window rolls over, so after the busiest window so far
+//it never allocates again
+struct measurementStore {
+	struct measurementPage* firstPage;
+	struct measurementPage* lastPage;
+	int usedInLastPage;
+	int count;
+
+	struct measurementPage* freePages;
+	int pagesAllocated;
+	int pagesInUse;
+	int peakPagesInUse;
+};
+
+//The speeds of the people measured walking through the hall, either in one direction or in both
+struct directionStats {
+	int count;
+	float maxSpeed;
+	float minSpeed;
+	float averageSpeed;
+	float standardDeviation;
+};
+
+//A running summary of speeds that is updated once per person, so the stats of a window are ready without
+//going back over its measurements. The mean and variance are kept with Welford's method, m2 being the sum of
+//the squared differences from the mean
+struct speedAccumulator {
+	int count;
+	float maxSpeed;
+	float minSpeed;
+	double mean;
+	double m2;
+};
+
+//A fixed size log-linear histogram of speeds that the percentiles are read from. Two sketches are merged by
+//adding up their buckets, which is how the windows are rolled up into hours and days
+struct speedSketch {
+	uint32_t buckets[SKETCH_BUCKETS];
+	uint32_t total;
+};
+
+//The walk-throughs of calibration mode, each made at a known speed. Their travel times, before the latencies of the
+//lasers are taken off, are fitted to travelTime = distance / speed + offset when walking right and
+//distance / speed - offset when walking left, offset being how much later laser 2 answers than laser 1. The sums are
+//those of the least squares fit, with x = 1 / speed, s = 1 walking right and -1 walking left and t the travel time,
+//all in seconds
+struct calibrationRun {
+	long walks[2];
+	double sumXX;
+	double sumXS;
+	double sumXT;
+	double sumST;
+	double sumTT;
+};
+
+//One laser as the glitch filter sees it. raw is its level after the last edge, at rawSince, and level the level the
+//tracker has been given. history holds the laser's level at the last 32 ticks of the filter's sample clock, the newest
+//in bit 0, historyTick being the tick of the newest, and majority the level most of the last majoritySamples of them
+//had. While majority is not level it has been so since candidateSince, and the change is handed to the tracker, with
+//the time of the edge that started it, candidateEdge, once it has lasted long enough. excursion is 1 while raw has left
+//level and has neither come back nor been handed on
+struct glitchChannel {
+	int raw;
+	timestamp_ns rawSince;
+	int level;
+	uint32_t history;
+	uint64_t historyTick;
+	int majority;
+	timestamp_ns candidateSince;
+	timestamp_ns candidateEdge;
+	int excursion;
+};
+
+//A change of a laser the glitch filter has let through. commitTime is when it had lasted long enough and edgeTime the
+//time of the edge that started it, which is the time the tracker is given
+struct glitchCommit {
+	timestamp_ns commitTime;
+	timestamp_ns edgeTime;
+	int laser;
+	int level;
+};
+
+//The glitch filter between the sampler and the tracker of a lane, so that a photodiode flickering because of dust,
+//vibration or a bright light does not look like someone walking through. A change of a laser is only believed once most
+//of the last majoritySamples reads of it agree, the reads being samplePeriod nanoseconds apart, and then only once they
+//have kept agreeing for minPulse nanoseconds. minPulse[0] is for a laser being broken and minPulse[1] for it coming
+//back, so the two can be given different widths for hysteresis. With 1 read and no widths every edge goes straight
+//through. levels are the levels of the lasers the tracker has been given, rawLevels those of the last event, and
+//commits the changes let through by the last event that have not been handed out yet. glitches counts the flickers of
+//each laser that were thrown away
+struct glitchFilter {
+	uint32_t laserMasks[2];
+	timestamp_ns samplePeriod;
+	int majoritySamples;
+	timestamp_ns minPulse[2];
+
+	struct glitchChannel channels[2];
+	uint32_t levels;
+	uint32_t rawLevels;
+
+	struct glitchCommit commits[MAX_GLITCH_COMMITS];
+	int numCommits;
+	int nextCommit;
+
+	uint64_t glitches[2];
+};
+
+//The things the tracker can report back to measureSpeed
+enum trackerOutcome { TRANSIT_COMPLETED, TRANSIT_LOST, LASER_BLOCKED, HALL_BLOCKED };
+
+//Whether the log file is synced to the SD card after every batch of messages, and what happens to a message
+//when the logger is full
+enum logFsyncPolicy {LOG_FSYNC_NEVER, LOG_FSYNC_EVERY_BATCH};
+enum logOverflowPolicy {LOG_DROP_WHEN_FULL, LOG_BLOCK_WHEN_FULL};
+
+//How the logger looks after the log file, read from the config file. flushInterval is in milliseconds
+struct loggerSettings {
+	int flushInterval;
+	int fsyncPolicy;
+	int overflowPolicy;
+};
+
+//How long something took, counted in buckets of powers of 2 nanoseconds. Bucket i holds the times from 2^i up to 2^(i+1) ns
+struct latencyHistogram {
+	uint64_t buckets[LATENCY_BUCKETS];
+	uint64_t count;
+	double sum;
+	timestamp_ns max;
+};
+
+//One message waiting to be written to the log file
+struct logRecord {
+	int length;
+	char text[LOG_RECORD_SIZE];
+};
+
+//The logger keeps the messages in a ring until the writer thread writes them to the log file in one go. head is the
+//number of messages ever queued and tail the number ever written, so head - tail are waiting. Everything but the
+//records themselves is looked after by lock. The writer reads the records between tail and head without holding it,
+//which is safe because they are not written over until tail moves past them
+struct asyncLogger {
+	struct logRecord records[LOG_RECORDS];
+	uint64_t head;
+	uint64_t tail;
+
+	int fd;
+	struct loggerSettings settings;
+
+	pthread_mutex_t lock;
+	pthread_cond_t recordsWaiting;
+	pthread_cond_t spaceFree;
+	pthread_t thread;
+	int started;
+	int stopping;
+
+	//The time the oldest waiting message was queued, which the flush interval is counted from
+	timestamp_ns oldestQueued;
+
+	uint64_t dropped;
+	struct latencyHistogram enqueueLatency;
+	struct latencyHistogram writeLatency;
+};
+
+//The binary event log. started is 0 when there is no event log. Every lane queues its events in one ring, head being
+//the number of records ever queued and tail the number ever written, and a writer thread writes them out when a batch
+//is waiting, a stats window ends (flushed being head at the time) or the program stops. Everything but the records is
+//looked after by lock, and fd, size and the records between tail and head by the writer. It can touch those without
+//holding the lock, because they are not written over until tail moves past them
+struct eventLog {
+	struct speedlogRecord records[EVENT_LOG_RECORDS];
+	uint64_t head;
+	uint64_t tail;
+	uint64_t flushed;
+	uint64_t dropped;
+
+	int fd;
+	char fileName[CONFIG_NAME_SIZE];
+	off_t size;
+	off_t maxSize;
+	int overflowPolicy;
+
+	pthread_mutex_t lock;
+	pthread_cond_t recordsWaiting;
+	pthread_cond_t spaceFree;
+	pthread_t thread;
+	int started;
+	int stopping;
+};
+
+//One report from the tracker. laser is 0 or 1 for laser 1 or 2 (or -1 if no laser is involved) and speed
+//and travelTime, the time between the person breaking the two lasers, are only set for a completed transit
+struct trackerReport {
+	enum trackerOutcome outcome;
+	enum travelDirection direction;
+	int laser;
+	timestamp_ns timestamp;
+	float speed;
+	int64_t travelTime;
+};
+
+//What measureSpeed measures about itself while it runs, all in real time. decisionLatency is the time from an edge
+//being captured to everything it caused being done, loopPeriod the time between the starts of two turns of the
+//loop, and the sums of the loop periods and of their squares give the jitter. These are only kept for one turn in every
+//METRICS_SAMPLE_TURNS. busyTime is the time from the end of one wait for an edge to the start of the next, kept for
+//every turn, its longest being the longest stall of the loop, missedEdges counts the edges that
+//changed no laser or more than one, so that another edge must have been missed, glitches the flickers of each laser the
+//glitch filter threw away, and stateTime is the time, on the
+//clock of the GPIO backend, the hall has spent in each hallState
+struct pipelineMetrics {
+	uint64_t iterations;
+	uint64_t edges;
+	uint64_t transits;
+	uint64_t missedEdges;
+	uint64_t glitches[2];
+	struct latencyHistogram decisionLatency;
+	struct latencyHistogram loopPeriod;
+	struct latencyHistogram busyTime;
+	double loopPeriodSum;
+	double loopPeriodSquares;
+	timestamp_ns stateTime[HALL_STATES];
+
+	//What has happened in the hall since the program started, for each direction. speedBins count the speeds
+	//measured in the bins of the stats file histogram and speedSum adds them up, and occupancy is the number of
+	//people in the hall right now
+	uint64_t directionTransits[2];
+	uint64_t speeders[2];
+	uint64_t lost[2];
+	uint64_t offTheCharts;
+	uint64_t laserBlocked;
+	uint64_t hallBlocked;
+	uint64_t speedBins[HISTOGRAM_BINS];
+	double speedSum;
+	int occupancy;
+
+	//When measureSpeed started, in real time
+	timestamp_ns started;
+
+	//Leaves out the loop period, busy time and decision latency, with the reads of the clock they need, only so that
+	//the pipeline benchmark can find out what they cost
+	int untimed;
+};
+
+//The thread that serves the metrics on a Unix domain socket and writes the metrics file, so that neither ever holds
+//up the state machine. measureSpeed hands it a copy of the metrics of its lane every METRICS_PUBLISH_INTERVAL
+//milliseconds and the server takes its own copy of those to format, so the lock is only ever held for a copy.
+//Everything it needs is in here, so nothing is allocated for a scrape
+struct metricsServer {
+	struct samplerThread* sampler;
+	int numLanes;
+	struct asyncLogger* logFile;
+
+	//The metrics file and the socket, either of which can be empty for none, and the socket listening on it
+	char fileName[CONFIG_NAME_SIZE];
+	char socketName[CONFIG_NAME_SIZE];
+	int listenFd;
+
+	pthread_mutex_t lock;
+	struct pipelineMetrics published[MAX_LANES];
+	struct pipelineMetrics snapshot[MAX_LANES];
+	char buffer[METRICS_BUFFER_SIZE];
+
+	//An eventfd to wake the thread up when it is time for it to stop
+	int stopFd;
+	pthread_t thread;
+	int started;
+	atomic_int running;
+};
+
+//The settings of one lane: the pins of its lasers and its warning LED (-1 for none), its speed limits in m/s, the
+//distance between its lasers in metres, the latencies of its lasers in microseconds and the settings of its glitch
+//filter, the widths being in microseconds
+struct laneConfig {
+	int laserPins[2];
+	int warningLedPin;
+	float speedLimit;
+	float speedLimits[2];
+	float distance;
+	float laserLatency[2];
+	float minPulse[2];
+	int majoritySamples;
+};
+
+//Everything read from the config file. The watchdog timeout and statsFrequency are in seconds and eventLogSize is in
+//kilobytes. The names of the event log and the metrics file and socket are empty when there are none, and
+//calibrationSpeed, in m/s, is 0 unless the program is being calibrated. The first numLanes of lanes are watched
+struct speedometerConfig {
+	int watchdogTimeout;
+	char logFileName[CONFIG_NAME_SIZE];
+	char statsFileName[CONFIG_NAME_SIZE];
+	int statsFrequency;
+	struct loggerSettings logSettings;
+	char eventLogName[CONFIG_NAME_SIZE];
+	int eventLogSize;
+	char metricsFileName[CONFIG_NAME_SIZE];
+	char metricsSocketName[CONFIG_NAME_SIZE];
+	float calibrationSpeed;
+	float idlePollPeriod;
+	float activePollPeriod;
+	int pollSpin;
+	int numLanes;
+	struct laneConfig lanes[MAX_LANES];
+};
+
+//The kinds of values in the config file. Numbers can be given with a unit after them, and are converted to the first
+//unit of their type
+enum configValueType { CONFIG_NAME, CONFIG_SWITCH, CONFIG_PIN, CONFIG_COUNT, CONFIG_SPEED, CONFIG_DISTANCE, CONFIG_SECONDS, CONFIG_MILLISECONDS, CONFIG_MICROSECONDS, CONFIG_KILOBYTES, CONFIG_VALUE_TYPES };
+
+//A unit a number in the config file can be given in, and what to multiply by to get the first unit of its type
+struct configUnit {
+	const char* name;
+	double factor;
+};
+
+static const struct configUnit speedUnits[] = { { "m/s", 1 }, { "km/h", 1 / 3.6 }, { "mph", 0.44704 }, { NULL, 0 } };
+static const struct configUnit distanceUnits[] = { { "m", 1 }, { "cm", 0.01 }, { "mm", 0.001 }, { "ft", 0.3048 }, { NULL, 0 } };
+static const struct configUnit secondUnits[] = { { "s", 1 }, { "ms", 0.001 }, { "min", 60 }, { "h", 3600 }, { NULL, 0 } };
+static const struct configUnit millisecondUnits[] = { { "ms", 1 }, { "s", 1000 }, { "min", 60000 }, { NULL, 0 } };
+static const struct configUnit microsecondUnits[] = { { "us", 1 }, { "ns", 0.001 }, { "ms", 1000 }, { NULL, 0 } };
+static const struct configUnit kilobyteUnits[] = { { "KB", 1 }, { "K", 1 }, { "MB", 1024 }, { "M", 1024 }, { "GB", 1048576 }, { NULL, 0 } };
+
+static const struct configUnit* const configUnits[CONFIG_VALUE_TYPES] = {
+	[CONFIG_SPEED] = speedUnits,
+	[CONFIG_DISTANCE] = distanceUnits,
+	[CONFIG_SECONDS] = secondUnits,
+	[CONFIG_MILLISECONDS] = millisecondUnits,
+	[CONFIG_MICROSECONDS] = microsecondUnits,
+	[CONFIG_KILOBYTES] = kilobyteUnits
+};
+
+//The units of each type, for the error messages
+static const char* const configUnitNames[CONFIG_VALUE_TYPES] = {
+	[CONFIG_SPEED] = "m/s, km/h or mph",
+	[CONFIG_DISTANCE] = "m, cm, mm or ft",
+	[CONFIG_SECONDS] = "s, ms, min or h",
+	[CONFIG_MILLISECONDS] = "ms, s or min",
+	[CONFIG_MICROSECONDS] = "us, ns or ms",
+	[CONFIG_KILOBYTES] = "KB, MB or GB"
+};
+
+//One setting of the config file: its name, its type, where it goes in the config (or, for the settings of a lane, in
+//the laneConfig) and the smallest and biggest values it can have, in the first unit of its type. For names, max is the
+//most characters they can have
+struct configKey {
+	const char* name;
+	enum configValueType type;
+	size_t offset;
+	double min;
+	double max;
+};
+
+static const struct configKey configKeys[] = {
+	{ "WATCHDOG_TIMEOUT", CONFIG_SECONDS, offsetof(struct speedometerConfig, watchdogTimeout), 1, 15 },
+	{ "LOGFILE", CONFIG_NAME, offsetof(struct speedometerConfig, logFileName), 0, CONFIG_NAME_SIZE - 1 },
+	{ "STATSFILE", CONFIG_NAME, offsetof(struct speedometerConfig, statsFileName), 0, CONFIG_NAME_SIZE - 1 },
+	{ "DURATION", CONFIG_SECONDS, offsetof(struct speedometerConfig, statsFrequency), 1, SECONDS_PER_DAY },
+	{ "STATS_FREQUENCY", CONFIG_SECONDS, offsetof(struct speedometerConfig, statsFrequency), 1, SECONDS_PER_DAY },
+	{ "CALIBRATION_SPEED", CONFIG_SPEED, offsetof(struct speedometerConfig, calibrationSpeed), 0, 100 },
+	{ "LOG_FLUSH_INTERVAL", CONFIG_MILLISECONDS, offsetof(struct speedometerConfig, logSettings.flushInterval), 1, 60000 },
+	{ "LOG_FSYNC", CONFIG_SWITCH, offsetof(struct speedometerConfig, logSettings.fsyncPolicy), 0, 1 },
+	{ "LOG_WHEN_FULL", CONFIG_SWITCH, offsetof(struct speedometerConfig, logSettings.overflowPolicy), 0, 1 },
+	{ "EVENTLOG", CONFIG_NAME, offsetof(struct speedometerConfig, eventLogName), 0, CONFIG_NAME_SIZE - 1 },
+	{ "EVENTLOG_SIZE", CONFIG_KILOBYTES, offsetof(struct speedometerConfig, eventLogSize), 1, 4194304 },
+	{ "METRICS_FILE", CONFIG_NAME, offsetof(struct speedometerConfig, metricsFileName), 0, CONFIG_NAME_SIZE - 1 },
+	{ "METRICS_SOCKET", CONFIG_NAME, offsetof(struct speedometerConfig, metricsSocketName), 0, sizeof(((struct sockaddr_un*)0)->sun_path) - 1 },
+	{ "IDLE_POLL_PERIOD", CONFIG_MICROSECONDS, offsetof(struct speedometerConfig, idlePollPeriod), 10, CAPTURE_TIMEOUT_MS * 1000 },
+	{ "ACTIVE_POLL_PERIOD", CONFIG_MICROSECONDS, offsetof(struct speedometerConfig, activePollPeriod), 10, CAPTURE_TIMEOUT_MS * 1000 },
+	{ "POLL_SPIN", CONFIG_SWITCH, offsetof(struct speedometerConfig, pollSpin), 0, 1 }
+};
+
+//The settings every lane has. Given as they are they are the settings of the first lane, and with LANE<n>_ in front of
+//them, like LANE2_SPEED_LIMIT, those of lane n
+static const struct configKey laneConfigKeys[] = {
+	{ "LASER1_PIN", CONFIG_PIN, offsetof(struct laneConfig, laserPins[0]), 2, 27 },
+	{ "LASER2_PIN", CONFIG_PIN, offsetof(struct laneConfig, laserPins[1]), 2, 27 },
+	{ "WARNING_LED", CONFIG_PIN, offsetof(struct laneConfig, warningLedPin), 2, 27 },
+	{ "SPEED_LIMIT", CONFIG_SPEED, offsetof(struct laneConfig, speedLimit), 0, 100 },
+	{ "SPEED_LIMIT_RIGHT", CONFIG_SPEED, offsetof(struct laneConfig, speedLimits[MOVING_RIGHT]), 0, 100 },
+	{ "SPEED_LIMIT_LEFT", CONFIG_SPEED, offsetof(struct laneConfig, speedLimits[MOVING_LEFT]), 0, 100 },
+	{ "DISTANCE_BETWEEN_LASERS", CONFIG_DISTANCE, offsetof(struct laneConfig, distance), 0.01, 100 },
+	{ "LASER1_LATENCY", CONFIG_MICROSECONDS, offsetof(struct laneConfig, laserLatency[0]), -100000, 100000 },
+	{ "LASER2_LATENCY", CONFIG_MICROSECONDS, offsetof(struct laneConfig, laserLatency[1]), -100000, 100000 },
+	{ "MIN_BREAK_TIME", CONFIG_MICROSECONDS, offsetof(struct laneConfig, minPulse[0]), 0, 1000000 },
+	{ "MIN_RESTORE_TIME", CONFIG_MICROSECONDS, offsetof(struct laneConfig, minPulse[1]), 0, 1000000 },
+	{ "MAJORITY_SAMPLES", CONFIG_COUNT, offsetof(struct laneConfig, majoritySamples), 1, MAX_MAJORITY_SAMPLES }
+};
+
+//The thread that reads the config file again when it changes or the program is sent SIGHUP. It reads and checks the
+//new config on its own thread and leaves a copy of it in pending for the state machine of each lane, which swaps it in
+//between two edges, so the lasers are never stopped for it. A config with a mistake in it is logged and left out
+struct configWatcher {
+	char fileName[CONFIG_NAME_SIZE];
+	struct asyncLogger* logFile;
+
+	//The inotify watch on the directory of the config file, so that editors that write a new file and move it over
+	//the old one are noticed too, a signalfd for SIGHUP and an eventfd for stopping the thread
+	int inotifyFd;
+	int signalFd;
+	int stopFd;
+
+	int numLanes;
+	_Atomic(struct speedometerConfig*) pending[MAX_LANES];
+
+	pthread_t thread;
+	int started;
+	atomic_int running;
+};
+
+//The watchdog, kept from rebooting the Pi only while the state machine of every lane is still going round its loop.
+//Each lane counts its turns in turns, and the first lane only pings the watchdog once every lane has turned since the
+//last ping, lastTurns being the counts then. fd is -1 when there is no watchdog
+struct laneWatchdog {
+	int fd;
+	int numLanes;
+	atomic_ullong turns[MAX_LANES];
+	unsigned long long lastTurns[MAX_LANES];
+};
+
+//Everything the state machine of a lane other than the first is given, as it runs on a thread of its own
+struct laneThread {
+	int lane;
+	struct gpioBackend* gpio;
+	struct samplerThread* sampler;
+	struct laneWatchdog* watchdog;
+	const struct speedometerConfig* config;
+	struct configWatcher* configWatcher;
+	struct asyncLogger* logFile;
+	FILE* statsFile;
+	struct eventLog* eventLog;
+	struct pipelineMetrics* metrics;
+	struct metricsServer* metricsServer;
+
+	pthread_t thread;
+	int started;
+};
+
+//One made up change of a laser, used to feed the tracker synthetic traffic. blocking is 1 when a person
+//starts blocking the laser and 0 when they stop
+struct syntheticEdge {
+	timestamp_ns timestamp;
+	int laser;
+	int blocking;
+};
+
+//One person of the synthetic traffic: the way they walked, their speed in m/s, and when they broke the laser they came
+//in through and stopped breaking the one they left through
+struct syntheticPerson {
+	enum travelDirection direction;
+	double speed;
+	timestamp_ns entering;
+	timestamp_ns leaving;
+};
+
+//One lane of the lane benchmark: its tracker, and the sampler that hands it its edges
+struct laneBenchmark {
+	struct transitTracker tracker;
+	struct samplerThread* sampler;
+	int lane;
+};
+
+//The ways the jitter benchmark sleeps between wake-ups: for a period after every wake-up with usleep, the way the
+//polling loop used to, until the next time on a grid with clock_nanosleep, and the same at real-time priority
+enum jitterMode { JITTER_USLEEP, JITTER_ABSOLUTE, JITTER_REALTIME, JITTER_MODES };
+
+//One run of the jitter benchmark, on the given CPU, while loading is set a thread at normal priority spinning on the
+//same CPU. lateness is how late every wake-up came after the time it was meant for, periodSum and periodSquares add up
+//the times between them and realtime is -1 if the run could not be given real-time priority
+struct jitterRun {
+	enum jitterMode mode;
+	int cpu;
+	atomic_int loading;
+	struct latencyHistogram lateness;
+	double periodSum;
+	double periodSquares;
+	int realtime;
+};
+
 //All function declarations
 GPIO_Handle initializeGPIO();																																	//Defined on line 240
 
-int laserDiodeStatus(GPIO_Handle gpio, int diodeNumber);																										//Defined on line 256
+int sampleLasers(struct gpioBackend* gpio, uint32_t laserMask, struct laserSample* sample);
 
-void setToOutput(GPIO_Handle gpio, int pinNumber);																												//Defined on line 288
+timestamp_ns getMonotonicTime();
 
-void outputOn(GPIO_Handle gpio, int pinNumber);																													//Defined on line 331
+timestamp_ns gpioTime(struct gpioBackend* gpio);
 
-void outputOff(GPIO_Handle gpio, int pinNumber);																												//Defined on line 337
+void initMmioBackend(struct mmioBackend* mmio, GPIO_Handle gpio);
 
-void getTime(char* buffer);																																		//Defined on line 342
+uint32_t mmioReadLevels(struct gpioBackend* backend);
 
-void readConfig(FILE* configFile, int* timeout, char* logFileName, char* statsFileName, int* statsFrequency, int* speedLimit, int* distanceBetweenLasers);		//Defined on line 363
+void mmioSetToOutput(struct gpioBackend* backend, int pinNumber);
 
-void computeStats(float* maxSpeed, float* minSpeed, float* averageSpeed, float objectSpeeds[], int peoplePassedThrough);										//Defined on line 490
+void mmioWritePin(struct gpioBackend* backend, int pinNumber, int on);
 
-void measureSpeed(GPIO_Handle gpio, int watchdog, const int statsFrequency, const int speedLimit, const int distance, FILE* logFile, FILE* statsFile);			//Defined on line 511
+timestamp_ns realTime(struct gpioBackend* backend);
 
-int main(const int argc, const char* const argv[])	{
+void initLedRecorder(struct ledRecorder* recorder, struct gpioBackend* clock);
 
-	//Create a string that contains the program name
-	const char* argName = argv[0];
+uint32_t recorderReadLevels(struct gpioBackend* backend);
 
-	//These variables will be used to count how long the name of the program is
-	int i = 0;
-	int namelength = 0;
+void recorderSetToOutput(struct gpioBackend* backend, int pinNumber);
 
-	//Find the length of the program name
-	while(argName[i] != 0)	{
-		namelength++;
-		i++;
-	} 
+void recorderWritePin(struct gpioBackend* backend, int pinNumber, int on);
 
-	//The name of the program
-	char programName[namelength];
-	i = 0;
+timestamp_ns recorderTime(struct gpioBackend* backend);
 
-	//Copy the name of the program without the ./ at the start
-	//of argv[0]
-	while(argName[i + 2] != 0)	{
-		programName[i] = argName[i + 2];
-		i++;
-	} 
-	
-	//The name of the config file
-	const char* configFileName = "/home/pi/speedometer.cfg";
+void initReplayBackend(struct replayBackend* replay, uint32_t laserMask);
 
-	//Open the config file
-	FILE* configFile;
-	configFile = fopen(configFileName, "r");
+int addReplayEdge(struct replayBackend* replay, size_t* capacity, timestamp_ns timestamp, uint32_t levels);
 
-	//Output a warning message to the error stream and the log file if the file cannot be openned
-	if(!configFile)	{
-		#ifndef RUN_AS_SERVICE
-		perror("The config file could not be opened; exiting\n");
-		#endif
+int loadTraceFile(struct replayBackend* replay, const char* fileName);
 
-		return -1;
-	}
+int loadSyntheticTrace(struct replayBackend* replay, struct syntheticPerson* people, int numPeople, double meanHeadway, double minSpeed, double maxSpeed, double distance, const uint32_t laserMasks[2], unsigned int seed);
 
-	//Declare the variables that will be passed to the readConfig function
-	int timeout = 0;
-	char logFileName[50];
-	char statsFileName[50];
-	int statsFrequency = DEFAULT_STATS_FREQUENCY;
-	int speedLimit = DEFAULT_SPEED_LIMIT;
-	int distanceBetweenLasers = DEFAULT_LASER_DISTANCE;
+uint32_t replayReadLevels(struct gpioBackend* backend);
 
-	//Create a char array that will be used to hold the time values
-	char time[30];
-	getTime(time);
+void replaySetToOutput(struct gpioBackend* backend, int pinNumber);
 
-	//Call the readConfig function to read from the config file
-	readConfig(configFile, &timeout, logFileName, statsFileName, &statsFrequency, &speedLimit, &distanceBetweenLasers);
+void replayWritePin(struct gpioBackend* backend, int pinNumber, int on);
 
-	//Close the configFile now that we have finished reading from it
-	fclose(configFile);
+timestamp_ns replayTime(struct gpioBackend* backend);
 
-	//Create a new file pointer to point to the log file and stats file
-	FILE* logFile;
-	FILE* statsFile;
+int replayNextEdge(struct gpioBackend* backend, struct laserEvent* event, int timeoutMs);
 
-	//Set it to point to the file from the log and stats files and make it append to
-	//the file when it writes to it.
-	logFile = fopen(logFileName, "a");
-	statsFile = fopen(statsFileName, "a");
+void freeReplayBackend(struct replayBackend* replay);
 
-	//Check that the file opens properly.
-	if(!logFile)	{
-		#ifndef RUN_AS_SERVICE
-		perror("The log file could not be opened; exiting\n");
-		#endif
+float computeSpeed(float distance, timestamp_ns enteringTime, timestamp_ns exitingTime);
 
-		return -1;
-	}
+void initTracker(struct transitTracker* tracker, float distance, const uint32_t laserMasks[2], uint32_t levels);
 
-	#ifndef RUN_AS_SERVICE
-	printf("Timeout Time: %d Log File Name: %s statsFileName: %s statsFrequency: %d Speed Limit: %d Distance Between Lasers: %d \n\n", timeout, logFileName, statsFileName, statsFrequency, speedLimit, distanceBetweenLasers);
-	#endif
+void calibrateTracker(struct transitTracker* tracker, float distance, const float latencies[2]);
 
-	//Initialize the GPIO pins
-	GPIO_Handle gpio = initializeGPIO();
-	//Get the current time
-	getTime(time);
-	//Log that the GPIO pins have been initialized
-	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The GPIO pins have been initialized\n\n");
+void addCalibrationWalk(struct calibrationRun* run, enum travelDirection direction, float speed, int64_t travelTime, const float latencies[2]);
 
-	#ifndef RUN_AS_SERVICE
-	printf("Successful initialization of the GPIO pins\n");
-	#endif
+int solveCalibration(const struct calibrationRun* run, float distance, double* fittedDistance, double* offset, double* residual);
 
-	//This variable will be used to access the /dev/watchdog file, similar to how
-	//the GPIO_Handle works
-	int watchdog;
+void printCalibration(FILE* output, const struct calibrationRun* run, const struct speedometerConfig* config, int lane);
 
-	//We use the open function here to open the /dev/watchdog file. If it does
-	//not open, then we output an error message. We do not use fopen() because we
-	//do not want to create a file if it doesn't exist
-	if ((watchdog = open("/dev/watchdog", O_RDWR | O_NOCTTY)) < 0) {
-		#ifndef RUN_AS_SERVICE
-		printf("Error: Couldn't open watchdog device! %d\n", watchdog);
-		#endif
+void addReport(struct transitTracker* tracker, struct trackerReport reports[], int* numReports, int maxReports, enum trackerOutcome outcome, enum travelDirection direction, int laser, timestamp_ns timestamp, float speed, int64_t travelTime);
 
-		getTime(time);
-		PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The watchdog was unable to be opened!\n\n");
-		return -1;
-	} 
-	//Get the current time
-	getTime(time);
-	//Log that the watchdog file has been opened
-	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The Watchdog file has been opened\n\n");
+struct transit* queuedTransit(struct transitQueue* queue, int position);
 
-	//This line uses the ioctl function to set the time limit of the watchdog
-	//timer to 15 seconds. The time limit can not be set higher that 15 seconds
-	//so please make a note of that when creating your own programs.
-	//If we try to set it to any value greater than 15, then it will reject that
-	//value and continue to use the previously set time limit
-	ioctl(watchdog, WDIOC_SETTIMEOUT, &timeout);
-	
-	//Get the current time
-	getTime(time);
-	//Log that the Watchdog time limit has been set
-	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The Watchdog time limit has been set\n\n");
+void removeTransit(struct transitQueue* queue, int position);
 
-	//The value of timeout will be changed to whatever the current time limit of the
-	//watchdog timer is
-	ioctl(watchdog, WDIOC_GETTIMEOUT, &timeout);
+void insertTransit(struct transitTracker* tracker, enum travelDirection direction, int laser, timestamp_ns enteringTime, timestamp_ns inHallTime, struct trackerReport reports[], int* numReports, int maxReports);
 
-	//This print statement will confirm to us if the time limit has been properly
-	//changed.
-	#ifndef RUN_AS_SERVICE
-	printf("The watchdog timeout is %d seconds.\n\n", timeout);
-	#endif
+double exitError(struct transitTracker* tracker, const struct transit* transit, timestamp_ns timestamp);
 
-	//Set the pins for the LED's to outputs
-	setToOutput(gpio, RUNNING_LED_PIN);
-	setToOutput(gpio, WARNING_LED_PIN);
+double exitFit(struct transitTracker* tracker, const struct transit* transit, timestamp_ns exitingTime, timestamp_ns leftTime);
 
-	//Logs that the LED pins have been set to outputs
-	getTime(time);
-	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The LED pins have been set as outputs\n\n");
+timestamp_ns exitDeadline(struct transitTracker* tracker, const struct transit* transit);
 
-	//Calls the main function which monitors the hall activity
-	measureSpeed(gpio, watchdog, statsFrequency, speedLimit, distanceBetweenLasers, logFile, statsFile);
+int exitCandidate(struct transitTracker* tracker, struct transitQueue* queue, timestamp_ns timestamp);
 
-	return 0;
-}
+void completeTransit(struct transitTracker* tracker, enum travelDirection direction, int position, struct trackerReport reports[], int* numReports, int maxReports);
 
-GPIO_Handle initializeGPIO()	{													//This function initializes the GPIO and outputs an error if the GPIO has any issues initializing
-	GPIO_Handle gpio;
-	gpio = gpiolib_init_gpio();
-	if(gpio == NULL)	{
-		#ifndef RUN_AS_SERVICE
-		perror("Could not initialize GPIO");
-		#endif
-	}
+void laserBroken(struct transitTracker* tracker, int laser, timestamp_ns timestamp, struct trackerReport reports[], int* numReports, int maxReports);
 
-	return gpio;	
-}
+void laserRestored(struct transitTracker* tracker, int laser, timestamp_ns timestamp, struct trackerReport reports[], int* numReports, int maxReports);
 
-//This function should accept the diode number (1 or 2) and output
-//a 0 if the laser beam is not reaching the diode, a 1 if the laser
-//beam is reaching the diode or -1 if an error occurs.
+void checkTrackerTimers(struct transitTracker* tracker, timestamp_ns now, struct trackerReport reports[], int* numReports, int maxReports);
 
-int laserDiodeStatus(GPIO_Handle gpio, int diodeNumber)	{						//This function checks the status of the given laser diode. Outputs a 1 if the diode is receiving the laser beam and 0 if it is not. 	
+timestamp_ns trackerDeadline(struct transitTracker* tracker);
 
-	if(gpio == NULL)
-		return -1;
+int trackEvent(struct transitTracker* tracker, const struct laserEvent* event, struct trackerReport reports[], int maxReports);
 
-	if(diodeNumber == 1)	{
-		//If the photodiode is receiving a laser signal, return 1, else, return 0
-		uint32_t level_reg = gpiolib_read_reg(gpio, GPLEV(0));
+int trackerOccupancy(struct transitTracker* tracker);
 
-		if(level_reg & (1 << LASER1_PIN_NUM))
-			return 1;
+enum hallState trackerHallState(struct transitTracker* tracker);
 
-		else
-			return 0;
-	}
-	if(diodeNumber == 2)	{
+void initGlitchFilter(struct glitchFilter* filter, const uint32_t laserMasks[2], uint32_t levels, timestamp_ns samplePeriod);
 
-		//If the photodiode is receiving a laser signal, return 1, else, return 0
-		uint32_t level_reg = gpiolib_read_reg(gpio, GPLEV(0));
+void setGlitchFilter(struct glitchFilter* filter, int majoritySamples, const float minPulse[2]);
 
-		if(level_reg & (1 << LASER2_PIN_NUM))
-			return 1;
+int majorityTicks(const struct glitchChannel* channel, int majoritySamples, uint64_t maxTicks);
 
-		else
-			return 0;
-	}
-	else
-		return -1;
-}
+void commitGlitch(struct glitchFilter* filter, int laser, timestamp_ns commitTime);
 
-//This function will change the appropriate pins value in the select register
-//so that the pin can function as an output
-void setToOutput(GPIO_Handle gpio, int pinNumber)	{
-	//Check that the gpio is functional
-	if(gpio == NULL)
-	{
-		#ifndef RUN_AS_SERVICE
-		printf("The GPIO has not been intitialized properly \n");
-		#endif
+void settleGlitch(struct glitchFilter* filter, int laser);
 
-		return;
-	}
+void swingMajority(struct glitchFilter* filter, int laser, timestamp_ns swingTime, timestamp_ns now);
 
-	//Check that we are trying to set a valid pin number
-	if(pinNumber < 2 || pinNumber > 27)
-	{
-		#ifndef RUN_AS_SERVICE
-		printf("Not a valid pinNumer \n");
-		#endif
+void advanceGlitchFilter(struct glitchFilter* filter, int laser, timestamp_ns now);
 
-		return;
-	}
+void filterEvent(struct glitchFilter* filter, const struct laserEvent* event);
 
-	//This will create a variable that has the appropriate select
-	//register number. For more information about the registers
-	//look up BCM 2835.
-	int registerNum = pinNumber / 10;
+int nextFilteredEvent(struct glitchFilter* filter, struct laserEvent* event);
 
-	//This will create a variable that is the appropriate amount that 
-	//the 1 will need to be shifted by to set the pin to be an output
-	int bitShift = (pinNumber % 10) * 3;
+timestamp_ns glitchDeadline(struct glitchFilter* filter);
 
-	#ifndef RUN_AS_SERVICE
-	printf("registerNum: %d\t bitShift: %d\n",registerNum,bitShift);
-	#endif
+int compareSyntheticEdges(const void* first, const void* second);
 
-	//This is the same code that was used in Lab 2, except that it uses
-	//variables for the register number and the bit shift
-	uint32_t sel_reg = gpiolib_read_reg(gpio, GPFSEL(registerNum));
-	sel_reg |= 1  << bitShift;
-	gpiolib_write_reg(gpio, GPFSEL(registerNum), sel_reg);
-}
+int comparePeopleLeaving(const void* first, const void* second);
 
-//This function will make an output pin output 3.3V. It is the same
-//as what was done in Lab 2 to make the pin output 3.3V
-void outputOn(GPIO_Handle gpio, int pinNumber)	{
-	gpiolib_write_reg(gpio, GPSET(0), 1 << pinNumber);
-}
+int generateTraffic(struct syntheticEdge* edges, struct syntheticPerson* people, int numPeople, double meanHeadway, double minSpeed, double maxSpeed, double distance, unsigned int* seed);
 
-//This function will make an output pin turn off. It is the same
-//as what was done in Lab 2 to make the pin turn off
-void outputOff(GPIO_Handle gpio, int pinNumber)	{
-	gpiolib_write_reg(gpio, GPCLR(0), 1 << pinNumber);
-}
+int syntheticEvents(const struct syntheticEdge* edges, int numEdges, const uint32_t laserMasks[2], struct laserEvent* events);
 
-//This function will get the current time using the gettimeofday function
-void getTime(char* buffer)	{
-	//Create a timeval struct named tv
-  	struct timeval tv;
+int checkTrackedTraffic(struct transitTracker* tracker, const struct laserEvent* events, int numEvents, struct syntheticPerson* people, int numPeople);
 
-	//Create a time_t variable named curtime
-  	time_t curtime;
+int runTrackerBenchmark(FILE* results);
 
-	//Get the current time and store it in the tv struct
-  	gettimeofday(&tv, NULL); 
+int addFlickers(struct syntheticEdge* edges, int numEdges, int maxEdges, unsigned int* seed);
 
-	//Set curtime to be equal to the number of seconds in tv
-  	curtime=tv.tv_sec;
+int filterTraffic(const struct laserEvent* events, int numEvents, const uint32_t laserMasks[2], struct glitchFilter* filter, struct transitTracker* tracker, struct speedMeasurement* measured, int maxMeasured);
 
-	//This will set buffer to be equal to a string that in
-	//equivalent to the current date, in a month, day, year and
-	//the current time in 24 hour notation.
-  	strftime(buffer,30,"%m-%d-%Y  %T.",localtime(&curtime));
-} 
+int compareMeasurementTimes(const void* first, const void* second);
 
-//This is a function used to read from the config file. It is not implemented very
-//well, so when you create your own you should try to create a more effective version
-void readConfig(FILE* configFile, int* timeout, char* logFileName, char* statsFileName, int* statsFrequency, int* speedLimit, int* distanceBetweenLasers)	{
-	//Loop counter
-	int i = 0;
-	
-	//A char array to act as a buffer for the file
-	char buffer[255];
+int matchTransits(const struct speedMeasurement* first, int numFirst, const struct speedMeasurement* second, int numSecond);
 
-	//The value of the timeout variable is set to zero at the start
-	*timeout = 0;
-
-	//The value of duration is set to zero at the start
-	*statsFrequency = 0;
-
-	//The value of the numBlinks variable is set to zero at the start
-	*speedLimit = 0;
-
-	//The value of distanceBetweenLasers is set to zero at the start
-	*distanceBetweenLasers = 0;
-
-	//This is a variable used to track which input we are currently looking
-	//for (timeout, logFileName or numBlinks)
-	int input = 0;
-
-	//This will 
-	//fgets(buffer, 255, configFile);
-	//This will check that the file can still be read from and if it can,
-	//then the loop will check to see if the line may have any useful 
-	//information.
-	while(fgets(buffer, 255, configFile) != NULL)	{
-		i = 0;
-		//If the starting character of the string is a '#', 
-		//then we can ignore that line
-		if(buffer[i] != '#')	{
-			while(buffer[i] != 0)	{
-				//This if will check the value of timeout
-				if(buffer[i] == '=' && input == 0)	{
-					//The loop runs while the character is not null
-					while(buffer[i] != 0)	{
-						//If the character is a number from 0 to 9
-						if(buffer[i] >= '0' && buffer[i] <= '9')	{
-							//Move the previous digits up one position and add the
-							//new digit
-							*timeout = (*timeout * 10) + (buffer[i] - '0');
-						}
-						i++;
-					}
-					input++;
-				}
-				else if(buffer[i] == '=' && input == 1)	{ //This will find the name of the log file
-					int j = 0;
-					//Loop runs while the character is not a newline or null
-					while(buffer[i] != 0  && buffer[i] != '\n')	{
-						//If the characters after the equal sign are not spaces or
-						//equal signs, then it will add that character to the string
-						if(buffer[i] != ' ' && buffer[i] != '=')	{
-							logFileName[j] = buffer[i];
-							j++;
-						}
-						i++;
-					}
-					//Add a null terminator at the end
-					logFileName[j] = 0;
-					input++;
-				}
-				else if(buffer[i] == '=' && input == 2)	{ //This will find the name of the log file
-					int j = 0;
-					//Loop runs while the character is not a newline or null
-					while(buffer[i] != 0  && buffer[i] != '\n')	{
-						//If the characters after the equal sign are not spaces or
-						//equal signs, then it will add that character to the string
-						if(buffer[i] != ' ' && buffer[i] != '=')	{
-							statsFileName[j] = buffer[i];
-							j++;
-						}
-						i++;
-					}
-					//Add a null terminator at the end
-					statsFileName[j] = 0;
-					input++;
-				}
-				else if(buffer[i] == '=' && input == 3)	{ //This will find the value of duration
-					//The loop runs while the character is not null
-					while(buffer[i] != 0)	{
-						//If the character is a number from 0 to 9
-						if(buffer[i] >= '0' && buffer[i] <= '9')	{
-							//Move the previous digits up one position and add the
-							//new digit
-							*statsFrequency = (*statsFrequency * 10) + (buffer[i] - '0');
-						}
-						i++;
-					}
-					input++;
-				}
-				else if(buffer[i] == '=' && input == 4)	{ //This will find the value of speedLimit
-					//The loop runs while the character is not null
-					while(buffer[i] != 0)	{
-						
-						//If the character is a number from 0 to 9
-						if(buffer[i] >= '0' && buffer[i] <= '9')	{
-							//Move the previous digits up one position and add the
-							//new digit
-							*speedLimit = (*speedLimit * 10) + (buffer[i] - '0');				
-						}
-						i++;
-					}
-					input++;
-				}
-				else if(buffer[i] == '=' && input == 5)	{ //This will find the value of distanceBetweenLasers				
-					//The loop runs while the character is not null
-					while(buffer[i] != 0)	{
-						//If the character is a number from 0 to 9
-						if(buffer[i] >= '0' && buffer[i] <= '9')	{
-							//Move the previous digits up one position and add the
-							//new digit
-							*distanceBetweenLasers = (*distanceBetweenLasers * 10) + (buffer[i] - '0');
-						}
-						i++;
-					}
-					input++;
-				}
-				else
-					i++;
-			}
-		}
-	}
-}
+int runGlitchBenchmark(FILE* results);
 
-void computeStats(float* maxSpeed, float* minSpeed, float* averageSpeed, float objectSpeeds[], int peoplePassedThrough)	{
-	float sumOfSpeeds = 0;
-	*maxSpeed = FLT_MAX;
-	*minSpeed = 0;
-	*averageSpeed = 0;
+void* laneBenchmarkThread(void* argument);
 
-	for(int i = 0; i < peoplePassedThrough; i++)	{
-		if(objectSpeeds[i] > maxSpeed)
-			*maxSpeed = objectSpeeds[i];
-		if(objectSpeeds[i] < minSpeed)
-			*minSpeed = objectSpeeds[i];
+int runLaneBenchmark(FILE* results);
 
-		sumOfSpeeds += objectSpeeds[i];
-	}
+int openEdgeCapture(struct laserCapture* capture);
 
-	*averageSpeed = sumOfSpeeds / peoplePassedThrough;
+int openCapture(struct laserCapture* capture, struct gpioBackend* gpio, uint32_t laserMask, int forcePolling);
 
-	if(!peoplePassedThrough)
-		minSpeed = 0;
-}
+void setPollRates(struct laserCapture* capture, float idlePeriod, float activePeriod, int spin);
 
-void measureSpeed(GPIO_Handle gpio, int watchdog, const int statsFrequency, const int speedLimit, const int distance, FILE* logFile, FILE* statsFile)	{
-	//Indicates that the program is running, even when puTTy is not connected.
-	
-	outputOn(gpio, RUNNING_LED_PIN);
+int pollNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs);
 
-	char curTime[30];
-	float distanceBetweenLasers = distance / 100.0;
+void waitForPoll(struct laserCapture* capture, timestamp_ns now);
 
-	//If, initially either of the 2 photodiodes are disconnected, wait 1 second then check again. If either or both are still disconnected, exit the program
-	while(!laserDiodeStatus(gpio, 1) || !laserDiodeStatus(gpio, 2))	{
-		//This ioctl call will write to the watchdog file and prevent the pi from rebooting
-		ioctl(watchdog, WDIOC_KEEPALIVE, 0);
+void printPollStats(FILE* statsFile, struct laserCapture* capture);
 
-		#ifndef RUN_AS_SERVICE
-		printf("Distance: %.2f, Laser1: %d, Laser2: %d\n", distanceBetweenLasers, laserDiodeStatus(gpio, 1), laserDiodeStatus(gpio, 2));
-		#endif
+int edgeNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs);
 
-		sleep(2);
-		if(!laserDiodeStatus(gpio, 1) || !laserDiodeStatus(gpio, 2))	{
-			getTime(curTime);
-			PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_ERROR, "There are no lasers connected to one or more of the photodiodes, exiting.\n\n");
+int initStream(struct sampleStream* stream, size_t size, timestamp_ns period);
 
-			#ifndef RUN_AS_SERVICE
-			perror("No lasers connected!\n");
-			#endif
-		}
-	}
+uint32_t* streamBlock(struct sampleStream* stream);
 
-	//Logs that connections with the lasers has been established
-	getTime(curTime);
+void publishStreamBlock(struct sampleStream* stream, timestamp_ns firstTime, timestamp_ns lastTime);
 
-	#ifndef RUN_AS_SERVICE
-	printf("Connection with both lasers has been established!\n");
-	#endif
+int makeRealtime(int cpu, int priority);
 
-	PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_INFO, "Connection with both lasers has been established!");
-	
-	//If the given speedLimit is less than 0, exit with an error code
-	if(speedLimit < 0)	{
-		getTime(curTime);
+void prefaultStack();
 
-		#ifndef RUN_AS_SERVICE
-		perror("Received an invalid speedLimit; exiting\n");
-		#endif
+void* streamerMain(void* argument);
 
-		PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_ERROR, "The measureSpeed function was given an invalid speed\n\n");
-		return;
-	}
+int startStream(struct sampleStream* stream, struct gpioBackend* gpio, int cpu, int priority);
 
-	//If the given speedLimit is 0, allow the program to precede but note it in the log file
-	if(!speedLimit)	{
-		getTime(curTime);
+void stopStream(struct sampleStream* stream);
 
-		#ifndef RUN_AS_SERVICE
-		perror("Received a speedLimit as 0; running program but flagging all objects walking through hall\n");
-		#endif
+void freeStream(struct sampleStream* stream);
 
-		PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "The requested speedLimit is 0. Flagging any objects moving through hall\n\n");
-	}
+void openStreamCapture(struct laserCapture* capture, struct sampleStream* stream, uint32_t laserMask, uint32_t levels);
 
-	//Enum to establish the different states to be used in the state maching
-	enum objectLocation { NOONE_IN_HALL, IN_HALL_MOVE_LEFT, IN_HALL_MOVE_RIGHT, EXITED_HALL, LASER1_BROKEN_GOING_IN, LASER1_BROKEN_GOING_OUT_INCORRECT, LASER1_BROKEN_GOING_OUT_CORRECT, LASER2_BROKEN_GOING_IN, LASER2_BROKEN_GOING_OUT_INCORRECT, LASER2_BROKEN_GOING_OUT_CORRECT };
-	enum objectLocation currentLocation = NOONE_IN_HALL;
+size_t findEdge(const uint32_t* samples, size_t count, uint32_t previous, uint32_t mask);
 
-	//Declaration of variables to be used when calculating time and an array that will store the speeds of the objects
-	float objectSpeed = 0;
-	float objectSpeeds[1000];
-	
-	for(int i = 0; i < 1000; i++)
-		objectSpeeds[i] = 0;
+void resetEdgeBatch(struct edgeBatch* batch);
 
-	int enteringNewState = 0;
-	int peoplePassedThrough = 0;
-	int numberOfSpeeders = 0;
-	int warningIssued = 1;
+int addEdge(struct edgeBatch* batch, size_t sample, uint32_t level, uint32_t previous, uint32_t mask);
 
-	time_t startTime = time(NULL);
-	time_t enteringTime = time(NULL);
-	time_t exitingTime = time(NULL);
-	time_t timeInState = time(NULL);
+size_t detectEdges(const uint32_t* samples, size_t count, uint32_t previous, uint32_t mask, struct edgeBatch* batch);
 
-	//The start time of the program
-	char sTime[30];
-	getTime(sTime);
+size_t detectEdgesScalar(const uint32_t* samples, size_t count, uint32_t previous, uint32_t mask, struct edgeBatch* batch);
 
-	//Always runs this, intermittently printing out stats. We acknowledge that a while(1) is not generally accepted but in this case, this illustrates that the program runs continuously.
-	while(1)	{
+timestamp_ns streamSampleTime(const struct sampleStream* stream, size_t sample);
 
-		//If enough time has elapsed since the last time stats were printed
-		if((time(NULL) - startTime) > statsFrequency)	{
+int streamNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs);
 
-			//Some short math in order to find the values of the stats that we are going to print out.
-			float* maxSpeed;
-			float* minSpeed;
-			float* averageSpeed;
+int captureNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs);
 
-			computeStats(maxSpeed, minSpeed, averageSpeed, objectSpeeds, peoplePassedThrough);
+void closeCapture(struct laserCapture* capture);
 
-			getTime(curTime);
+int pushEvent(struct eventRing* ring, const struct laserEvent* event);
 
-			//Used instead of the macro to print a message with variables. Prints all statistics to the log file
-			fprintf(statsFile, "STATS FOR THE TIME BETWEEN %s and %s", sTime, curTime);
-			fprintf(statsFile, "The number of people that passed through the hall was: %d\n", peoplePassedThrough);
-			fprintf(statsFile, "The number of people speeding through the hall was: %d\n", numberOfSpeeders);
+int popEvent(struct eventRing* ring, struct laserEvent* event);
 
-			fprintf(statsFile, "The fastest person that went through the hall travelled at a speed of approximately %.2f m/s\n", *maxSpeed);
-			fprintf(statsFile, "The slowest person that went through the hall travelled at a speed of approximately %.2f m/s\n", *minSpeed);
-			fprintf(statsFile, "The average speed of the people travelling through the hall was %.2f m/s\n\n\n\n", *averageSpeed);
-			fflush(statsFile);
+void* samplerMain(void* argument);
 
-			//Used to reset the values in the array of object speeds
-			for(int i = 0; i < peoplePassedThrough; i++)
-				objectSpeeds[i] = 0;
+void fanOutEvent(struct samplerThread* sampler, const struct laserEvent* event);
 
-			//Resets the number of people that passed through as well as resets the start time
-			peoplePassedThrough = 0;
-			numberOfSpeeders = 0;
-			startTime = time(NULL);
-			getTime(sTime);
-		}
-		
-		//Variables used to keep track of photodiode status. 1 = receiving a laser, 0 = no laser detected. 
-		int laser1Status = laserDiodeStatus(gpio, 1);
-		int laser2Status = laserDiodeStatus(gpio, 2);
+int initSampler(struct samplerThread* sampler, struct laserCapture* capture, int cpu, int priority, const uint32_t laneMasks[], int numLanes);
 
-		//This ioctl call will write to the watchdog file and prevent the pi from rebooting
-		ioctl(watchdog, WDIOC_KEEPALIVE, 0);
+int startSampler(struct samplerThread* sampler);
 
-		//Sleep every iteration of the loop for a miniscule amount of time to reduce processing power
-		usleep(1000);
-		
-		switch(currentLocation)	{
+int samplerNextEvent(struct samplerThread* sampler, int lane, struct laserEvent* event, int timeoutMs);
 
-			case NOONE_IN_HALL:
-				if(laser1Status && laser2Status)	{
-					break;
+void setLaneBusy(struct samplerThread* sampler, int lane, int busy);
 
-				}	//If left laser breaks, a person is entering the hall from the left
-				else if(!laser1Status)	{
-					currentLocation = LASER1_BROKEN_GOING_IN;
-					enteringNewState = 1;
-					enteringTime = time(NULL);
-					timeInState = time(NULL);
-
-				}	//If right laser breaks, a person is entering the hall from the right
-				else if(!laser2Status)	{
-					currentLocation = LASER2_BROKEN_GOING_IN;
-					enteringNewState = 1;
-					enteringTime = time(NULL);
-					timeInState = time(NULL);
-				}
+void stopSampler(struct samplerThread* sampler);
 
-				break;
+void setToOutput(struct gpioBackend* gpio, int pinNumber);																												//Defined on line 288
 
-			//The reason why these 2 states exist to is allow the watchdog to ping at a consistent rate. While these 2 states could be taken out of the program, they would have to be replaced with
-			//a while loop in some of the states which is extremely ugly and, annoying because then the watchdog would have to be constantly pinged in these while loops to prevent a timeout. 
-			case LASER1_BROKEN_GOING_IN:
+void outputOn(struct gpioBackend* gpio, int pinNumber);																													//Defined on line 331
 
-				if(laser1Status)	{	
-					currentLocation = IN_HALL_MOVE_RIGHT;
-					outputOn(gpio, WARNING_LED_PIN);
-				}
+void outputOff(struct gpioBackend* gpio, int pinNumber);																												//Defined on line 337
 
-				if((time(NULL) - timeInState) > LASER_BLOCK_TIME)	{
-					getTime(curTime);
+void initLedScheduler(struct ledScheduler* leds, struct gpioBackend* gpio);
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the laser!\n");
-					#endif 
+struct ledEffect* findLedEffect(struct ledScheduler* leds, int pinNumber);
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
-					timeInState = time(NULL);
-				}
+void ledSolid(struct ledScheduler* leds, int pinNumber, int on);
 
-				break;
+void ledBlink(struct ledScheduler* leds, int pinNumber, int times, timestamp_ns period, timestamp_ns now);
 
-			case LASER2_BROKEN_GOING_IN:
-				
-				if(laser2Status)	{
-					currentLocation = IN_HALL_MOVE_LEFT;
-					outputOn(gpio, WARNING_LED_PIN);
-				}
+timestamp_ns runLedScheduler(struct ledScheduler* leds, timestamp_ns now);
 
-				if((time(NULL) - timeInState) > LASER_BLOCK_TIME)	{
-					getTime(curTime);
+void getTime(char* buffer);																																		//Defined on line 342
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the laser!\n");
-					#endif 
+void getTimeUncached(char* buffer);
+
+void* timeBenchmarkThread(void* argument);
+
+void runTimeBenchmark(FILE* results);
+
+void addLatency(struct latencyHistogram* histogram, timestamp_ns latency);
+
+timestamp_ns latencyPercentile(const struct latencyHistogram* histogram, int percent);
+
+void printLatencies(FILE* statsFile, const char* label, const struct latencyHistogram* histogram);
+
+int startLogger(struct asyncLogger* logger, int fd, const struct loggerSettings* settings);
+
+void logMessage(struct asyncLogger* logger, const char* format, ...);
+
+void* loggerMain(void* argument);
+
+void printLoggerStats(FILE* statsFile, struct asyncLogger* logger);
+
+void setLoggerSettings(struct asyncLogger* logger, const struct loggerSettings* settings);
+
+void stopLogger(struct asyncLogger* logger);
+
+void defaultConfig(struct speedometerConfig* config);
+
+uint32_t laneLaserMask(const struct laneConfig* lane);
+
+uint32_t configLaserMask(const struct speedometerConfig* config);
+
+int parseConfigNumber(const char* text, enum configValueType type, double* value);
+
+int setConfigValue(void* settings, const struct configKey* key, const char* value, char* error, size_t errorSize);
+
+int readConfig(FILE* configFile, struct speedometerConfig* config, char* error, size_t errorSize);		//Defined on line 363
+
+int loadConfig(const char* fileName, struct speedometerConfig* config, char* error, size_t errorSize);
+
+int startConfigWatcher(struct configWatcher* watcher, const char* fileName, int numLanes, struct asyncLogger* logFile);
+
+int isConfigFileEvent(struct configWatcher* watcher);
+
+void reloadConfig(struct configWatcher* watcher);
+
+void* configWatcherMain(void* argument);
+
+void stopConfigWatcher(struct configWatcher* watcher);
+
+void applyConfig(struct speedometerConfig* config, const struct speedometerConfig* newConfig, int lane, struct transitTracker* tracker, struct glitchFilter* filter, struct asyncLogger* logFile, const char* programName);
+
+int startEventLogFile(struct eventLog* log);
+
+int openEventLog(struct eventLog* log, const char* fileName, int maxSize, int overflowPolicy);
+
+int rotateEventLog(struct eventLog* log);
+
+int writeEventBatch(struct eventLog* log, uint64_t first, int count);
+
+void* eventLogMain(void* argument);
+
+void flushEventLog(struct eventLog* log);
+
+void logEvent(struct eventLog* log, int lane, int type, int direction, int flags, float speed, timestamp_ns timestamp);
+
+uint64_t eventLogDropped(struct eventLog* log);
+
+void closeEventLog(struct eventLog* log);
+
+void initMeasurementStore(struct measurementStore* store, int numPages);
+
+int storeMeasurement(struct measurementStore* store, const struct speedMeasurement* measurement);
+
+void recycleMeasurements(struct measurementStore* store);
+
+void freeMeasurementStore(struct measurementStore* store);
+
+void resetAccumulator(struct speedAccumulator* accumulator);
+
+void accumulateSpeed(struct speedAccumulator* accumulator, float speed);
+
+void readAccumulator(const struct speedAccumulator* accumulator, struct directionStats* stats);
+
+void resetSketch(struct speedSketch* sketch);
+
+int sketchBucket(float speed);
+
+float sketchBucketSpeed(int bucket);
+
+void addToSketch(struct speedSketch* sketch, float speed);
+
+void mergeSketch(struct speedSketch* total, const struct speedSketch* sketch);
+
+float sketchPercentile(const struct speedSketch* sketch, int percent);
+
+void printPercentiles(FILE* statsFile, const char* label, const struct speedSketch* sketch);
+
+void printHistogram(FILE* statsFile, const struct speedSketch* sketch);
+
+void computeStats(struct directionStats stats[], struct measurementStore* store);										//Defined on line 490
+
+int statsMatch(const struct directionStats* first, const struct directionStats* second);
+
+int runStatsBenchmark(FILE* results);
+
+double loopJitter(const struct pipelineMetrics* metrics);
+
+void appendText(char* buffer, size_t size, size_t* length, const char* format, ...);
+
+void formatHistogram(char* buffer, size_t size, size_t* length, const char* name, const char* help, const struct pipelineMetrics metrics[], int numLanes, size_t offset);
+
+size_t formatMetrics(char* buffer, size_t size, const struct pipelineMetrics metrics[], int numLanes, struct samplerThread* sampler);
+
+int writeMetricsFile(const char* fileName, const char* text, size_t length);
+
+int startMetricsServer(struct metricsServer* server, struct samplerThread* sampler, int numLanes, struct asyncLogger* logFile, const char* fileName, const char* socketName);
+
+int openMetricsSocket(struct metricsServer* server);
+
+void publishMetrics(struct metricsServer* server, int lane, const struct pipelineMetrics* metrics, int wait);
+
+size_t formatServerMetrics(struct metricsServer* server);
+
+void serveScrape(struct metricsServer* server, int fd);
+
+void* metricsServerMain(void* argument);
+
+void stopMetricsServer(struct metricsServer* server);
+
+int checkLoggedSpeeds(const char* eventLogName, struct syntheticPerson* people, int numPeople, timestamp_ns traceStart);
+
+double replayPipeline(struct replayBackend* replay, const struct speedometerConfig* config, int logFd, FILE* statsFile, struct eventLog* eventLog, struct pipelineMetrics* metrics);
+
+int runPipelineScenario(double meanHeadway, double minSpeed, double maxSpeed, FILE* results);
+
+void runInstrumentationBenchmark(FILE* results);
+
+int runPipelineBenchmark(FILE* results);
+
+int checkLedWrites(const struct ledWrite* writes, int numWrites, const struct ledWrite* expected, int numExpected);
+
+int runLedBenchmark(FILE* results);
+
+void runStreamBenchmark(FILE* results);
+
+uint32_t liveReadLevels(struct gpioBackend* backend);
+
+void runPollBenchmark(FILE* results);
+
+void* jitterBenchmarkThread(void* argument);
+
+void* jitterLoadThread(void* argument);
+
+void runJitterBenchmark(FILE* results);
+
+void pingWatchdog(struct laneWatchdog* watchdog, int lane);
+
+void* laneMain(void* argument);
+
+void measureSpeed(struct gpioBackend* gpio, struct samplerThread* sampler, int lane, struct laneWatchdog* watchdog, const struct speedometerConfig* settings, struct configWatcher* configWatcher, struct asyncLogger* logFile, FILE* statsFile, struct eventLog* eventLog, struct pipelineMetrics* metrics, struct metricsServer* metricsServer);			//Defined on line 511
+
+int main(const int argc, const char* const argv[])	{
+
+	//Create a string that contains the program name
+	const char* argName = argv[0];
+
+	//These variables will be used to count how long the name of the program is
+	int i = 0;
+	int namelength = 0;
+
+	//Find the length of the program name
+	while(argName[i] != 0)	{
+		namelength++;
+		i++;
+	} 
+
+	//The name of the program
+	char programName[namelength];
+	i = 0;
+
+	//Copy the name of the program without the ./ at the start
+	//of argv[0]
+	while(argName[i + 2] != 0)	{
+		programName[i] = argName[i + 2];
+		i++;
+	} 
+	programName[i] = 0;
+
+	//Look through the command line options. -f <file> plays back a trace of the lasers instead of
+	//watching the GPIO pins and -s <people> plays back synthetic traffic of that many people, both as fast as
+	//they can be handled. -p forces the capture engine to poll the level register, -r <rate> streams the level register
+	//at that many samples a second instead, -c <cpu> pins the sampler thread (or the streamer thread, when streaming) to
+	//a CPU, -P <priority> runs it at that real-time priority with the memory of the program locked and -b runs the
+	//benchmarks instead of watching the hall, -o <file> adding their results to a file as JSON, one line for each
+	const char* eventFileName = NULL;
+	const char* resultsFileName = NULL;
+	int syntheticPeople = 0;
+	int forcePolling = 0;
+	int streamRate = 0;
+	int samplerCpu = -1;
+	int samplerPriority = 0;
+	int runBenchmarks = 0;
+
+	for(int arg = 1; arg < argc; arg++)	{
+		if(!strcmp(argv[arg], "-f") && arg + 1 < argc)
+			eventFileName = argv[++arg];
+		else if(!strcmp(argv[arg], "-s") && arg + 1 < argc)
+			syntheticPeople = atoi(argv[++arg]);
+		else if(!strcmp(argv[arg], "-p"))
+			forcePolling = 1;
+		else if(!strcmp(argv[arg], "-r") && arg + 1 < argc)
+			streamRate = atoi(argv[++arg]);
+		else if(!strcmp(argv[arg], "-c") && arg + 1 < argc)
+			samplerCpu = atoi(argv[++arg]);
+		else if(!strcmp(argv[arg], "-P") && arg + 1 < argc)
+			samplerPriority = atoi(argv[++arg]);
+		else if(!strcmp(argv[arg], "-b"))
+			runBenchmarks = 1;
+		else if(!strcmp(argv[arg], "-o") && arg + 1 < argc)
+			resultsFileName = argv[++arg];
+	}
+
+	if(streamRate && (streamRate < STREAM_MIN_RATE || streamRate > STREAM_MAX_RATE))	{
+		#ifndef RUN_AS_SERVICE
+		fprintf(stderr, "The level register can be streamed at %d to %d samples a second; exiting\n", STREAM_MIN_RATE, STREAM_MAX_RATE);
+		#endif
+
+		return -1;
+	}
+
+	if(samplerPriority && (samplerPriority < sched_get_priority_min(SCHED_FIFO) || samplerPriority > sched_get_priority_max(SCHED_FIFO)))	{
+		#ifndef RUN_AS_SERVICE
+		fprintf(stderr, "The real-time priority must be between %d and %d; exiting\n", sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+		#endif
+
+		return -1;
+	}
+
+	//The benchmarks run on synthetic traffic, so they do not need the config file or the GPIO pins
+	if(runBenchmarks)	{
+		FILE* results = resultsFileName ? fopen(resultsFileName, "a") : NULL;
+
+		if(resultsFileName && !results)	{
+			#ifndef RUN_AS_SERVICE
+			perror("The benchmark results file could not be opened; exiting\n");
+			#endif
+
+			return -1;
+		}
+
+		//The benchmarks that check what they measure fail the run if it is wrong
+		int failures = 0;
+		failures += runTrackerBenchmark(results) < 0;
+		failures += runGlitchBenchmark(results) < 0;
+		failures += runStatsBenchmark(results) < 0;
+		runTimeBenchmark(results);
+		failures += runPipelineBenchmark(results) < 0;
+		failures += runLedBenchmark(results) < 0;
+		runStreamBenchmark(results);
+		runPollBenchmark(results);
+		runJitterBenchmark(results);
+		failures += runLaneBenchmark(results) < 0;
+
+		if(results)
+			fclose(results);
+
+		if(failures)	{
+			printf("%d of the benchmarks found something wrong\n", failures);
+			return -1;
+		}
+		return 0;
+	}
+	
+	//The name of the config file
+	const char* configFileName = "/home/pi/speedometer.cfg";
+
+	//In real-time mode every thread gets a smaller stack, and all of the memory of the program, along with everything it
+	//allocates from now on, is locked into RAM and faulted in straight away, so that reading the lasers never waits on
+	//a page fault. The program carries on without if the memory cannot be locked
+	int memoryLocked = 0;
+
+	if(samplerPriority)	{
+		pthread_attr_t attributes;
+		pthread_attr_init(&attributes);
+		pthread_attr_setstacksize(&attributes, REALTIME_STACK_SIZE);
+		pthread_setattr_default_np(&attributes);
+		pthread_attr_destroy(&attributes);
+
+		memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+	}
+
+	//SIGHUP makes the program read its config file again. It is blocked here, before any thread is started, so that it
+	//is only ever picked up by the config watcher instead of stopping the program
+	sigset_t hangup;
+	sigemptyset(&hangup);
+	sigaddset(&hangup, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &hangup, NULL);
+
+	//Create a char array that will be used to hold the time values
+	char time[TIME_BUFFER_SIZE];
+	getTime(time);
+
+	//Read the config file. Output the mistake in it to the error stream and exit if it cannot be read
+	struct speedometerConfig config;
+	char configError[CONFIG_LINE_SIZE + 64];
+
+	if(loadConfig(configFileName, &config, configError, sizeof(configError)) < 0)	{
+		#ifndef RUN_AS_SERVICE
+		fprintf(stderr, "The config file could not be read, %s; exiting\n", configError);
+		#endif
+
+		return -1;
+	}
+
+	int timeout = config.watchdogTimeout;
+
+	//Create a new file descriptor for the log file and a file pointer for the stats file
+	int logFd;
+	FILE* statsFile;
+
+	//Open the log and stats files and make them append to the file when they are written to.
+	logFd = open(config.logFileName, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	statsFile = fopen(config.statsFileName, "a");
+
+	//Check that the file opens properly.
+	if(logFd < 0)	{
+		#ifndef RUN_AS_SERVICE
+		perror("The log file could not be opened; exiting\n");
+		#endif
+
+		return -1;
+	}
+
+	//Everything logged from here on goes through the logger, so that writing to the SD card never holds up the
+	//lasers. It is static as it holds all of the waiting messages
+	static struct asyncLogger logger;
+	struct asyncLogger* logFile = &logger;
+
+	if(startLogger(logFile, logFd, &config.logSettings) < 0)	{
+		#ifndef RUN_AS_SERVICE
+		perror("The log writer thread could not be started; writing the log directly\n");
+		#endif
+	}
+
+	if(samplerPriority)	{
+		getTime(time);
+		if(memoryLocked)
+			PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "Real-time mode: the memory of the program is locked\n\n");
+		else
+			PRINT_MSG(logFile, time, programName, SEVERITY_WARNING, "Real-time mode: the memory of the program could not be locked, carrying on without\n\n");
+	}
+
+	#ifndef RUN_AS_SERVICE
+	printf("Timeout Time: %d Log File Name: %s statsFileName: %s statsFrequency: %d Lanes: %d\n", timeout, config.logFileName, config.statsFileName, config.statsFrequency, config.numLanes);
+	for(int lane = 0; lane < config.numLanes; lane++)
+		printf("Lane %d: Lasers on pins %d and %d Speed Limit: %.2f (right: %.2f, left: %.2f) Distance Between Lasers: %.2f \n", lane + 1, config.lanes[lane].laserPins[0], config.lanes[lane].laserPins[1], config.lanes[lane].speedLimit, config.lanes[lane].speedLimits[MOVING_RIGHT], config.lanes[lane].speedLimits[MOVING_LEFT], config.lanes[lane].distance);
+	printf("\n");
+	#endif
+
+	//Open the binary event log, if the config file asks for one
+	struct eventLog eventLog;
+
+	if(openEventLog(&eventLog, config.eventLogName, config.eventLogSize, config.logSettings.overflowPolicy) < 0)	{
+		#ifndef RUN_AS_SERVICE
+		perror("The event log could not be opened; carrying on without it\n");
+		#endif
+	}
+
+	//The bits of the level register of the lasers of each lane, and of every lane together
+	uint32_t laneMasks[MAX_LANES];
+	for(int lane = 0; lane < config.numLanes; lane++)
+		laneMasks[lane] = laneLaserMask(&config.lanes[lane]);
+	uint32_t laserMask = configLaserMask(&config);
+
+	//Pick the GPIO backend. A trace is played back on the virtual clock of a replay backend, which also records
+	//the LEDs, and otherwise the registers of the Pi are used. Each lane plays back its own part of the trace on a
+	//replay backend of its own, so that every lane has a virtual clock that only it moves and always gives the same
+	//results, however the lanes' threads are scheduled. The pipelines are the backend, capture engine and sampler
+	//thread the lanes are fed by: one for every lane when playing back a trace and one for all of them otherwise
+	int replaying = eventFileName || syntheticPeople > 0;
+	int numPipelines = replaying ? config.numLanes : 1;
+	struct gpioBackend* gpios[MAX_LANES] = { NULL };
+	struct mmioBackend mmio;
+	static struct replayBackend replays[MAX_LANES];
+
+	if(replaying)	{
+		for(int lane = 0; lane < config.numLanes; lane++)	{
+			const uint32_t masks[2] = { 1u << config.lanes[lane].laserPins[0], 1u << config.lanes[lane].laserPins[1] };
+			initReplayBackend(&replays[lane], laneMasks[lane]);
+
+			int loaded = eventFileName ? loadTraceFile(&replays[lane], eventFileName) : loadSyntheticTrace(&replays[lane], NULL, syntheticPeople, SIMULATION_HEADWAY, SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, config.lanes[lane].distance, masks, lane + 1);
+			if(loaded < 0)	{
+				#ifndef RUN_AS_SERVICE
+				perror("The trace could not be loaded; exiting\n");
+				#endif
+
+				getTime(time);
+				PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The trace of the lasers could not be loaded!\n\n");
+				stopLogger(logFile);
+				return -1;
+			}
+
+			gpios[lane] = &replays[lane].backend;
+		}
+	}
+	else	{
+		//Initialize the GPIO pins
+		GPIO_Handle gpioHandle = initializeGPIO();
+
+		if(gpioHandle != NULL)	{
+			initMmioBackend(&mmio, gpioHandle);
+			for(int lane = 0; lane < config.numLanes; lane++)
+				gpios[lane] = &mmio.backend;
+		}
+	}
+	struct gpioBackend* gpio = gpios[0];
+
+	//Get the current time
+	getTime(time);
+	//Log that the GPIO pins have been initialized
+	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The GPIO pins have been initialized\n\n");
+
+	#ifndef RUN_AS_SERVICE
+	printf("Successful initialization of the GPIO pins\n");
+	#endif
+
+	//This variable will be used to access the /dev/watchdog file, similar to how
+	//the GPIO_Handle works
+	int watchdog;
+
+	//We use the open function here to open the /dev/watchdog file. If it does
+	//not open, then we output an error message. We do not use fopen() because we
+	//do not want to create a file if it doesn't exist
+	if ((watchdog = open("/dev/watchdog", O_RDWR | O_NOCTTY)) < 0) {
+		#ifndef RUN_AS_SERVICE
+		printf("Error: Couldn't open watchdog device! %d\n", watchdog);
+		#endif
+
+		getTime(time);
+		PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The watchdog was unable to be opened!\n\n");
+
+		//When playing back a file of fake events there is usually no watchdog, so carry on without one
+		if(!replaying)	{
+			stopLogger(logFile);
+			return -1;
+		}
+	} 
+	else	{
+		//Get the current time
+		getTime(time);
+		//Log that the watchdog file has been opened
+		PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The Watchdog file has been opened\n\n");
+	}
+
+	//This line uses the ioctl function to set the time limit of the watchdog
+	//timer to 15 seconds. The time limit can not be set higher that 15 seconds
+	//so please make a note of that when creating your own programs.
+	//If we try to set it to any value greater than 15, then it will reject that
+	//value and continue to use the previously set time limit
+	ioctl(watchdog, WDIOC_SETTIMEOUT, &timeout);
+	
+	//Get the current time
+	getTime(time);
+	//Log that the Watchdog time limit has been set
+	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The Watchdog time limit has been set\n\n");
+
+	//The value of timeout will be changed to whatever the current time limit of the
+	//watchdog timer is
+	ioctl(watchdog, WDIOC_GETTIMEOUT, &timeout);
+
+	//This print statement will confirm to us if the time limit has been properly
+	//changed.
+	#ifndef RUN_AS_SERVICE
+	printf("The watchdog timeout is %d seconds.\n\n", timeout);
+	#endif
+
+	//The state machine of every lane has to keep going round its loop for the watchdog to be pinged
+	static struct laneWatchdog laneWatchdog;
+	laneWatchdog.fd = watchdog;
+	laneWatchdog.numLanes = config.numLanes;
+
+	//Set the pins for the LED's to outputs. The running LED is the first lane's to look after and every lane
+	//can have a warning LED of its own
+	setToOutput(gpio, RUNNING_LED_PIN);
+	for(int lane = 0; lane < config.numLanes; lane++)	{
+		if(config.lanes[lane].warningLedPin >= 0)
+			setToOutput(gpios[lane], config.lanes[lane].warningLedPin);
+	}
+
+	//Logs that the LED pins have been set to outputs
+	getTime(time);
+	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "The LED pins have been set as outputs\n\n");
+
+	//Start the capture engine, which falls back to polling if the edge events cannot be requested. When asked to, the
+	//level register is streamed instead, as long as there is a level register to stream. The stream is static as it
+	//holds the streamer's buffer
+	struct laserCapture captures[MAX_LANES];
+	static struct sampleStream stream;
+	int captureMode;
+
+	if(streamRate && !replaying && gpio)	{
+		captureMode = -1;
+
+		if(initStream(&stream, STREAM_SAMPLES, NS_PER_SECOND / streamRate) == 0)	{
+			struct laserSample sample;
+			sampleLasers(gpio, laserMask, &sample);
+
+			if(startStream(&stream, gpio, samplerCpu, samplerPriority) == 0)	{
+				openStreamCapture(&captures[0], &stream, laserMask, sample.levels);
+				captureMode = CAPTURE_STREAM;
+
+				//The streamer is the one pinned to the CPU and run at real-time priority, the sampler only wakes up once
+				//a block
+				samplerCpu = -1;
+				samplerPriority = 0;
+			}
+			else
+				freeStream(&stream);
+		}
+	}
+	else	{
+		captureMode = openCapture(&captures[0], gpio, replaying ? laneMasks[0] : laserMask, forcePolling);
+
+		for(int pipeline = 1; pipeline < numPipelines && captureMode >= 0; pipeline++)
+			openCapture(&captures[pipeline], gpios[pipeline], laneMasks[pipeline], forcePolling);
+	}
+
+	getTime(time);
+	if(captureMode < 0)	{
+		#ifndef RUN_AS_SERVICE
+		perror("The laser capture could not be started; exiting\n");
+		#endif
+
+		PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The laser capture could not be started!\n\n");
+		stopLogger(logFile);
+		return -1;
+	}
+	else if(captureMode == CAPTURE_EDGE)
+		PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "Capturing the lasers with GPIO edge events\n\n");
+	else if(captureMode == CAPTURE_STREAM)
+		PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "Capturing the lasers by streaming the level register\n\n");
+	else if(captureMode == CAPTURE_REPLAY)
+		PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "Playing back a trace of the lasers\n\n");
+	else	{
+		PRINT_MSG(logFile, time, programName, SEVERITY_INFO, "Capturing the lasers by polling the level register\n\n");
+
+		//The level register can be read less often while nobody is in the halls
+		setPollRates(&captures[0], config.idlePollPeriod, config.activePollPeriod, config.pollSpin);
+
+		char message[256];
+		snprintf(message, sizeof(message), "Reading the level register every %.0f us while the halls are empty and every %.0f us once someone is in one%s\n\n", config.idlePollPeriod, config.activePollPeriod, config.pollSpin ? ", spinning in between" : "");
+		PRINT_MSG(logFile, time, programName, SEVERITY_INFO, message);
+	}
+
+	//Get the sampler threads ready. measureSpeed starts them once it knows the lasers are connected. They are static
+	//as they hold the rings of every lane
+	static struct samplerThread samplers[MAX_LANES];
+
+	for(int pipeline = 0; pipeline < numPipelines; pipeline++)	{
+		if(initSampler(&samplers[pipeline], &captures[pipeline], samplerCpu, samplerPriority, laneMasks, config.numLanes) < 0)	{
+			getTime(time);
+			PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The sampler thread could not be set up!\n\n");
+			stopLogger(logFile);
+			return -1;
+		}
+	}
+
+	//Start serving the metrics, if the config file asks for them. The program carries on without them if they cannot be
+	//served. The server is static as it holds its copies of the metrics
+	static struct metricsServer metricsServer;
+
+	if(startMetricsServer(&metricsServer, &samplers[0], config.numLanes, logFile, config.metricsFileName, config.metricsSocketName) < 0)	{
+		getTime(time);
+		PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The metrics server could not be started, carrying on without it\n\n");
+
+		#ifndef RUN_AS_SERVICE
+		perror("The metrics server could not be started; carrying on without it\n");
+		#endif
+	}
+
+	//Start watching the config file, so that changes to it are picked up without restarting
+	static struct configWatcher configWatcher;
+
+	if(startConfigWatcher(&configWatcher, configFileName, config.numLanes, logFile) < 0)	{
+		getTime(time);
+		PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The config file cannot be watched, it will only be read again when the program is restarted\n\n");
+	}
+
+	//Calls the main function which monitors the hall activity. Every lane but the first gets a thread of its own, so
+	//that the lanes are spread over the CPUs, and the first lane runs right here
+	static struct pipelineMetrics metrics[MAX_LANES];
+	struct laneThread lanes[MAX_LANES];
+	timestamp_ns runStart = getMonotonicTime();
+
+	for(int lane = 1; lane < config.numLanes; lane++)	{
+		lanes[lane] = (struct laneThread){ .lane = lane, .gpio = gpios[lane], .sampler = &samplers[replaying ? lane : 0], .watchdog = &laneWatchdog, .config = &config, .configWatcher = &configWatcher,
+			.logFile = logFile, .statsFile = statsFile, .eventLog = &eventLog, .metrics = &metrics[lane], .metricsServer = &metricsServer };
+		lanes[lane].started = pthread_create(&lanes[lane].thread, NULL, laneMain, &lanes[lane]) == 0;
+
+		if(!lanes[lane].started)	{
+			getTime(time);
+			PRINT_MSG(logFile, time, programName, SEVERITY_ERROR, "The thread of a lane could not be started, that lane is not being watched!\n\n");
+		}
+	}
+
+	measureSpeed(gpio, &samplers[0], 0, &laneWatchdog, &config, &configWatcher, logFile, statsFile, &eventLog, &metrics[0], &metricsServer);
+
+	for(int lane = 1; lane < config.numLanes; lane++)	{
+		if(lanes[lane].started)
+			pthread_join(lanes[lane].thread, NULL);
+	}
+
+	//Say how much faster than real time the trace of each lane was played back
+	if(replaying)	{
+		double realSeconds = (double)(getMonotonicTime() - runStart) / NS_PER_SECOND;
+
+		for(int lane = 0; lane < config.numLanes; lane++)	{
+			double virtualSeconds = (double)(replays[lane].now - replays[lane].startTime) / NS_PER_SECOND;
+
+			#ifndef RUN_AS_SERVICE
+			if(config.numLanes > 1)
+				printf("Lane %d: ", lane + 1);
+			printf("Played back %zu edges, %.1f s of the hall in %.3f s (%.0f times faster than real time). The LEDs were switched %llu times\n", replays[lane].numEdges, virtualSeconds, realSeconds, realSeconds > 0 ? virtualSeconds / realSeconds : 0, (unsigned long long)replays[lane].leds.numWrites);
+			#endif
+
+			freeReplayBackend(&replays[lane]);
+		}
+	}
+
+	stopConfigWatcher(&configWatcher);
+	stopMetricsServer(&metricsServer);
+	for(int pipeline = 0; pipeline < numPipelines; pipeline++)
+		stopSampler(&samplers[pipeline]);
+	if(captureMode == CAPTURE_STREAM)	{
+		stopStream(&stream);
+		freeStream(&stream);
+	}
+	for(int pipeline = 0; pipeline < numPipelines; pipeline++)
+		closeCapture(&captures[pipeline]);
+	closeEventLog(&eventLog);
+	stopLogger(logFile);
+	close(logFd);
+
+	return 0;
+}
+
+GPIO_Handle initializeGPIO()	{													//This function initializes the GPIO and outputs an error if the GPIO has any issues initializing
+	GPIO_Handle gpio;
+	gpio = gpiolib_init_gpio();
+	if(gpio == NULL)	{
+		#ifndef RUN_AS_SERVICE
+		perror("Could not initialize GPIO");
+		#endif
+	}
+
+	return gpio;	
+}
+
+//This function reads the level register once and keeps the bits of the laser pins in laserMask, so that all of the
+//lasers are sampled at the same instant. Returns 0 on success and -1 if the GPIO has not been initialized
+
+int sampleLasers(struct gpioBackend* gpio, uint32_t laserMask, struct laserSample* sample)	{
+
+	if(gpio == NULL)
+		return -1;
+
+	uint32_t level_reg = gpio->readLevels(gpio);
+	sample->timestamp = gpio->now(gpio);
+	sample->levels = level_reg & laserMask;
+
+	return 0;
+}
+
+//This function returns the current CLOCK_MONOTONIC time in nanoseconds. It is the same clock the kernel
+//uses to timestamp GPIO line events, so the edges from every capture mode can be compared with each other
+timestamp_ns getMonotonicTime()	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (timestamp_ns)now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+//This function returns the time on the clock of a GPIO backend. Everything the state machine times, it times with
+//this clock, so that it runs on the virtual clock when a trace is played back
+timestamp_ns gpioTime(struct gpioBackend* gpio)	{
+	if(gpio == NULL)
+		return getMonotonicTime();
+
+	return gpio->now(gpio);
+}
+
+//This function sets up the backend for the registers of the Pi
+void initMmioBackend(struct mmioBackend* mmio, GPIO_Handle gpio)	{
+	memset(mmio, 0, sizeof(*mmio));
+	mmio->gpio = gpio;
+	mmio->backend.name = "registers";
+	mmio->backend.readLevels = mmioReadLevels;
+	mmio->backend.setToOutput = mmioSetToOutput;
+	mmio->backend.writePin = mmioWritePin;
+	mmio->backend.now = realTime;
+	mmio->backend.nextEdge = NULL;
+}
+
+//This function reads the level register of the Pi
+uint32_t mmioReadLevels(struct gpioBackend* backend)	{
+	struct mmioBackend* mmio = (struct mmioBackend*)backend;
+
+	return gpiolib_read_reg(mmio->gpio, GPLEV(0));
+}
+
+//This function will change the appropriate pins value in the select register
+//so that the pin can function as an output
+void mmioSetToOutput(struct gpioBackend* backend, int pinNumber)	{
+	struct mmioBackend* mmio = (struct mmioBackend*)backend;
+
+	//This will create a variable that has the appropriate select
+	//register number. For more information about the registers
+	//look up BCM 2835.
+	int registerNum = pinNumber / 10;
+
+	//This will create a variable that is the appropriate amount that 
+	//the 1 will need to be shifted by to set the pin to be an output
+	int bitShift = (pinNumber % 10) * 3;
+
+	#ifndef RUN_AS_SERVICE
+	printf("registerNum: %d\t bitShift: %d\n",registerNum,bitShift);
+	#endif
+
+	//This is the same code that was used in Lab 2, except that it uses
+	//variables for the register number and the bit shift
+	uint32_t sel_reg = gpiolib_read_reg(mmio->gpio, GPFSEL(registerNum));
+	sel_reg |= 1  << bitShift;
+	gpiolib_write_reg(mmio->gpio, GPFSEL(registerNum), sel_reg);
+}
+
+//This function will make an output pin output 3.3V or turn it off. It is the same
+//as what was done in Lab 2
+void mmioWritePin(struct gpioBackend* backend, int pinNumber, int on)	{
+	struct mmioBackend* mmio = (struct mmioBackend*)backend;
+
+	if(on)
+		gpiolib_write_reg(mmio->gpio, GPSET(0), 1 << pinNumber);
+	else
+		gpiolib_write_reg(mmio->gpio, GPCLR(0), 1 << pinNumber);
+}
+
+//This function is the clock of the backends that run in real time
+timestamp_ns realTime(struct gpioBackend* backend)	{
+	(void)backend;
+
+	return getMonotonicTime();
+}
+
+//This function sets up an LED recorder. Reading the level register gives both lasers reaching their photodiodes
+//until inputs is changed. If clock is NULL the writes are timed in real time
+void initLedRecorder(struct ledRecorder* recorder, struct gpioBackend* clock)	{
+	memset(recorder, 0, sizeof(*recorder));
+	recorder->clock = clock;
+	recorder->inputs = LASER_PIN_MASK;
+	recorder->backend.name = "LED recorder";
+	recorder->backend.readLevels = recorderReadLevels;
+	recorder->backend.setToOutput = recorderSetToOutput;
+	recorder->backend.writePin = recorderWritePin;
+	recorder->backend.now = recorderTime;
+	recorder->backend.nextEdge = NULL;
+}
+
+//This function gives the inputs of the LED recorder together with the levels of its outputs, like the level register would
+uint32_t recorderReadLevels(struct gpioBackend* backend)	{
+	struct ledRecorder* recorder = (struct ledRecorder*)backend;
+
+	return (recorder->inputs & ~recorder->outputPins) | (recorder->outputs & recorder->outputPins);
+}
+
+//This function remembers that a pin is an output
+void recorderSetToOutput(struct gpioBackend* backend, int pinNumber)	{
+	struct ledRecorder* recorder = (struct ledRecorder*)backend;
+
+	recorder->outputPins |= 1 << pinNumber;
+}
+
+//This function sets an output pin in memory and records the write
+void recorderWritePin(struct gpioBackend* backend, int pinNumber, int on)	{
+	struct ledRecorder* recorder = (struct ledRecorder*)backend;
+
+	if(on)
+		recorder->outputs |= 1 << pinNumber;
+	else
+		recorder->outputs &= ~(1 << pinNumber);
+
+	struct ledWrite* write = &recorder->writes[recorder->numWrites % LED_RECORDER_SIZE];
+	write->timestamp = recorderTime(backend);
+	write->pin = pinNumber;
+	write->on = on;
+	recorder->numWrites++;
+}
+
+//This function is the clock of the LED recorder
+timestamp_ns recorderTime(struct gpioBackend* backend)	{
+	struct ledRecorder* recorder = (struct ledRecorder*)backend;
+
+	return recorder->clock ? recorder->clock->now(recorder->clock) : getMonotonicTime();
+}
+
+//This function sets up a replay backend with an empty trace of the lasers on the bits of the level register in
+//laserMask. The lasers start out reaching their photodiodes
+void initReplayBackend(struct replayBackend* replay, uint32_t laserMask)	{
+	memset(replay, 0, sizeof(*replay));
+	replay->backend.name = "trace replay";
+	replay->backend.readLevels = replayReadLevels;
+	replay->backend.setToOutput = replaySetToOutput;
+	replay->backend.writePin = replayWritePin;
+	replay->backend.now = replayTime;
+	replay->backend.nextEdge = replayNextEdge;
+
+	//The lasers are played back from the trace, so the LED recorder only gives the LEDs
+	initLedRecorder(&replay->leds, &replay->backend);
+	replay->leds.inputs = 0;
+
+	replay->laserMask = laserMask;
+	replay->levels = laserMask;
+	replay->startTime = getMonotonicTime();
+	replay->now = replay->startTime;
+}
+
+//This function adds an edge to the end of the trace, growing it when it is full. Returns 0 on success and -1 if
+//there is no memory for it
+int addReplayEdge(struct replayBackend* replay, size_t* capacity, timestamp_ns timestamp, uint32_t levels)	{
+	if(replay->numEdges == *capacity)	{
+		size_t newCapacity = *capacity ? *capacity * 2 : 1024;
+		struct laserEvent* edges = realloc(replay->edges, newCapacity * sizeof(struct laserEvent));
+		if(!edges)
+			return -1;
+
+		replay->edges = edges;
+		*capacity = newCapacity;
+	}
+
+	replay->edges[replay->numEdges].timestamp = timestamp;
+	replay->edges[replay->numEdges].levels = levels;
+	replay->numEdges++;
+	return 0;
+}
+
+//This function loads a trace of the lasers from a file. Each line holds the time of the edge in nanoseconds, the pin
+//number and the new level of the pin, for example "1500000000 4 0". Empty lines and lines starting with a '#' are
+//skipped, and so are the edges of pins that are not the replay backend's lasers, so that every lane can load the
+//same trace. The first edge of the trace is played back right when the replay starts, on every lane. Returns 0 on
+//success and -1 on an error
+int loadTraceFile(struct replayBackend* replay, const char* fileName)	{
+	FILE* traceFile = fopen(fileName, "r");
+	if(!traceFile)
+		return -1;
+
+	char buffer[255];
+	size_t capacity = 0;
+	uint32_t levels = replay->laserMask;
+	timestamp_ns firstTime = 0;
+	int firstEdge = 1;
+	int result = 0;
+
+	while(fgets(buffer, 255, traceFile) != NULL)	{
+		unsigned long long edgeTime;
+		int pin;
+		int level;
+
+		if(buffer[0] == '#' || sscanf(buffer, "%llu %d %d", &edgeTime, &pin, &level) != 3 || pin < 0 || pin > 31)
+			continue;
+
+		if(firstEdge)
+			firstTime = edgeTime;
+		firstEdge = 0;
+
+		if(!(replay->laserMask & (1u << pin)))
+			continue;
+
+		if(level)
+			levels |= 1u << pin;
+		else
+			levels &= ~(1u << pin);
+
+		if(addReplayEdge(replay, &capacity, replay->startTime + (edgeTime - firstTime), levels) < 0)	{
+			result = -1;
+			break;
+		}
+	}
+
+	fclose(traceFile);
+	return result;
+}
+
+//This function loads synthetic traffic of numPeople walking through the hall, made up by generateTraffic from seed, as
+//the trace. distance is in metres and laserMasks are the bits of the level register of laser 1 and laser 2. If people is
+//not NULL, who walked through is written to it. Returns 0 on success and -1 if there is not enough memory
+int loadSyntheticTrace(struct replayBackend* replay, struct syntheticPerson* people, int numPeople, double meanHeadway, double minSpeed, double maxSpeed, double distance, const uint32_t laserMasks[2], unsigned int seed)	{
+	struct syntheticEdge* edges = malloc(4 * (size_t)numPeople * sizeof(struct syntheticEdge));
+	struct laserEvent* events = malloc(4 * (size_t)numPeople * sizeof(struct laserEvent));
+
+	if(!edges || !events)	{
+		free(edges);
+		free(events);
+		return -1;
+	}
+
+	int numEvents = syntheticEvents(edges, generateTraffic(edges, people, numPeople, meanHeadway, minSpeed, maxSpeed, distance, &seed), laserMasks, events);
+	free(edges);
+
+	for(int i = 0; i < numEvents; i++)
+		events[i].timestamp += replay->startTime;
+
+	free(replay->edges);
+	replay->edges = events;
+	replay->numEdges = numEvents;
+	return 0;
+}
+
+//This function gives the levels of the lasers at the current time of the virtual clock, with the LEDs
+uint32_t replayReadLevels(struct gpioBackend* backend)	{
+	struct replayBackend* replay = (struct replayBackend*)backend;
+
+	return (replay->levels & replay->laserMask) | recorderReadLevels(&replay->leds.backend);
+}
+
+//The LEDs of a replay backend are written to its LED recorder
+void replaySetToOutput(struct gpioBackend* backend, int pinNumber)	{
+	struct replayBackend* replay = (struct replayBackend*)backend;
+
+	recorderSetToOutput(&replay->leds.backend, pinNumber);
+}
+
+void replayWritePin(struct gpioBackend* backend, int pinNumber, int on)	{
+	struct replayBackend* replay = (struct replayBackend*)backend;
+
+	recorderWritePin(&replay->leds.backend, pinNumber, on);
+}
+
+//This function is the virtual clock of a replay backend
+timestamp_ns replayTime(struct gpioBackend* backend)	{
+	struct replayBackend* replay = (struct replayBackend*)backend;
+
+	return replay->now;
+}
+
+//This function plays back the next edge of the trace. If it comes within the timeout, the virtual clock jumps to it,
+//otherwise the clock moves on by the timeout and nothing changes. It returns the same as captureNextEvent, -1 once the
+//trace has run out, but the state machine is still allowed to finish the state it is in with a timeout of 0
+int replayNextEdge(struct gpioBackend* backend, struct laserEvent* event, int timeoutMs)	{
+	struct replayBackend* replay = (struct replayBackend*)backend;
+
+	if(replay->nextEdge == replay->numEdges && timeoutMs)
+		return -1;
+
+	timestamp_ns timeout = (timestamp_ns)timeoutMs * NS_PER_MS;
+
+	if(replay->nextEdge == replay->numEdges || replay->edges[replay->nextEdge].timestamp > replay->now + timeout)	{
+		replay->now += timeout;
+		event->timestamp = replay->now;
+		event->levels = replay->levels;
+		return 0;
+	}
+
+	const struct laserEvent* edge = &replay->edges[replay->nextEdge++];
+	if(edge->timestamp > replay->now)
+		replay->now = edge->timestamp;
+
+	replay->levels = edge->levels;
+	event->timestamp = edge->timestamp;
+	event->levels = edge->levels;
+	return 1;
+}
+
+//This function gives back the memory of the trace
+void freeReplayBackend(struct replayBackend* replay)	{
+	free(replay->edges);
+	replay->edges = NULL;
+	replay->numEdges = 0;
+}
+
+//This function requests the line of every laser in the capture's laser mask from the gpiochip so that the kernel
+//reports every rising and falling edge on them. Returns 0 on success and -1 if the lines could not be requested
+int openEdgeCapture(struct laserCapture* capture)	{
+	int chip = open(GPIO_CHIP_DEVICE, O_RDONLY);
+	if(chip < 0)
+		return -1;
+
+	for(int pin = 0; pin < 32; pin++)	{
+		if(capture->laserMask & (1u << pin))
+			capture->linePins[capture->numLines++] = pin;
+	}
+
+	for(int i = 0; i < capture->numLines; i++)	{
+		struct gpioevent_request request;
+		memset(&request, 0, sizeof(request));
+
+		request.lineoffset = capture->linePins[i];
+		request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+		request.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+		strcpy(request.consumer_label, "speedometer");
+
+		//If one of the lines cannot be requested, give back the ones we already have
+		if(ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &request) < 0)	{
+			for(int j = 0; j < i; j++)	{
+				close(capture->lineFds[j]);
+				capture->lineFds[j] = -1;
+			}
+
+			capture->numLines = 0;
+			close(chip);
+			return -1;
+		}
+
+		capture->lineFds[i] = request.fd;
+
+		//Read the starting level of the line so that the first edge has something to be compared to
+		struct gpiohandle_data data;
+		if(ioctl(request.fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == 0 && data.values[0])
+			capture->levels |= 1 << capture->linePins[i];
+	}
+
+	close(chip);
+	return 0;
+}
+
+//This function starts the capture engine on the lasers whose bits of the level register are in laserMask. If the
+//GPIO backend plays back a trace the edges come from it, otherwise the laser lines are requested as edge events and,
+//if that fails or polling is forced, the level register is polled the same way the program always has. Returns the
+//capture mode or -1 on an error
+int openCapture(struct laserCapture* capture, struct gpioBackend* gpio, uint32_t laserMask, int forcePolling)	{
+	memset(capture, 0, sizeof(*capture));
+	capture->gpio = gpio;
+	capture->laserMask = laserMask;
+
+	if(gpio != NULL && gpio->nextEdge != NULL)	{
+		capture->mode = CAPTURE_REPLAY;
+		capture->levels = gpio->readLevels(gpio) & laserMask;
+		return capture->mode;
+	}
+
+	if(!forcePolling && openEdgeCapture(capture) == 0)	{
+		capture->mode = CAPTURE_EDGE;
+		return capture->mode;
+	}
+
+	if(gpio == NULL)
+		return -1;
+
+	struct laserSample sample;
+	sampleLasers(gpio, laserMask, &sample);
+
+	capture->mode = CAPTURE_POLL;
+	capture->levels = sample.levels;
+	setPollRates(capture, POLL_PERIOD_US, POLL_PERIOD_US, 0);
+	return capture->mode;
+}
+
+//This function sets how often, in microseconds, the level register is read when polling: every idlePeriod while nobody
+//is in any of the halls and every activePeriod once someone is. If spin is 1 the sampler spins between the reads
+//while someone is, instead of sleeping
+void setPollRates(struct laserCapture* capture, float idlePeriod, float activePeriod, int spin)	{
+	capture->idlePeriod = llround(idlePeriod * 1000.0);
+	capture->activePeriod = llround(activePeriod * 1000.0);
+	capture->pollSpin = spin;
+	capture->pollPeriod = capture->activePeriod;
+}
+
+//This function waits for the next edge when polling. The level register is read on a grid of times, set by
+//waitForPoll, until one of the lasers changes or the timeout runs out. Returns -1 if the level register cannot be read
+int pollNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs)	{
+	timestamp_ns deadline = getMonotonicTime() + (timestamp_ns)timeoutMs * NS_PER_MS;
+	int changed = 0;
+
+	while(1)	{
+		struct laserSample sample;
+		if(sampleLasers(capture->gpio, capture->laserMask, &sample) < 0)
+			return -1;
+
+		//Keep count of how regularly the level register is being read, and how long it has been read at each rate
+		if(capture->lastPoll)	{
+			timestamp_ns gap = sample.timestamp - capture->lastPoll;
+
+			if(gap > LATE_POLL_PERIODS * capture->pollPeriod)
+				atomic_fetch_add_explicit(&capture->latePolls, 1, memory_order_relaxed);
+			if(gap > atomic_load_explicit(&capture->longestPollGap, memory_order_relaxed))
+				atomic_store_explicit(&capture->longestPollGap, gap, memory_order_relaxed);
+
+			atomic_fetch_add_explicit(capture->pollActive ? &capture->activeTime : &capture->idleTime, gap, memory_order_relaxed);
+		}
+		capture->lastPoll = sample.timestamp;
+		atomic_fetch_add_explicit(&capture->polls, 1, memory_order_relaxed);
+
+		event->timestamp = sample.timestamp;
+		event->levels = sample.levels;
+
+		if(sample.levels != capture->levels)	{
+			capture->levels = sample.levels;
+			changed = 1;
+			break;
+		}
+
+		if(sample.timestamp >= deadline)
+			break;
+
+		waitForPoll(capture, sample.timestamp);
+	}
+
+	//Keep track of the CPU time the polling takes, for the CPU time the slower reads save
+	struct timespec cpuTime;
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime) == 0)
+		atomic_store_explicit(&capture->cpuTime, (timestamp_ns)cpuTime.tv_sec * NS_PER_SECOND + cpuTime.tv_nsec, memory_order_relaxed);
+
+	return changed;
+}
+
+//This function waits until the level register is next due to be read. It is read every activePeriod while a laser is
+//broken or someone is in one of the halls, and every idlePeriod otherwise, as nobody can get into a hall without
+//breaking a laser first. The reads are kept to a grid of times, slept until with clock_nanosleep, so that the time
+//taken by the reads and the edges does not add up into drift, and a new grid is only started when the rate changes or
+//the sampler has fallen a whole period behind. While someone is in a hall it can spin instead of sleeping
+void waitForPoll(struct laserCapture* capture, timestamp_ns now)	{
+	int active = atomic_load_explicit(&capture->busyLanes, memory_order_relaxed) != 0 || capture->levels != capture->laserMask;
+	timestamp_ns period = active ? capture->activePeriod : capture->idlePeriod;
+
+	if(active == capture->pollActive && capture->nextPoll + period > now)
+		capture->nextPoll += period;
+	else
+		capture->nextPoll = now + period;
+
+	capture->pollActive = active;
+	capture->pollPeriod = period;
+
+	if(active && capture->pollSpin)	{
+		while(getMonotonicTime() < capture->nextPoll)
+			;
+	}
+	else	{
+		struct timespec wakeup = { capture->nextPoll / NS_PER_SECOND, capture->nextPoll % NS_PER_SECOND };
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR)
+			;
+	}
+
+	//How late the sampler got going again, which is what the reads are timed with
+	timestamp_ns late = getMonotonicTime() - capture->nextPoll;
+	atomic_fetch_add_explicit(&capture->wakeups, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&capture->wakeLatency, late, memory_order_relaxed);
+	if(late > atomic_load_explicit(&capture->longestWakeLatency, memory_order_relaxed))
+		atomic_store_explicit(&capture->longestWakeLatency, late, memory_order_relaxed);
+}
+
+//This function writes out how the polling has gone since the program started: the share of the time the level
+//register was read at the active rate, how late the sampler woke up for the reads and the CPU time it used. The CPU
+//time saved is worked out from the CPU time a read has taken, for the reads that would have been made had the level
+//register been read at the active rate all the time
+void printPollStats(FILE* statsFile, struct laserCapture* capture)	{
+	unsigned long long polls = atomic_load_explicit(&capture->polls, memory_order_relaxed);
+	unsigned long long wakeups = atomic_load_explicit(&capture->wakeups, memory_order_relaxed);
+	double idleTime = atomic_load_explicit(&capture->idleTime, memory_order_relaxed);
+	double activeTime = atomic_load_explicit(&capture->activeTime, memory_order_relaxed);
+	double cpuTime = atomic_load_explicit(&capture->cpuTime, memory_order_relaxed);
+
+	double dutyCycle = (idleTime + activeTime > 0) ? 100.0 * activeTime / (idleTime + activeTime) : 0;
+	double fixedPolls = (idleTime + activeTime) / capture->activePeriod;
+	double savedTime = (polls && fixedPolls > polls) ? (fixedPolls - polls) * cpuTime / polls : 0;
+
+	fprintf(statsFile, "The level register has been read %llu times since the program started, every %.0f us %.1f%% of the time and every %.0f us otherwise, the sampler waking up %.1f us late on average and %.1f us at the most\n", polls, capture->activePeriod / 1000.0, dutyCycle, capture->idlePeriod / 1000.0, wakeups ? atomic_load_explicit(&capture->wakeLatency, memory_order_relaxed) / 1000.0 / wakeups : 0, atomic_load_explicit(&capture->longestWakeLatency, memory_order_relaxed) / 1000.0);
+	fprintf(statsFile, "The sampler has used %.3f s of CPU time, about %.3f s less than reading the level register every %.0f us all of the time would have\n", cpuTime / NS_PER_SECOND, savedTime / NS_PER_SECOND, capture->activePeriod / 1000.0);
+}
+
+//This function waits for the next edge reported by the kernel. One event is read ahead from each line so
+//that when several lasers have changed, the earliest of their edges is always handed out first
+int edgeNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs)	{
+	struct pollfd pollFds[MAX_LASER_LINES];
+	int line = -1;
+
+	//The first pass only picks up the events that are already waiting, the second pass waits for new ones
+	for(int pass = 0; pass < 2 && line < 0; pass++)	{
+		int waiting = 0;
+
+		for(int i = 0; i < capture->numLines; i++)	{
+			pollFds[i].fd = capture->hasPendingEvent[i] ? -1 : capture->lineFds[i];
+			pollFds[i].events = POLLIN;
+			pollFds[i].revents = 0;
+			waiting += !capture->hasPendingEvent[i];
+		}
+
+		if(waiting && poll(pollFds, capture->numLines, pass ? timeoutMs : 0) < 0 && errno != EINTR)
+			return -1;
+
+		for(int i = 0; i < capture->numLines; i++)	{
+			if(pollFds[i].revents & POLLIN)	{
+				if(read(capture->lineFds[i], &capture->pendingEvents[i], sizeof(struct gpioevent_data)) == sizeof(struct gpioevent_data))
+					capture->hasPendingEvent[i] = 1;
+			}
+
+			//Pick out the earliest of the events that have been read
+			if(capture->hasPendingEvent[i] && (line < 0 || capture->pendingEvents[i].timestamp < capture->pendingEvents[line].timestamp))
+				line = i;
+		}
+	}
+
+	//Nothing happened before the timeout, so just hand back the levels we already know
+	if(line < 0)	{
+		event->timestamp = getMonotonicTime();
+		event->levels = capture->levels;
+		return 0;
+	}
+
+	if(capture->pendingEvents[line].id == GPIOEVENT_EVENT_RISING_EDGE)
+		capture->levels |= 1 << capture->linePins[line];
+	else
+		capture->levels &= ~(1 << capture->linePins[line]);
+
+	capture->hasPendingEvent[line] = 0;
+
+	//Since Linux 5.7 the kernel timestamps line events with CLOCK_MONOTONIC, the same clock as getMonotonicTime
+	event->timestamp = capture->pendingEvents[line].timestamp;
+	event->levels = capture->levels;
+	return 1;
+}
+
+//This function gets a stream of size samples, a power of 2 no smaller than two blocks, taken every period
+//nanoseconds ready to be filled. Returns 0 on success and -1 if there is no memory for it
+int initStream(struct sampleStream* stream, size_t size, timestamp_ns period)	{
+	memset(stream, 0, sizeof(*stream));
+	stream->size = size;
+	stream->period = period;
+	stream->cpu = -1;
+
+	stream->samples = aligned_alloc(64, size * sizeof(uint32_t));
+	stream->blockTimes = malloc(size / STREAM_BLOCK_SAMPLES * sizeof(*stream->blockTimes));
+	stream->readyFd = eventfd(0, EFD_NONBLOCK);
+
+	if(!stream->samples || !stream->blockTimes || stream->readyFd < 0)	{
+		freeStream(stream);
+		return -1;
+	}
+
+	return 0;
+}
+
+//This function gives the block of the stream the next STREAM_BLOCK_SAMPLES samples are to be written to
+uint32_t* streamBlock(struct sampleStream* stream)	{
+	size_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+
+	return &stream->samples[head & (stream->size - 1)];
+}
+
+//This function hands the block written to streamBlock over to the scanner, with the times its first and last
+//samples were taken
+void publishStreamBlock(struct sampleStream* stream, timestamp_ns firstTime, timestamp_ns lastTime)	{
+	size_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+	size_t block = (head / STREAM_BLOCK_SAMPLES) & (stream->size / STREAM_BLOCK_SAMPLES - 1);
+
+	stream->blockTimes[block][0] = firstTime;
+	stream->blockTimes[block][1] = lastTime;
+	atomic_store_explicit(&stream->head, head + STREAM_BLOCK_SAMPLES, memory_order_release);
+
+	uint64_t one = 1;
+	write(stream->readyFd, &one, sizeof(one));
+}
+
+//This function gets the thread it is called on ready to read the lasers. It is pinned to cpu, unless that is -1, and
+//unless priority is 0 it is scheduled with SCHED_FIFO at that priority, so that only the kernel and other real-time
+//threads can hold it up. Its stack is touched first, so that it does not fault on the way in. Returns 0 on success and
+//-1 if the priority could not be set, usually because the program is not run as root
+int makeRealtime(int cpu, int priority)	{
+	if(cpu >= 0)	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	if(!priority)
+		return 0;
+
+	prefaultStack();
+
+	struct sched_param param = { .sched_priority = priority };
+	return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 ? 0 : -1;
+}
+
+//This function touches REALTIME_STACK_PREFAULT bytes of the stack of the thread it is called on, a page at a time, so
+//that the pages are there before the thread needs them
+void prefaultStack()	{
+	volatile char stack[REALTIME_STACK_PREFAULT];
+
+	for(size_t i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+//This is the streamer thread. It reads the level register every period, on a fixed grid of times rather than a sleep
+//after every read, so that the samples are evenly spaced. The periods are far shorter than the scheduler can sleep for,
+//so it spins on the clock between reads and is best given a CPU of its own with -c
+void* streamerMain(void* argument)	{
+	struct sampleStream* stream = argument;
+
+	//If asked to, keep the streamer on its own CPU and at real-time priority
+	if(makeRealtime(stream->cpu, stream->priority) < 0)
+		atomic_store(&stream->realtime, -1);
+	else if(stream->priority)
+		atomic_store(&stream->realtime, 1);
+
+	timestamp_ns next = getMonotonicTime();
+
+	while(atomic_load_explicit(&stream->running, memory_order_relaxed))	{
+		uint32_t* block = streamBlock(stream);
+		timestamp_ns firstTime = 0;
+		timestamp_ns now = 0;
+
+		for(int i = 0; i < STREAM_BLOCK_SAMPLES; i++)	{
+			while((now = getMonotonicTime()) < next)
+				;
+
+			//After a gap the reads no longer fit the even spacing of the block. The rest of the block is filled with the
+			//read before the gap, timed as if there had been none, and the grid starts again from now in the next block.
+			//There is no catching up on the reads that were missed
+			if(now - next > STREAM_GAP_PERIODS * stream->period)	{
+				atomic_fetch_add_explicit(&stream->gaps, 1, memory_order_relaxed);
+				next = now;
+
+				if(i)	{
+					for(; i < STREAM_BLOCK_SAMPLES; i++)
+						block[i] = block[i - 1];
+
+					now = firstTime + (STREAM_BLOCK_SAMPLES - 1) * stream->period;
+					break;
+				}
+			}
+
+			block[i] = stream->gpio->readLevels(stream->gpio);
+			if(!i)
+				firstTime = now;
+
+			if(now - next > stream->period)
+				atomic_fetch_add_explicit(&stream->lateSamples, 1, memory_order_relaxed);
+			next += stream->period;
+		}
+
+		publishStreamBlock(stream, firstTime, now);
+	}
+
+	uint64_t one = 1;
+	atomic_store(&stream->finished, 1);
+	write(stream->readyFd, &one, sizeof(one));
+
+	return NULL;
+}
+
+//This function starts streaming the level register of the GPIO backend, on the given CPU if it is not -1 and at the
+//given real-time priority if it is not 0. Returns 0 on success and -1 if the streamer thread could not be created
+int startStream(struct sampleStream* stream, struct gpioBackend* gpio, int cpu, int priority)	{
+	stream->gpio = gpio;
+	stream->cpu = cpu;
+	stream->priority = priority;
+	atomic_store(&stream->running, 1);
+
+	if(pthread_create(&stream->thread, NULL, streamerMain, stream) != 0)	{
+		atomic_store(&stream->running, 0);
+		return -1;
+	}
+
+	stream->started = 1;
+	return 0;
+}
+
+//This function stops the streamer thread and waits for it to finish
+void stopStream(struct sampleStream* stream)	{
+	atomic_store(&stream->running, 0);
+
+	if(stream->started)
+		pthread_join(stream->thread, NULL);
+
+	stream->started = 0;
+}
+
+//This function gives back the memory of a stream
+void freeStream(struct sampleStream* stream)	{
+	free(stream->samples);
+	free(stream->blockTimes);
+	if(stream->readyFd >= 0)
+		close(stream->readyFd);
+
+	stream->samples = NULL;
+	stream->blockTimes = NULL;
+	stream->readyFd = -1;
+}
+
+//This function starts the capture engine on a stream of the level register, watching the lasers whose bits are in
+//laserMask. levels are the levels of the lasers before the first sample
+void openStreamCapture(struct laserCapture* capture, struct sampleStream* stream, uint32_t laserMask, uint32_t levels)	{
+	memset(capture, 0, sizeof(*capture));
+	capture->mode = CAPTURE_STREAM;
+	capture->gpio = stream->gpio;
+	capture->laserMask = laserMask;
+	capture->stream = stream;
+	capture->scanned = atomic_load(&stream->head);
+	capture->levels = levels & laserMask;
+}
+
+//This function finds the first of count samples whose bits under mask are different from the sample before it,
+//previous being the one before the first. Almost every sample is the same as the one before, so the samples are
+//compared two at a time as one 64 bit word, against the same word moved along by one sample. Returns the index of the
+//sample or count if none of them is different
+size_t findEdge(const uint32_t* samples, size_t count, uint32_t previous, uint32_t mask)	{
+	const uint64_t pairMask = mask | (uint64_t)mask << 32;
+	uint64_t last = previous;
+	size_t i = 0;
+
+	for(; i + 2 <= count; i += 2)	{
+		uint64_t pair;
+		memcpy(&pair, &samples[i], sizeof(pair));
+
+		uint64_t changed = (pair ^ (pair << 32 | last)) & pairMask;
+		if(changed)
+			return i + !(changed & 0xFFFFFFFF);
+
+		last = pair >> 32;
+	}
+
+	if(i < count && ((samples[i] ^ last) & mask))
+		return i;
+
+	return count;
+}
+
+//This function empties a batch of edges before a scan
+void resetEdgeBatch(struct edgeBatch* batch)	{
+	batch->numEdges = 0;
+	batch->changedPins = 0;
+}
+
+//This function adds the edge in a sample, level, to the batch. previous is the sample before it. Every pin that changed
+//for the first time in the run has its sample noted, going through them with count trailing zeros rather than one pin
+//at a time. Returns 1 once the batch is full
+int addEdge(struct edgeBatch* batch, size_t sample, uint32_t level, uint32_t previous, uint32_t mask)	{
+	uint32_t changed = (level ^ previous) & mask;
+	size_t edge = batch->numEdges++;
+
+	batch->samples[edge] = sample;
+	batch->levels[edge] = level & mask;
+	batch->rising[edge] = changed & level;
+	batch->falling[edge] = changed & ~level;
+
+	for(uint32_t newPins = changed & ~batch->changedPins; newPins; newPins &= newPins - 1)
+		batch->firstEdges[__builtin_ctz(newPins)] = sample;
+	batch->changedPins |= changed;
+
+	return batch->numEdges == EDGE_BATCH_SIZE;
+}
+
+//This function finds every sample of count samples whose bits under mask are different from the sample before it,
+//previous being the one before the first, and puts them in the batch. Every pin of the level register is looked at at
+//once, and almost every sample is the same as the one before, so 8 samples are compared with the 8 before them at a
+//time using the vector instructions of the CPU, only the rare runs with an edge in them being looked at one sample at
+//a time. Without vector instructions the samples are compared two at a time as one 64 bit word instead. It stops once
+//the batch is full. Returns the number of samples scanned
+size_t detectEdges(const uint32_t* samples, size_t count, uint32_t previous, uint32_t mask, struct edgeBatch* batch)	{
+	resetEdgeBatch(batch);
+	if(!count)
+		return 0;
+
+	//The first sample is compared with previous, and from then on every sample with the one before it in the run
+	if(((samples[0] ^ previous) & mask) && addEdge(batch, 0, samples[0], previous, mask))
+		return 1;
+
+	size_t i = 1;
+
+	#if defined(__SSE2__)
+	const __m128i masks = _mm_set1_epi32(mask);
+	const __m128i zero = _mm_setzero_si128();
+
+	for(; i + 8 <= count; i += 8)	{
+		__m128i low = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&samples[i]), _mm_loadu_si128((const __m128i*)&samples[i - 1]));
+		__m128i high = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&samples[i + 4]), _mm_loadu_si128((const __m128i*)&samples[i + 3]));
+		__m128i changed = _mm_and_si128(_mm_or_si128(low, high), masks);
+
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(changed, zero)) == 0xFFFF)
+			continue;
+
+		for(size_t j = i; j < i + 8; j++)	{
+			if(((samples[j] ^ samples[j - 1]) & mask) && addEdge(batch, j, samples[j], samples[j - 1], mask))
+				return j + 1;
+		}
+	}
+	#elif defined(__ARM_NEON)
+	const uint32x4_t masks = vdupq_n_u32(mask);
+
+	for(; i + 8 <= count; i += 8)	{
+		uint32x4_t low = veorq_u32(vld1q_u32(&samples[i]), vld1q_u32(&samples[i - 1]));
+		uint32x4_t high = veorq_u32(vld1q_u32(&samples[i + 4]), vld1q_u32(&samples[i + 3]));
+		uint32x4_t changed = vandq_u32(vorrq_u32(low, high), masks);
+		uint32x2_t folded = vorr_u32(vget_low_u32(changed), vget_high_u32(changed));
+
+		if(!(vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)))
+			continue;
+
+		for(size_t j = i; j < i + 8; j++)	{
+			if(((samples[j] ^ samples[j - 1]) & mask) && addEdge(batch, j, samples[j], samples[j - 1], mask))
+				return j + 1;
+		}
+	}
+	#else
+	const uint64_t pairMask = mask | (uint64_t)mask << 32;
+
+	for(; i + 2 <= count; i += 2)	{
+		uint64_t pair;
+		uint64_t before;
+		memcpy(&pair, &samples[i], sizeof(pair));
+		memcpy(&before, &samples[i - 1], sizeof(before));
+
+		if(!((pair ^ before) & pairMask))
+			continue;
+
+		for(size_t j = i; j < i + 2; j++)	{
+			if(((samples[j] ^ samples[j - 1]) & mask) && addEdge(batch, j, samples[j], samples[j - 1], mask))
+				return j + 1;
+		}
+	}
+	#endif
+
+	for(; i < count; i++)	{
+		if(((samples[i] ^ samples[i - 1]) & mask) && addEdge(batch, i, samples[i], samples[i - 1], mask))
+			return i + 1;
+	}
+
+	return count;
+}
+
+//This function does the same as detectEdges one sample and one pin at a time, the way the lasers used to be looked at.
+//It is what the benchmarks check and time detectEdges against
+size_t detectEdgesScalar(const uint32_t* samples, size_t count, uint32_t previous, uint32_t mask, struct edgeBatch* batch)	{
+	resetEdgeBatch(batch);
+
+	for(size_t i = 0; i < count; i++)	{
+		uint32_t level = samples[i];
+		uint32_t changed = 0;
+
+		for(int pin = 0; pin < 32; pin++)	{
+			uint32_t bit = 1u << pin;
+			if((mask & bit) && (level & bit) != (previous & bit))
+				changed |= bit;
+		}
+
+		if(changed && addEdge(batch, i, level, previous, mask))
+			return i + 1;
+		previous = level;
+	}
+
+	return count;
+}
+
+//This function gives the time a sample of the stream was taken, spreading the samples of its block evenly between
+//the first and the last
+timestamp_ns streamSampleTime(const struct sampleStream* stream, size_t sample)	{
+	const timestamp_ns* times = stream->blockTimes[(sample / STREAM_BLOCK_SAMPLES) & (stream->size / STREAM_BLOCK_SAMPLES - 1)];
+
+	return times[0] + (times[1] - times[0]) * (sample % STREAM_BLOCK_SAMPLES) / (STREAM_BLOCK_SAMPLES - 1);
+}
+
+//This function waits for the next edge in the stream. The blocks that have come in since the last scan are scanned for
+//up to EDGE_BATCH_SIZE samples in which a laser changed, which are then handed out one at a time, timed by where they
+//are in the stream. They are timed as soon as they are found, before the streamer can write over the times of their
+//block. It returns the same as captureNextEvent, -1 once the stream has finished and every sample has been scanned
+int streamNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs)	{
+	struct sampleStream* stream = capture->stream;
+	timestamp_ns deadline = getMonotonicTime() + (timestamp_ns)timeoutMs * NS_PER_MS;
+
+	while(1)	{
+		//Edges already found by the last scan are handed out first, and only then is the stream scanned again
+		if(capture->nextBatchEvent < capture->numBatchEvents)	{
+			*event = capture->batchEvents[capture->nextBatchEvent++];
+			capture->levels = event->levels;
+			return 1;
+		}
+		capture->numBatchEvents = 0;
+
+		size_t head = atomic_load_explicit(&stream->head, memory_order_acquire);
+
+		//The streamer is about to write over samples that have not been scanned, so they are skipped. A laser that
+		//changed in them shows up as an edge at the first sample after them
+		if(head - capture->scanned > stream->size - STREAM_BLOCK_SAMPLES)	{
+			capture->scanned = head - STREAM_BLOCK_SAMPLES;
+			atomic_fetch_add_explicit(&capture->overruns, 1, memory_order_relaxed);
+		}
+
+		while(capture->scanned < head && !capture->numBatchEvents)	{
+			size_t first = capture->scanned & (stream->size - 1);
+			size_t count = head - capture->scanned;
+			if(count > stream->size - first)
+				count = stream->size - first;
+
+			struct edgeBatch batch;
+			size_t scanned = detectEdges(&stream->samples[first], count, capture->levels, capture->laserMask, &batch);
+
+			for(size_t i = 0; i < batch.numEdges; i++)	{
+				capture->batchEvents[i].timestamp = streamSampleTime(stream, capture->scanned + batch.samples[i]);
+				capture->batchEvents[i].levels = batch.levels[i];
+			}
+
+			capture->numBatchEvents = batch.numEdges;
+			capture->nextBatchEvent = 0;
+			capture->scanned += scanned;
+		}
+
+		if(capture->numBatchEvents)
+			continue;
+
+		if(atomic_load(&stream->finished) && capture->scanned == atomic_load(&stream->head))
+			return -1;
+
+		//Nothing has changed, so wait for the next block until the timeout runs out
+		timestamp_ns now = getMonotonicTime();
+		if(now >= deadline)	{
+			event->timestamp = now;
+			event->levels = capture->levels;
+			return 0;
+		}
+
+		struct pollfd ready = { stream->readyFd, POLLIN, 0 };
+		if(poll(&ready, 1, (deadline - now) / NS_PER_MS + 1) > 0)	{
+			uint64_t count;
+			read(stream->readyFd, &count, sizeof(count));
+		}
+	}
+}
+
+//This function hands the state machine the next change of the lasers. Returns 1 if one of the lasers changed,
+//0 if the timeout ran out first (the event then holds the current levels and time) and -1 if the capture has ended
+int captureNextEvent(struct laserCapture* capture, struct laserEvent* event, int timeoutMs)	{
+	if(capture->mode == CAPTURE_EDGE)
+		return edgeNextEvent(capture, event, timeoutMs);
+
+	if(capture->mode == CAPTURE_STREAM)
+		return streamNextEvent(capture, event, timeoutMs);
+
+	if(capture->mode == CAPTURE_REPLAY)
+		return capture->gpio->nextEdge(capture->gpio, event, timeoutMs);
+
+	return pollNextEvent(capture, event, timeoutMs);
+}
+
+//This function gives back the line event file descriptors used by the capture
+void closeCapture(struct laserCapture* capture)	{
+	for(int i = 0; i < capture->numLines; i++)	{
+		if(capture->lineFds[i] >= 0)
+			close(capture->lineFds[i]);
+	}
+
+	capture->numLines = 0;
+}
+
+//This function adds an event to the ring. It must only ever be called from the sampler thread. Returns 0 on
+//success and -1 if the ring is full, in which case the event is dropped and counted as an overflow
+int pushEvent(struct eventRing* ring, const struct laserEvent* event)	{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if(head - tail >= EVENT_RING_SIZE)	{
+		atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+		return -1;
+	}
+
+	ring->events[head & (EVENT_RING_SIZE - 1)] = *event;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	//Keep track of the most events that have ever been waiting in the ring
+	size_t used = head + 1 - tail;
+	if(used > atomic_load_explicit(&ring->highWater, memory_order_relaxed))
+		atomic_store_explicit(&ring->highWater, used, memory_order_relaxed);
+
+	return 0;
+}
+
+//This function takes the oldest event out of the ring. It must only ever be called from the thread running
+//the state machine. Returns 1 if an event was taken and 0 if the ring is empty
+int popEvent(struct eventRing* ring, struct laserEvent* event)	{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	if(tail == head)
+		return 0;
+
+	*event = ring->events[tail & (EVENT_RING_SIZE - 1)];
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+	return 1;
+}
+
+//This function hands an edge captured by the sampler thread to the lanes whose lasers it changed. Each lane is given
+//only the levels of its own lasers, so that its state machine never sees the other lanes. An event that did not
+//change any laser means edges were missed, and since they could have been on any lane it is given to all of them
+void fanOutEvent(struct samplerThread* sampler, const struct laserEvent* event)	{
+	uint32_t changed = event->levels ^ sampler->levels;
+
+	for(int lane = 0; lane < sampler->numLanes; lane++)	{
+		struct samplerLane* samplerLane = &sampler->lanes[lane];
+
+		if(changed && !(changed & samplerLane->mask))
+			continue;
+
+		struct laserEvent laneEvent = { event->timestamp, event->levels & samplerLane->mask };
+
+		//Wake the lane's state machine up every time there is a new edge for it
+		if(pushEvent(&samplerLane->ring, &laneEvent) == 0)	{
+			uint64_t one = 1;
+			write(samplerLane->wakeFd, &one, sizeof(one));
+		}
+	}
+
+	sampler->levels = event->levels;
+}
+
+//This is the sampler thread. It does nothing but wait for the lasers to change and push the edges into the
+//rings of the lanes, so the lasers keep being watched while the state machines are busy logging or blinking the LEDs
+void* samplerMain(void* argument)	{
+	struct samplerThread* sampler = argument;
+
+	//If asked to, keep the sampler on its own CPU so that it is not moved around by the scheduler, and at real-time
+	//priority so that it is not held up by it
+	if(makeRealtime(sampler->cpu, sampler->priority) < 0)
+		atomic_store(&sampler->realtime, -1);
+	else if(sampler->priority)
+		atomic_store(&sampler->realtime, 1);
+
+	while(atomic_load(&sampler->running))	{
+		struct laserEvent event;
+		int captured = captureNextEvent(sampler->capture, &event, CAPTURE_TIMEOUT_MS);
+
+		if(captured < 0)
+			break;
+
+		if(captured)
+			fanOutEvent(sampler, &event);
+	}
+
+	//Let the state machines know that there will not be any more events
+	uint64_t one = 1;
+	atomic_store(&sampler->finished, 1);
+
+	for(int lane = 0; lane < sampler->numLanes; lane++)
+		write(sampler->lanes[lane].wakeFd, &one, sizeof(one));
+
+	return NULL;
+}
+
+//This function gets a sampler thread ready to watch the lasers through the given capture engine, for numLanes lanes
+//whose lasers are the bits of the level register in laneMasks. If cpu is not -1 the thread will be pinned to that
+//CPU, and if priority is not 0 it will run at that real-time priority. Returns 0 on success and -1 on an error
+int initSampler(struct samplerThread* sampler, struct laserCapture* capture, int cpu, int priority, const uint32_t laneMasks[], int numLanes)	{
+	memset(sampler, 0, sizeof(*sampler));
+	sampler->capture = capture;
+	sampler->cpu = cpu;
+	sampler->priority = priority;
+	sampler->levels = capture->levels;
+	sampler->numLanes = numLanes;
+	pthread_mutex_init(&sampler->startLock, NULL);
+
+	for(int lane = 0; lane < numLanes; lane++)	{
+		struct samplerLane* samplerLane = &sampler->lanes[lane];
+		samplerLane->mask = laneMasks[lane];
+		samplerLane->levels = capture->levels & laneMasks[lane];
+
+		samplerLane->wakeFd = eventfd(0, EFD_NONBLOCK);
+		if(samplerLane->wakeFd < 0)	{
+			for(int i = 0; i < lane; i++)
+				close(sampler->lanes[i].wakeFd);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+//This function starts the sampler thread. Every lane calls it, but only the first call starts the thread. A trace is
+//played back on the state machine's own thread instead, so that it runs on the virtual clock and always gives the
+//same results. Returns 0 on success and -1 if the thread could not be created
+int startSampler(struct samplerThread* sampler)	{
+	if(sampler->capture->mode == CAPTURE_REPLAY)
+		return 0;
+
+	int result = 0;
+	pthread_mutex_lock(&sampler->startLock);
+
+	if(!sampler->started)	{
+		atomic_store(&sampler->running, 1);
+
+		if(pthread_create(&sampler->thread, NULL, samplerMain, sampler) != 0)	{
+			atomic_store(&sampler->running, 0);
+			result = -1;
+		}
+		else
+			sampler->started = 1;
+	}
+
+	pthread_mutex_unlock(&sampler->startLock);
+	return result;
+}
+
+//This function hands a lane's state machine the next edge pushed by the sampler thread. It works the same way as
+//captureNextEvent: it returns 1 for an edge, 0 if the timeout ran out first (the event then holds the last levels
+//and the current time) and -1 once the sampler has stopped and every one of its events has been handed out
+int samplerNextEvent(struct samplerThread* sampler, int lane, struct laserEvent* event, int timeoutMs)	{
+	struct samplerLane* samplerLane = &sampler->lanes[lane];
+	samplerLane->wokenAt = 0;
+
+	//Without a sampler thread the capture engine is asked directly
+	if(sampler->capture->mode == CAPTURE_REPLAY)	{
+		int captured = captureNextEvent(sampler->capture, event, timeoutMs);
+		if(captured > 0)
+			samplerLane->levels = event->levels;
+		return captured;
+	}
+
+	int popped = popEvent(&samplerLane->ring, event);
+
+	if(!popped && atomic_load(&sampler->finished))	{
+		//The sampler might have pushed one last event right before finishing, so check the ring once more
+		popped = popEvent(&samplerLane->ring, event);
+
+		//Once everything has been handed out, the state machine is still allowed to finish the state it is in
+		if(!popped && timeoutMs)
+			return -1;
+	}
+	else if(!popped && timeoutMs)	{
+		struct pollfd wakeup = { samplerLane->wakeFd, POLLIN, 0 };
+
+		if(poll(&wakeup, 1, timeoutMs) > 0)	{
+			uint64_t count;
+			read(samplerLane->wakeFd, &count, sizeof(count));
+		}
+
+		samplerLane->wokenAt = getMonotonicTime();
+		popped = popEvent(&samplerLane->ring, event);
+	}
+
+	if(!popped)	{
+		event->timestamp = samplerLane->wokenAt ? samplerLane->wokenAt : getMonotonicTime();
+		event->levels = samplerLane->levels;
+		return 0;
+	}
+
+	samplerLane->levels = event->levels;
+	return 1;
+}
+
+//This function is called by the state machine of a lane with whether anyone is in its hall, so that the sampler reads
+//the lasers at the active rate until everyone has left every hall
+void setLaneBusy(struct samplerThread* sampler, int lane, int busy)	{
+	struct samplerLane* samplerLane = &sampler->lanes[lane];
+
+	if(busy == samplerLane->busy)
+		return;
+
+	if(busy)
+		atomic_fetch_or_explicit(&sampler->capture->busyLanes, 1u << lane, memory_order_relaxed);
+	else
+		atomic_fetch_and_explicit(&sampler->capture->busyLanes, ~(1u << lane), memory_order_relaxed);
+
+	samplerLane->busy = busy;
+}
+
+//This function stops the sampler thread and waits for it to finish
+void stopSampler(struct samplerThread* sampler)	{
+	atomic_store(&sampler->running, 0);
+
+	if(sampler->started)
+		pthread_join(sampler->thread, NULL);
+
+	sampler->started = 0;
+
+	for(int lane = 0; lane < sampler->numLanes; lane++)
+		close(sampler->lanes[lane].wakeFd);
+
+	pthread_mutex_destroy(&sampler->startLock);
+}
+
+//This function will change the appropriate pins value in the select register
+//so that the pin can function as an output
+void setToOutput(struct gpioBackend* gpio, int pinNumber)	{
+	//Check that the gpio is functional
+	if(gpio == NULL)
+	{
+		#ifndef RUN_AS_SERVICE
+		printf("The GPIO has not been intitialized properly \n");
+		#endif
+
+		return;
+	}
+
+	//Check that we are trying to set a valid pin number
+	if(pinNumber < 2 || pinNumber > 27)
+	{
+		#ifndef RUN_AS_SERVICE
+		printf("Not a valid pinNumer \n");
+		#endif
+
+		return;
+	}
+
+	gpio->setToOutput(gpio, pinNumber);
+}
+
+//This function will make an output pin output 3.3V
+void outputOn(struct gpioBackend* gpio, int pinNumber)	{
+	//Without a GPIO there are no LEDs to turn on
+	if(gpio == NULL)
+		return;
+
+	gpio->writePin(gpio, pinNumber, 1);
+}
+
+//This function will make an output pin turn off
+void outputOff(struct gpioBackend* gpio, int pinNumber)	{
+	if(gpio == NULL)
+		return;
+
+	gpio->writePin(gpio, pinNumber, 0);
+}
+
+//This function gets the LED scheduler ready. Every LED it looks after starts out off
+void initLedScheduler(struct ledScheduler* leds, struct gpioBackend* gpio)	{
+	memset(leds, 0, sizeof(*leds));
+	leds->gpio = gpio;
+}
+
+//This function finds the effect of an LED, adding the LED to the scheduler the first time it is used.
+//Returns NULL if the scheduler is already looking after MAX_SCHEDULED_LEDS other LEDs
+struct ledEffect* findLedEffect(struct ledScheduler* leds, int pinNumber)	{
+	for(int i = 0; i < leds->numLeds; i++)	{
+		if(leds->effects[i].pin == pinNumber)
+			return &leds->effects[i];
+	}
+
+	if(leds->numLeds == MAX_SCHEDULED_LEDS)
+		return NULL;
+
+	struct ledEffect* effect = &leds->effects[leds->numLeds++];
+	effect->pin = pinNumber;
+	return effect;
+}
+
+//This function turns an LED on or off for as long as nothing else is asked of it, for example to keep the
+//warning LED on while someone is in the hall. If the LED is blinking, it goes to this state once it is done
+void ledSolid(struct ledScheduler* leds, int pinNumber, int on)	{
+	struct ledEffect* effect = findLedEffect(leds, pinNumber);
+	if(effect == NULL)
+		return;
+
+	effect->solidOn = on;
+
+	if(!effect->blinksLeft && effect->lit != on)	{
+		effect->lit = on;
+		if(on)
+			outputOn(leds->gpio, pinNumber);
+		else
+			outputOff(leds->gpio, pinNumber);
+	}
+}
+
+//This function starts blinking an LED the given number of times, staying on and then off for period
+//nanoseconds each time. The LED is turned on right away and runLedScheduler takes care of the rest
+void ledBlink(struct ledScheduler* leds, int pinNumber, int times, timestamp_ns period, timestamp_ns now)	{
+	struct ledEffect* effect = findLedEffect(leds, pinNumber);
+	if(effect == NULL || times <= 0)
+		return;
+
+	effect->blinksLeft = times;
+	effect->period = period;
+	effect->lit = 1;
+	effect->deadline = now + period;
+	outputOn(leds->gpio, pinNumber);
+}
+
+//This function moves every blinking LED along. It never waits: it only switches the LEDs whose deadline has
+//passed. Returns the time of the next deadline, or 0 if none of the LEDs are blinking
+timestamp_ns runLedScheduler(struct ledScheduler* leds, timestamp_ns now)	{
+	timestamp_ns nextDeadline = 0;
+
+	for(int i = 0; i < leds->numLeds; i++)	{
+		struct ledEffect* effect = &leds->effects[i];
+
+		//Catch up on every deadline that has passed, in case the state machine was slow to get here
+		while(effect->blinksLeft && now >= effect->deadline)	{
+			if(effect->lit)	{
+				effect->lit = 0;
+				outputOff(leds->gpio, effect->pin);
+			}
+			else if(--effect->blinksLeft)	{
+				effect->lit = 1;
+				outputOn(leds->gpio, effect->pin);
+			}
+
+			effect->deadline += effect->period;
+		}
+
+		//Once it has finished blinking, put the LED back the way it was asked to stay
+		if(!effect->blinksLeft && effect->lit != effect->solidOn)	{
+			effect->lit = effect->solidOn;
+			if(effect->lit)
+				outputOn(leds->gpio, effect->pin);
+			else
+				outputOff(leds->gpio, effect->pin);
+		}
+
+		if(effect->blinksLeft && (!nextDeadline || effect->deadline < nextDeadline))
+			nextDeadline = effect->deadline;
+	}
+
+	return nextDeadline;
+}
+
+//This function will get the current time, down to the millisecond. Working out the date and time of day is slow, so
+//each thread keeps the text of the last second it formatted and only writes the milliseconds after it until the
+//second changes. buffer must hold at least TIME_BUFFER_SIZE characters
+void getTime(char* buffer)	{
+	//The second that was formatted last and its text, one for each thread so that no locking is needed
+	static _Thread_local time_t cachedSecond = -1;
+	static _Thread_local char cachedText[TIME_BUFFER_SIZE];
+	static _Thread_local int cachedLength;
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	//This will set the text to be equal to a string that in
+	//equivalent to the current date, in a month, day, year and
+	//the current time in 24 hour notation.
+	if(now.tv_sec != cachedSecond)	{
+		struct tm date;
+		localtime_r(&now.tv_sec, &date);
+		cachedLength = strftime(cachedText, TIME_BUFFER_SIZE - 3, "%m-%d-%Y  %T.", &date);
+		cachedSecond = now.tv_sec;
+	}
+
+	int milliseconds = now.tv_nsec / NS_PER_MS;
+
+	memcpy(buffer, cachedText, cachedLength);
+	buffer[cachedLength] = '0' + milliseconds / 100;
+	buffer[cachedLength + 1] = '0' + milliseconds / 10 % 10;
+	buffer[cachedLength + 2] = '0' + milliseconds % 10;
+	buffer[cachedLength + 3] = 0;
+}
+
+//This function is getTime the way it used to be, with gettimeofday, localtime and strftime every time. It is only
+//kept for runTimeBenchmark to compare against
+void getTimeUncached(char* buffer)	{
+  	struct timeval tv;
+  	time_t curtime;
+
+  	gettimeofday(&tv, NULL); 
+  	curtime=tv.tv_sec;
+
+  	strftime(buffer,30,"%m-%d-%Y  %T.",localtime(&curtime));
+}
+
+//This function is run by each of the threads of runTimeBenchmark. It formats TIME_BENCHMARK_CALLS times and hands
+//back how long that took, in nanoseconds, through argument
+void* timeBenchmarkThread(void* argument)	{
+	timestamp_ns* elapsed = argument;
+	char buffer[TIME_BUFFER_SIZE];
+
+	timestamp_ns start = getMonotonicTime();
+	for(int i = 0; i < TIME_BENCHMARK_CALLS; i++)
+		getTime(buffer);
+	*elapsed = getMonotonicTime() - start;
+
+	return NULL;
+}
+
+//This function measures how long getTime takes against the way it used to work, on one thread and then on
+//TIME_BENCHMARK_THREADS threads at once, and prints the results
+void runTimeBenchmark(FILE* results)	{
+	char buffer[TIME_BUFFER_SIZE];
+
+	timestamp_ns start = getMonotonicTime();
+	for(int i = 0; i < TIME_BENCHMARK_CALLS; i++)
+		getTimeUncached(buffer);
+	timestamp_ns uncached = getMonotonicTime() - start;
+
+	start = getMonotonicTime();
+	for(int i = 0; i < TIME_BENCHMARK_CALLS; i++)
+		getTime(buffer);
+	timestamp_ns cached = getMonotonicTime() - start;
+
+	printf("Formatting the time: %.1f ns a call with strftime every time, %.1f ns a call cached (%s)\n", (double)uncached / TIME_BENCHMARK_CALLS, (double)cached / TIME_BENCHMARK_CALLS, buffer);
+
+	pthread_t threads[TIME_BENCHMARK_THREADS];
+	timestamp_ns elapsed[TIME_BENCHMARK_THREADS];
+	int started = 0;
+
+	for(; started < TIME_BENCHMARK_THREADS; started++)	{
+		if(pthread_create(&threads[started], NULL, timeBenchmarkThread, &elapsed[started]) != 0)
+			break;
+	}
+
+	timestamp_ns slowest = 0;
+	for(int i = 0; i < started; i++)	{
+		pthread_join(threads[i], NULL);
+		if(elapsed[i] > slowest)
+			slowest = elapsed[i];
+	}
+
+	if(started)
+		printf("Formatting the time on %d threads at once: %.1f ns a call on the slowest thread\n", started, (double)slowest / TIME_BENCHMARK_CALLS);
+
+	if(results)
+		fprintf(results, "{\"benchmark\": \"time\", \"uncached_ns\": %.1f, \"cached_ns\": %.1f, \"threads\": %d, \"threaded_ns\": %.1f}\n", (double)uncached / TIME_BENCHMARK_CALLS, (double)cached / TIME_BENCHMARK_CALLS, started, started ? (double)slowest / TIME_BENCHMARK_CALLS : 0);
+}
+
+//This function counts one latency in a histogram
+void addLatency(struct latencyHistogram* histogram, timestamp_ns latency)	{
+	int bucket = latency ? 63 - __builtin_clzll(latency) : 0;
+	if(bucket >= LATENCY_BUCKETS)
+		bucket = LATENCY_BUCKETS - 1;
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum += latency;
+	if(latency > histogram->max)
+		histogram->max = latency;
+}
+
+//This function gives the latency that the given percent of the latencies counted were under. As the buckets are
+//powers of 2, it is the top of the bucket the percentile falls in, or the longest latency if that is shorter
+timestamp_ns latencyPercentile(const struct latencyHistogram* histogram, int percent)	{
+	if(!histogram->count)
+		return 0;
+
+	uint64_t rank = (histogram->count * percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for(int i = 0; i < LATENCY_BUCKETS; i++)	{
+		seen += histogram->buckets[i];
+		if(seen >= rank)
+			return (2ULL << i) < histogram->max ? (2ULL << i) : histogram->max;
+	}
+
+	return histogram->max;
+}
+
+//This function writes the percentiles of a latency histogram to the stats file on one line, in microseconds
+void printLatencies(FILE* statsFile, const char* label, const struct latencyHistogram* histogram)	{
+	fprintf(statsFile, "%s: %llu times, 50%% under %.1f us, 90%% under %.1f us, 99%% under %.1f us, longest %.1f us\n", label, (unsigned long long)histogram->count, latencyPercentile(histogram, 50) / 1000.0, latencyPercentile(histogram, 90) / 1000.0, latencyPercentile(histogram, 99) / 1000.0, histogram->max / 1000.0);
+}
+
+//This function gets the logger ready and starts its writer thread. Until it is started, and if the thread cannot be
+//started, messages are written straight to the log file. Returns 0 on success and -1 if the thread could not be started
+int startLogger(struct asyncLogger* logger, int fd, const struct loggerSettings* settings)	{
+	memset(logger, 0, sizeof(*logger));
+	logger->fd = fd;
+	logger->settings = *settings;
+
+	//The writer waits for the flush interval on the same clock as everything else
+	pthread_condattr_t condAttributes;
+	pthread_condattr_init(&condAttributes);
+	pthread_condattr_setclock(&condAttributes, CLOCK_MONOTONIC);
+
+	pthread_mutex_init(&logger->lock, NULL);
+	pthread_cond_init(&logger->recordsWaiting, &condAttributes);
+	pthread_cond_init(&logger->spaceFree, NULL);
+	pthread_condattr_destroy(&condAttributes);
+
+	if(pthread_create(&logger->thread, NULL, loggerMain, logger) != 0)
+		return -1;
+
+	logger->started = 1;
+	return 0;
+}
+
+//This function formats a message and queues it for the writer thread. When the logger is full the message is either
+//dropped or the caller waits for room, depending on the overflow policy
+void logMessage(struct asyncLogger* logger, const char* format, ...)	{
+	timestamp_ns start = getMonotonicTime();
+	char text[LOG_RECORD_SIZE];
+
+	va_list arguments;
+	va_start(arguments, format);
+	int length = vsnprintf(text, LOG_RECORD_SIZE, format, arguments);
+	va_end(arguments);
+
+	if(length < 0)
+		return;
+	if(length >= LOG_RECORD_SIZE)
+		length = LOG_RECORD_SIZE - 1;
+
+	//Without the writer thread, write the message straight away
+	if(!logger->started)	{
+		if(write(logger->fd, text, length) < 0)	{
+			#ifndef RUN_AS_SERVICE
+			perror("Could not write to the log file");
+			#endif
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&logger->lock);
+
+	while(logger->head - logger->tail >= LOG_RECORDS)	{
+		if(logger->settings.overflowPolicy != LOG_BLOCK_WHEN_FULL)	{
+			logger->dropped++;
+			pthread_mutex_unlock(&logger->lock);
+			return;
+		}
+
+		pthread_cond_wait(&logger->spaceFree, &logger->lock);
+	}
+
+	struct logRecord* record = &logger->records[logger->head % LOG_RECORDS];
+	memcpy(record->text, text, length);
+	record->length = length;
+
+	if(logger->head == logger->tail)
+		logger->oldestQueued = start;
+	logger->head++;
+
+	//The writer only has to be woken up when it has nothing to do or there is a full batch for it
+	uint64_t waiting = logger->head - logger->tail;
+	if(waiting == 1 || waiting == LOG_BATCH_RECORDS)
+		pthread_cond_signal(&logger->recordsWaiting);
+
+	addLatency(&logger->enqueueLatency, getMonotonicTime() - start);
+	pthread_mutex_unlock(&logger->lock);
+}
+
+//This function is the log writer thread. It waits until a batch of messages is waiting or the oldest one has waited
+//for the flush interval, then writes all of them with one writev() call, and keeps going until the logger is stopped
+//and everything has been written
+void* loggerMain(void* argument)	{
+	struct asyncLogger* logger = argument;
+	struct iovec pieces[LOG_RECORDS];
+
+	pthread_mutex_lock(&logger->lock);
+
+	while(1)	{
+		uint64_t waiting = logger->head - logger->tail;
+
+		if(!waiting && logger->stopping)
+			break;
+
+		if(!waiting)	{
+			pthread_cond_wait(&logger->recordsWaiting, &logger->lock);
+			continue;
+		}
+
+		if(waiting < LOG_BATCH_RECORDS && !logger->stopping)	{
+			timestamp_ns flushTime = logger->oldestQueued + (timestamp_ns)logger->settings.flushInterval * NS_PER_MS;
+
+			if(getMonotonicTime() < flushTime)	{
+				struct timespec deadline = { flushTime / NS_PER_SECOND, flushTime % NS_PER_SECOND };
+				pthread_cond_timedwait(&logger->recordsWaiting, &logger->lock, &deadline);
+				continue;
+			}
+		}
+
+		uint64_t first = logger->tail;
+		int fsyncPolicy = logger->settings.fsyncPolicy;
+		pthread_mutex_unlock(&logger->lock);
+
+		//Point at every waiting message, in order
+		timestamp_ns start = getMonotonicTime();
+		for(uint64_t i = 0; i < waiting; i++)	{
+			struct logRecord* record = &logger->records[(first + i) % LOG_RECORDS];
+			pieces[i].iov_base = record->text;
+			pieces[i].iov_len = record->length;
+		}
+
+		//writev() may write only part of the batch, so keep going from wherever it stopped
+		struct iovec* piece = pieces;
+		int piecesLeft = waiting;
+
+		while(piecesLeft > 0)	{
+			ssize_t written = writev(logger->fd, piece, piecesLeft);
+
+			if(written < 0)	{
+				if(errno == EINTR)
+					continue;
+
+				#ifndef RUN_AS_SERVICE
+				perror("Could not write to the log file");
+				#endif
+				break;
+			}
+
+			while(piecesLeft > 0 && (size_t)written >= piece->iov_len)	{
+				written -= piece->iov_len;
+				piece++;
+				piecesLeft--;
+			}
+
+			if(piecesLeft > 0)	{
+				piece->iov_base = (char*)piece->iov_base + written;
+				piece->iov_len -= written;
+			}
+		}
+
+		if(fsyncPolicy == LOG_FSYNC_EVERY_BATCH)
+			fdatasync(logger->fd);
+
+		timestamp_ns writeTime = getMonotonicTime() - start;
+
+		pthread_mutex_lock(&logger->lock);
+		logger->tail += waiting;
+		addLatency(&logger->writeLatency, writeTime);
+
+		//A new oldest message may have been queued while the batch was being written
+		if(logger->head != logger->tail)
+			logger->oldestQueued = start;
+
+		pthread_cond_broadcast(&logger->spaceFree);
+	}
+
+	pthread_mutex_unlock(&logger->lock);
+	return NULL;
+}
+
+//This function writes how long queueing and writing the log messages has taken since the program started
+void printLoggerStats(FILE* statsFile, struct asyncLogger* logger)	{
+	if(!logger->started)
+		return;
+
+	pthread_mutex_lock(&logger->lock);
+	struct latencyHistogram enqueueLatency = logger->enqueueLatency;
+	struct latencyHistogram writeLatency = logger->writeLatency;
+	uint64_t dropped = logger->dropped;
+	pthread_mutex_unlock(&logger->lock);
+
+	fprintf(statsFile, "The log has dropped %llu messages because it was full\n", (unsigned long long)dropped);
+	printLatencies(statsFile, "Queueing a log message", &enqueueLatency);
+	printLatencies(statsFile, "Writing a batch of log messages", &writeLatency);
+}
+
+//This function changes how the logger looks after the log file while it is running
+void setLoggerSettings(struct asyncLogger* logger, const struct loggerSettings* settings)	{
+	if(!logger->started)	{
+		logger->settings = *settings;
+		return;
+	}
+
+	//The writer is woken up, so that a shorter flush interval counts straight away
+	pthread_mutex_lock(&logger->lock);
+	logger->settings = *settings;
+	pthread_cond_signal(&logger->recordsWaiting);
+	pthread_cond_broadcast(&logger->spaceFree);
+	pthread_mutex_unlock(&logger->lock);
+}
+
+//This function writes every message still waiting and stops the writer thread. Messages logged afterwards are
+//written straight to the log file
+void stopLogger(struct asyncLogger* logger)	{
+	if(!logger->started)
+		return;
+
+	pthread_mutex_lock(&logger->lock);
+	logger->stopping = 1;
+	pthread_cond_signal(&logger->recordsWaiting);
+	pthread_mutex_unlock(&logger->lock);
+
+	pthread_join(logger->thread, NULL);
+	logger->started = 0;
+
+	if(logger->settings.fsyncPolicy == LOG_FSYNC_EVERY_BATCH)
+		fdatasync(logger->fd);
+}
+
+//This function fills a config with the defaults of every setting. The names of the log and stats files have none, and
+//there is one lane, on the pins the program has always used
+void defaultConfig(struct speedometerConfig* config)	{
+	memset(config, 0, sizeof(*config));
+	config->watchdogTimeout = DEFAULT_WATCHDOG_TIMEOUT;
+	config->statsFrequency = DEFAULT_STATS_FREQUENCY;
+	config->numLanes = 1;
+
+	for(int lane = 0; lane < MAX_LANES; lane++)	{
+		struct laneConfig* laneConfig = &config->lanes[lane];
+
+		//The pins of the other lanes must be given, so they are set to -1 until they are found. Their warning LEDs
+		//are optional
+		laneConfig->laserPins[0] = -1;
+		laneConfig->laserPins[1] = -1;
+		laneConfig->warningLedPin = -1;
+		laneConfig->speedLimit = DEFAULT_SPEED_LIMIT;
+		laneConfig->distance = DEFAULT_LASER_DISTANCE;
+
+		//The glitch filter lets every edge straight through until it is told otherwise
+		laneConfig->majoritySamples = 1;
+
+		//The speed limits of each direction are optional, so they are set to -1 until they are found
+		laneConfig->speedLimits[MOVING_RIGHT] = -1;
+		laneConfig->speedLimits[MOVING_LEFT] = -1;
+	}
+
+	config->lanes[0].laserPins[0] = LASER1_PIN_NUM;
+	config->lanes[0].laserPins[1] = LASER2_PIN_NUM;
+	config->lanes[0].warningLedPin = WARNING_LED_PIN;
+
+	config->logSettings.flushInterval = DEFAULT_LOG_FLUSH_INTERVAL;
+	config->logSettings.fsyncPolicy = LOG_FSYNC_NEVER;
+	config->logSettings.overflowPolicy = LOG_DROP_WHEN_FULL;
+	config->eventLogSize = DEFAULT_EVENT_LOG_SIZE;
+
+	//The level register is polled at the same rate whether anyone is in the hall or not, until it is told otherwise
+	config->idlePollPeriod = POLL_PERIOD_US;
+	config->activePollPeriod = POLL_PERIOD_US;
+}
+
+//This function reads a number with an optional unit after it, like "1.5", "5 km/h" or "300 cm", and converts it to the
+//first unit of its type. Returns 0 on success and -1 if it is not a number or the unit is not one of its type's
+int parseConfigNumber(const char* text, enum configValueType type, double* value)	{
+	const struct configUnit* units = configUnits[type];
+
+	char* end;
+	*value = strtod(text, &end);
+	if(end == text || !isfinite(*value))
+		return -1;
+
+	while(*end == ' ' || *end == '\t')
+		end++;
+
+	//Without a unit the number is in the first unit of its type
+	if(!*end)
+		return 0;
+
+	for(int i = 0; units && units[i].name; i++)	{
+		if(!strcasecmp(end, units[i].name))	{
+			*value *= units[i].factor;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+//This function reads one setting into settings, which is the config or, for the settings of a lane, its laneConfig.
+//Returns 0 on success and -1 with the reason in error if the value is not valid for it
+int setConfigValue(void* settings, const struct configKey* key, const char* value, char* error, size_t errorSize)	{
+	void* field = (char*)settings + key->offset;
+
+	if(key->type == CONFIG_NAME)	{
+		if(!*value || strlen(value) > key->max)	{
+			snprintf(error, errorSize, "%s must be a name of 1 to %.0f characters", key->name, key->max);
+			return -1;
+		}
+
+		strcpy(field, value);
+		return 0;
+	}
+
+	if(key->type == CONFIG_SWITCH)	{
+		if(!strcmp(value, "1") || !strcasecmp(value, "yes") || !strcasecmp(value, "on") || !strcasecmp(value, "true"))
+			*(int*)field = 1;
+		else if(!strcmp(value, "0") || !strcasecmp(value, "no") || !strcasecmp(value, "off") || !strcasecmp(value, "false"))
+			*(int*)field = 0;
+		else	{
+			snprintf(error, errorSize, "%s must be 0 or 1", key->name);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	//Pins and counts have to be whole numbers
+	double number;
+	int wholeOnly = (key->type == CONFIG_PIN || key->type == CONFIG_COUNT);
+	if(parseConfigNumber(value, key->type, &number) < 0 || (wholeOnly && number != floor(number)))	{
+		if(configUnitNames[key->type])
+			snprintf(error, errorSize, "%s must be a number, in %s", key->name, configUnitNames[key->type]);
+		else if(key->type == CONFIG_COUNT)
+			snprintf(error, errorSize, "%s must be a whole number", key->name);
+		else
+			snprintf(error, errorSize, "%s must be a pin number", key->name);
+		return -1;
+	}
+
+	if(number < key->min || number > key->max)	{
+		snprintf(error, errorSize, "%s must be between %g and %g%s%s", key->name, key->min, key->max, configUnits[key->type] ? " " : "", configUnits[key->type] ? configUnits[key->type][0].name : "");
+		return -1;
+	}
+
+	if(key->type == CONFIG_SPEED || key->type == CONFIG_DISTANCE || key->type == CONFIG_MICROSECONDS)
+		*(float*)field = number;
+	else
+		*(int*)field = lround(number);
+
+	return 0;
+}
+
+//This function reads the config file. Every line is a setting like "SPEED_LIMIT = 1.5 m/s", a comment starting with
+//'#' or empty. The settings of a lane other than the first have LANE<n>_ in front of them, and every lane that has any
+//setting is watched. The settings can come in any order and are all checked, so that a mistake is not quietly turned
+//into something else. Returns 0 on success and -1, with the line and what is wrong with it in error, if the file is
+//not valid
+int readConfig(FILE* configFile, struct speedometerConfig* config, char* error, size_t errorSize)	{
+	char line[CONFIG_LINE_SIZE];
+	int lineNumber = 0;
+	char reason[CONFIG_LINE_SIZE];
+
+	defaultConfig(config);
+
+	while(fgets(line, sizeof(line), configFile) != NULL)	{
+		lineNumber++;
+
+		size_t length = strlen(line);
+		if(length == sizeof(line) - 1 && line[length - 1] != '\n' && !feof(configFile))	{
+			snprintf(error, errorSize, "line %d: the line is longer than %d characters", lineNumber, CONFIG_LINE_SIZE - 2);
+			return -1;
+		}
+
+		//Take the spaces off both ends, then skip empty lines and comments
+		while(length && isspace((unsigned char)line[length - 1]))
+			line[--length] = 0;
+
+		char* text = line;
+		while(isspace((unsigned char)*text))
+			text++;
+
+		if(!*text || *text == '#')
+			continue;
+
+		char* equals = strchr(text, '=');
+		if(!equals)	{
+			snprintf(error, errorSize, "line %d: expected a setting like NAME = value", lineNumber);
+			return -1;
+		}
+
+		//The name is everything before the '=' and the value everything after it, without the spaces around them
+		char* nameEnd = equals;
+		while(nameEnd > text && isspace((unsigned char)nameEnd[-1]))
+			nameEnd--;
+		*nameEnd = 0;
+
+		char* value = equals + 1;
+		while(isspace((unsigned char)*value))
+			value++;
+
+		//A LANE<n>_ in front of the name says which lane the setting is for
+		char* name = text;
+		int lane = 0;
+		if(!strncmp(name, "LANE", 4) && isdigit((unsigned char)name[4]))	{
+			char* end;
+			long number = strtol(name + 4, &end, 10);
+
+			if(*end != '_' || number < 1 || number > MAX_LANES)	{
+				snprintf(error, errorSize, "line %d: %s is not a lane, they go from LANE1_ to LANE%d_", lineNumber, text, MAX_LANES);
+				return -1;
+			}
+
+			lane = number - 1;
+			name = end + 1;
+		}
+
+		const struct configKey* key = NULL;
+		void* settings = &config->lanes[lane];
+		for(size_t i = 0; i < sizeof(laneConfigKeys) / sizeof(laneConfigKeys[0]); i++)	{
+			if(!strcmp(name, laneConfigKeys[i].name))
+				key = &laneConfigKeys[i];
+		}
+
+		if(key)	{
+			if(lane >= config->numLanes)
+				config->numLanes = lane + 1;
+		}
+		else	{
+			settings = config;
+			for(size_t i = 0; i < sizeof(configKeys) / sizeof(configKeys[0]); i++)	{
+				if(!strcmp(name, configKeys[i].name))
+					key = &configKeys[i];
+			}
+
+			if(key && name != text)	{
+				snprintf(error, errorSize, "line %d: %s is the same for every lane, so it cannot have LANE in front of it", lineNumber, name);
+				return -1;
+			}
+		}
+
+		if(!key)	{
+			snprintf(error, errorSize, "line %d: there is no setting called %s", lineNumber, text);
+			return -1;
+		}
+
+		if(setConfigValue(settings, key, value, reason, sizeof(reason)) < 0)	{
+			snprintf(error, errorSize, "line %d: %s", lineNumber, reason);
+			return -1;
+		}
+	}
+
+	if(!config->logFileName[0] || !config->statsFileName[0])	{
+		snprintf(error, errorSize, "LOGFILE and STATSFILE must be set");
+		return -1;
+	}
+
+	//Every lane needs its lasers, and no pin can be used for two things
+	uint32_t usedPins = 1u << RUNNING_LED_PIN;
+	for(int lane = 0; lane < config->numLanes; lane++)	{
+		struct laneConfig* laneConfig = &config->lanes[lane];
+
+		if(laneConfig->laserPins[0] < 0 || laneConfig->laserPins[1] < 0)	{
+			snprintf(error, errorSize, "LANE%d_LASER1_PIN and LANE%d_LASER2_PIN must be set", lane + 1, lane + 1);
+			return -1;
+		}
+
+		const int pins[3] = { laneConfig->laserPins[0], laneConfig->laserPins[1], laneConfig->warningLedPin };
+		for(int i = 0; i < 3; i++)	{
+			if(pins[i] < 0)
+				continue;
+
+			if(usedPins & (1u << pins[i]))	{
+				snprintf(error, errorSize, "pin %d of lane %d is already used", pins[i], lane + 1);
+				return -1;
+			}
+			usedPins |= 1u << pins[i];
+		}
+
+		//A direction without a speed limit of its own uses the one for the whole lane
+		for(int direction = 0; direction < 2; direction++)	{
+			if(laneConfig->speedLimits[direction] < 0)
+				laneConfig->speedLimits[direction] = laneConfig->speedLimit;
+		}
+	}
+
+	return 0;
+}
+
+//This function gives the bits of the level register of a lane's lasers
+uint32_t laneLaserMask(const struct laneConfig* laneConfig)	{
+	return (1u << laneConfig->laserPins[0]) | (1u << laneConfig->laserPins[1]);
+}
+
+//This function gives the bits of the level register of the lasers of every lane
+uint32_t configLaserMask(const struct speedometerConfig* config)	{
+	uint32_t mask = 0;
+	for(int lane = 0; lane < config->numLanes; lane++)
+		mask |= laneLaserMask(&config->lanes[lane]);
+
+	return mask;
+}
+
+//This function reads the config file with the given name. Returns 0 on success and -1, with the reason in error, if it
+//could not be opened or is not valid
+int loadConfig(const char* fileName, struct speedometerConfig* config, char* error, size_t errorSize)	{
+	FILE* configFile = fopen(fileName, "r");
+	if(!configFile)	{
+		snprintf(error, errorSize, "%s could not be opened: %s", fileName, strerror(errno));
+		return -1;
+	}
+
+	int result = readConfig(configFile, config, error, errorSize);
+	fclose(configFile);
+
+	return result;
+}
+
+//This function starts watching the config file, through inotify and SIGHUP, which must already be blocked, for the
+//state machines of numLanes lanes. Returns 0 on success and -1 if it cannot be watched
+int startConfigWatcher(struct configWatcher* watcher, const char* fileName, int numLanes, struct asyncLogger* logFile)	{
+	memset(watcher, 0, sizeof(*watcher));
+	snprintf(watcher->fileName, sizeof(watcher->fileName), "%s", fileName);
+	watcher->logFile = logFile;
+	watcher->numLanes = numLanes;
+	watcher->stopFd = -1;
+	watcher->signalFd = -1;
+
+	for(int lane = 0; lane < MAX_LANES; lane++)
+		atomic_init(&watcher->pending[lane], NULL);
+
+	//The directory the config file is in is watched, rather than the file, as editors often replace the file
+	char directory[CONFIG_NAME_SIZE];
+	const char* slash = strrchr(watcher->fileName, '/');
+	if(slash)
+		snprintf(directory, sizeof(directory), "%.*s", (int)(slash - watcher->fileName + 1), watcher->fileName);
+	else
+		strcpy(directory, ".");
+
+	watcher->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(watcher->inotifyFd < 0)
+		return -1;
+
+	if(inotify_add_watch(watcher->inotifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)	{
+		stopConfigWatcher(watcher);
+		return -1;
+	}
+
+	sigset_t hangup;
+	sigemptyset(&hangup);
+	sigaddset(&hangup, SIGHUP);
+
+	watcher->signalFd = signalfd(-1, &hangup, SFD_NONBLOCK | SFD_CLOEXEC);
+	watcher->stopFd = eventfd(0, EFD_NONBLOCK);
+	if(watcher->signalFd < 0 || watcher->stopFd < 0)	{
+		stopConfigWatcher(watcher);
+		return -1;
+	}
+
+	atomic_store(&watcher->running, 1);
+
+	if(pthread_create(&watcher->thread, NULL, configWatcherMain, watcher) != 0)	{
+		atomic_store(&watcher->running, 0);
+		stopConfigWatcher(watcher);
+		return -1;
+	}
+
+	watcher->started = 1;
+	return 0;
+}
+
+//This function reads the waiting inotify events. Returns 1 if any of them were about the config file and 0 if not
+int isConfigFileEvent(struct configWatcher* watcher)	{
+	_Alignas(struct inotify_event) char events[4096];
+	const char* slash = strrchr(watcher->fileName, '/');
+	const char* name = slash ? slash + 1 : watcher->fileName;
+	int changed = 0;
+	ssize_t length;
+
+	while((length = read(watcher->inotifyFd, events, sizeof(events))) > 0)	{
+		for(char* next = events; next < events + length; )	{
+			struct inotify_event* event = (struct inotify_event*)next;
+			if(event->len && !strcmp(event->name, name))
+				changed = 1;
+			next += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	return changed;
+}
+
+//This function reads the config file again and, if there is nothing wrong with it, leaves a copy of it for the state
+//machine of every lane to swap in. A config a state machine has not taken yet is replaced
+void reloadConfig(struct configWatcher* watcher)	{
+	char time[TIME_BUFFER_SIZE];
+	char error[CONFIG_LINE_SIZE + 64];
+	char message[sizeof(error) + 64];
+
+	struct speedometerConfig* config = malloc(sizeof(*config));
+	if(!config)
+		return;
+
+	if(loadConfig(watcher->fileName, config, error, sizeof(error)) < 0)	{
+		snprintf(message, sizeof(message), "The config file was not reloaded, %s\n\n", error);
+		getTime(time);
+		PRINT_MSG(watcher->logFile, time, "configWatcher", SEVERITY_ERROR, message);
+		free(config);
+		return;
+	}
+
+	for(int lane = 1; lane < watcher->numLanes; lane++)	{
+		struct speedometerConfig* copy = malloc(sizeof(*copy));
+		if(copy)	{
+			*copy = *config;
+			free(atomic_exchange(&watcher->pending[lane], copy));
+		}
+	}
+
+	free(atomic_exchange(&watcher->pending[0], config));
+}
+
+//This is the config watcher thread. It sleeps until the config file changes or the program is sent SIGHUP, and
+//then reads the config file again
+void* configWatcherMain(void* argument)	{
+	struct configWatcher* watcher = argument;
+
+	while(atomic_load(&watcher->running))	{
+		struct pollfd waiting[3] = { { watcher->stopFd, POLLIN, 0 }, { watcher->inotifyFd, POLLIN, 0 }, { watcher->signalFd, POLLIN, 0 } };
+		if(poll(waiting, 3, -1) <= 0)
+			continue;
+
+		int reload = 0;
+
+		if(waiting[2].revents & POLLIN)	{
+			struct signalfd_siginfo signal;
+			while(read(watcher->signalFd, &signal, sizeof(signal)) == sizeof(signal))
+				reload = 1;
+		}
+
+		//Wait for the file to be left alone before reading it, as it may be written in more than one go. Other files in
+		//the same directory, like the logs, keep changing, so only changes to the config file itself make it wait longer
+		if((waiting[1].revents & POLLIN) && isConfigFileEvent(watcher))	{
+			timestamp_ns settled = getMonotonicTime() + CONFIG_SETTLE_TIME * NS_PER_MS;
+			timestamp_ns now;
+
+			while((now = getMonotonicTime()) < settled)	{
+				struct pollfd settling = { watcher->inotifyFd, POLLIN, 0 };
+				if(poll(&settling, 1, (settled - now) / NS_PER_MS + 1) > 0 && isConfigFileEvent(watcher))
+					settled = getMonotonicTime() + CONFIG_SETTLE_TIME * NS_PER_MS;
+			}
+			reload = 1;
+		}
+
+		if(reload && atomic_load(&watcher->running))
+			reloadConfig(watcher);
+	}
+
+	return NULL;
+}
+
+//This function stops the config watcher and throws away a config the state machine never took
+void stopConfigWatcher(struct configWatcher* watcher)	{
+	if(watcher->started)	{
+		uint64_t one = 1;
+		atomic_store(&watcher->running, 0);
+		write(watcher->stopFd, &one, sizeof(one));
+		pthread_join(watcher->thread, NULL);
+		watcher->started = 0;
+	}
+
+	if(watcher->inotifyFd >= 0)
+		close(watcher->inotifyFd);
+	if(watcher->signalFd >= 0)
+		close(watcher->signalFd);
+	if(watcher->stopFd >= 0)
+		close(watcher->stopFd);
+	watcher->inotifyFd = watcher->signalFd = watcher->stopFd = -1;
+
+	for(int lane = 0; lane < MAX_LANES; lane++)
+		free(atomic_exchange(&watcher->pending[lane], NULL));
+}
+
+//This function swaps a reloaded config in for the running one of a lane. The speed limits, the distance between the
+//lasers, their latencies, the calibration speed, how often the stats are written and the logger settings change straight away. The files, the socket, the watchdog
+//timeout, the poll settings, the lanes and their pins are only set up once, so changes to them are logged and wait for the program to be restarted
+void applyConfig(struct speedometerConfig* config, const struct speedometerConfig* newConfig, int lane, struct transitTracker* tracker, struct glitchFilter* filter, struct asyncLogger* logFile, const char* programName)	{
+	char time[TIME_BUFFER_SIZE];
+	char message[256];
+	struct speedometerConfig applied = *newConfig;
+
+	if((strcmp(applied.logFileName, config->logFileName) || strcmp(applied.statsFileName, config->statsFileName) || strcmp(applied.eventLogName, config->eventLogName) || applied.eventLogSize != config->eventLogSize || strcmp(applied.metricsFileName, config->metricsFileName) || strcmp(applied.metricsSocketName, config->metricsSocketName) || applied.watchdogTimeout != config->watchdogTimeout) && lane == 0)	{
+		getTime(time);
+		PRINT_MSG(logFile, time, programName, SEVERITY_WARNING, "LOGFILE, STATSFILE, EVENTLOG, EVENTLOG_SIZE, METRICS_FILE, METRICS_SOCKET and WATCHDOG_TIMEOUT only change when the program is restarted\n\n");
+	}
+
+	//The sampler is shared by the lanes and set up once, so how often it polls stays as it is
+	if((applied.idlePollPeriod != config->idlePollPeriod || applied.activePollPeriod != config->activePollPeriod || applied.pollSpin != config->pollSpin) && lane == 0)	{
+		getTime(time);
+		PRINT_MSG(logFile, time, programName, SEVERITY_WARNING, "IDLE_POLL_PERIOD, ACTIVE_POLL_PERIOD and POLL_SPIN only change when the program is restarted\n\n");
+	}
+
+	//The lanes and their pins are set up once, so they stay as they are
+	int pinsChanged = applied.numLanes != config->numLanes;
+	for(int i = 0; i < MAX_LANES; i++)	{
+		pinsChanged |= applied.lanes[i].laserPins[0] != config->lanes[i].laserPins[0] || applied.lanes[i].laserPins[1] != config->lanes[i].laserPins[1] || applied.lanes[i].warningLedPin != config->lanes[i].warningLedPin;
+
+		applied.lanes[i].laserPins[0] = config->lanes[i].laserPins[0];
+		applied.lanes[i].laserPins[1] = config->lanes[i].laserPins[1];
+		applied.lanes[i].warningLedPin = config->lanes[i].warningLedPin;
+	}
+	applied.numLanes = config->numLanes;
+
+	if(pinsChanged && lane == 0)	{
+		getTime(time);
+		PRINT_MSG(logFile, time, programName, SEVERITY_WARNING, "The lanes, LASER1_PIN, LASER2_PIN and WARNING_LED only change when the program is restarted\n\n");
+	}
+
+	strcpy(applied.logFileName, config->logFileName);
+	strcpy(applied.statsFileName, config->statsFileName);
+	strcpy(applied.eventLogName, config->eventLogName);
+	strcpy(applied.metricsFileName, config->metricsFileName);
+	strcpy(applied.metricsSocketName, config->metricsSocketName);
+	applied.eventLogSize = config->eventLogSize;
+	applied.watchdogTimeout = config->watchdogTimeout;
+	applied.idlePollPeriod = config->idlePollPeriod;
+	applied.activePollPeriod = config->activePollPeriod;
+	applied.pollSpin = config->pollSpin;
+
+	const struct laneConfig* laneConfig = &applied.lanes[lane];
+	calibrateTracker(tracker, laneConfig->distance, laneConfig->laserLatency);
+	setGlitchFilter(filter, laneConfig->majoritySamples, laneConfig->minPulse);
+	setLoggerSettings(logFile, &applied.logSettings);
+	*config = applied;
+
+	snprintf(message, sizeof(message), "The config file has been reloaded. Speed limits %.2f m/s walking right and %.2f m/s walking left, %.4f m between the lasers, latencies of %.1f us and %.1f us, stats every %d s\n\n", laneConfig->speedLimits[MOVING_RIGHT], laneConfig->speedLimits[MOVING_LEFT], laneConfig->distance, laneConfig->laserLatency[0], laneConfig->laserLatency[1], config->statsFrequency);
+	getTime(time);
+	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, message);
+
+	snprintf(message, sizeof(message), "Flickers of the lasers shorter than %.0f us broken or %.0f us restored are filtered out, a laser's level being the one most of its last %d reads had\n\n", laneConfig->minPulse[0], laneConfig->minPulse[1], laneConfig->majoritySamples);
+	PRINT_MSG(logFile, time, programName, SEVERITY_INFO, message);
+}
+
+//This function gets the transit tracker ready. laserMasks are the bits of the level register of laser 1 and laser 2,
+//and levels are the levels of the lasers when tracking starts
+void initTracker(struct transitTracker* tracker, float distance, const uint32_t laserMasks[2], uint32_t levels)	{
+	memset(tracker, 0, sizeof(*tracker));
+	tracker->distance = distance;
+	tracker->levels = levels;
+	tracker->laserMasks[0] = laserMasks[0];
+	tracker->laserMasks[1] = laserMasks[1];
+}
+
+//This function sets the distance between the lasers, in metres, and how long each laser's photodiode takes to
+//answer, in microseconds
+void calibrateTracker(struct transitTracker* tracker, float distance, const float latencies[2])	{
+	tracker->distance = distance;
+	for(int laser = 0; laser < 2; laser++)
+		tracker->latency[laser] = llround(latencies[laser] * 1000.0);
+}
+
+//This function adds a report to the list handed back by trackEvent, as long as there is room for it, and counts it as
+//dropped otherwise
+void addReport(struct transitTracker* tracker, struct trackerReport reports[], int* numReports, int maxReports, enum trackerOutcome outcome, enum travelDirection direction, int laser, timestamp_ns timestamp, float speed, int64_t travelTime)	{
+	if(*numReports >= maxReports)	{
+		tracker->droppedReports++;
+		return;
+	}
+
+	reports[*numReports].outcome = outcome;
+	reports[*numReports].direction = direction;
+	reports[*numReports].laser = laser;
+	reports[*numReports].timestamp = timestamp;
+	reports[*numReports].speed = speed;
+	reports[*numReports].travelTime = travelTime;
+	(*numReports)++;
+}
+
+//This function gives the transit at the given position of a queue, 0 being the person who entered first
+struct transit* queuedTransit(struct transitQueue* queue, int position)	{
+	return &queue->transits[(queue->first + position) % MAX_TRANSITS_PER_DIRECTION];
+}
+
+//This function takes the person at the given position out of a queue, moving everyone behind them up
+void removeTransit(struct transitQueue* queue, int position)	{
+	for(int i = position; i > 0; i--)
+		*queuedTransit(queue, i) = *queuedTransit(queue, i - 1);
+
+	queue->first = (queue->first + 1) % MAX_TRANSITS_PER_DIRECTION;
+	queue->count--;
+}
+
+//This function puts a person who broke a laser at enteringTime into the queue of the given direction, behind everyone
+//who entered before them. inHallTime is when they stopped breaking it, or 0 if they still are. If the queue is full, the
+//person who has been in the hall the longest has most likely been lost already
+void insertTransit(struct transitTracker* tracker, enum travelDirection direction, int laser, timestamp_ns enteringTime, timestamp_ns inHallTime, struct trackerReport reports[], int* numReports, int maxReports)	{
+	struct transitQueue* queue = &tracker->queues[direction];
+	if(queue->count == MAX_TRANSITS_PER_DIRECTION)	{
+		addReport(tracker, reports, numReports, maxReports, TRANSIT_LOST, direction, laser, enteringTime, 0, 0);
+		removeTransit(queue, 0);
+		tracker->lost++;
+	}
+
+	int position = queue->count++;
+	for(; position > 0 && queuedTransit(queue, position - 1)->enteringTime > enteringTime; position--)
+		*queuedTransit(queue, position) = *queuedTransit(queue, position - 1);
+
+	struct transit* transit = queuedTransit(queue, position);
+	memset(transit, 0, sizeof(*transit));
+	transit->stage = inHallTime ? TRANSIT_IN_HALL : TRANSIT_ENTERING;
+	transit->enteringTime = enteringTime;
+	transit->inHallTime = inHallTime;
+}
+
+//This function gives how much sooner (when negative) or later than expected a person who is in the hall would be
+//getting to the far laser at timestamp, as the log of the time they would have taken over the time they were expected
+//to take. The time they took to walk into the hall gives their speed, and so the time they should take to walk through it
+double exitError(struct transitTracker* tracker, const struct transit* transit, timestamp_ns timestamp)	{
+	double expected = (double)(transit->inHallTime - transit->enteringTime) * tracker->distance / PERSON_DEPTH;
+	return log(fmax((double)(timestamp - transit->enteringTime), 1) / fmax(expected, 1));
+}
+
+//This function gives how well a laser broken at exitingTime and restored at leftTime fits a person who is in the hall
+//leaving: the sum of how far they would be from the time they were expected and how far the time they broke it would
+//be from the time they broke the laser they came in through, both as logs. Returns -1 if either is off by more than
+//EXIT_TIME_TOLERANCE or EXIT_BLOCK_TOLERANCE
+double exitFit(struct transitTracker* tracker, const struct transit* transit, timestamp_ns exitingTime, timestamp_ns leftTime)	{
+	double timeError = fabs(exitError(tracker, transit, exitingTime));
+	double blockError = fabs(log(fmax((double)(leftTime - exitingTime), 1) / fmax((double)(transit->inHallTime - transit->enteringTime), 1)));
+
+	if(timeError > log(EXIT_TIME_TOLERANCE) || blockError > log(EXIT_BLOCK_TOLERANCE))
+		return -1;
+	return timeError + blockError;
+}
+
+//This function gives the time after which nobody else breaking the far laser could be taken for the given person
+//leaving, so that they can be reported
+timestamp_ns exitDeadline(struct transitTracker* tracker, const struct transit* transit)	{
+	double expected = (double)(transit->inHallTime - transit->enteringTime) * tracker->distance / PERSON_DEPTH;
+	return transit->enteringTime + (timestamp_ns)(EXIT_TIME_TOLERANCE * expected);
+}
+
+//This function finds who in a queue could be leaving through a laser broken at timestamp. People leave in the order
+//they came in, so it is the first of them who is in the hall and not long overdue, as long as they are expected about
+//then, and anyone in front of them who was expected long before is most likely lost. Returns their position, or -1 if
+//nobody could be leaving
+int exitCandidate(struct transitTracker* tracker, struct transitQueue* queue, timestamp_ns timestamp)	{
+	for(int i = 0; i < queue->count; i++)	{
+		struct transit* transit = queuedTransit(queue, i);
+		if(transit->stage == TRANSIT_OUT)
+			continue;
+
+		if(transit->stage != TRANSIT_IN_HALL)
+			return -1;
+
+		double error = exitError(tracker, transit, timestamp);
+		if(fabs(error) <= log(EXIT_TIME_TOLERANCE))
+			return i;
+		if(error < 0)
+			return -1;
+	}
+
+	return -1;
+}
+
+//This function reports the person at the given position of a queue, who has left the hall, and takes them out of it
+void completeTransit(struct transitTracker* tracker, enum travelDirection direction, int position, struct trackerReport reports[], int* numReports, int maxReports)	{
+	struct transitQueue* queue = &tracker->queues[direction];
+	struct transit* transit = queuedTransit(queue, position);
+	float speed = computeSpeed(tracker->distance, transit->enteringTime, transit->exitingTime);
+
+	addReport(tracker, reports, numReports, maxReports, TRANSIT_COMPLETED, direction, direction == MOVING_RIGHT, transit->leftTime, speed, (int64_t)(transit->exitingTime - transit->enteringTime));
+	removeTransit(queue, position);
+	tracker->completed++;
+}
+
+//This function is called when a laser is broken. Until it is restored it is taken for the first person who could be
+//leaving through it, unless it is closer to when one of the people who have just left was expected, or else for a new
+//person entering the hall, so that the hall is in the right state in the meantime
+void laserBroken(struct transitTracker* tracker, int laser, timestamp_ns timestamp, struct trackerReport reports[], int* numReports, int maxReports)	{
+	tracker->brokenSince[laser] = timestamp;
+	tracker->blockWarningTime[laser] = timestamp;
+
+	//People walking right enter at laser 1 and leave at laser 2, people walking left do the opposite
+	enum travelDirection exitingDirection = laser ? MOVING_RIGHT : MOVING_LEFT;
+	enum travelDirection enteringDirection = laser ? MOVING_LEFT : MOVING_RIGHT;
+
+	struct transitQueue* queue = &tracker->queues[exitingDirection];
+	int leaving = exitCandidate(tracker, queue, timestamp);
+
+	if(leaving >= 0)	{
+		struct transit* transit = queuedTransit(queue, leaving);
+		double error = fabs(exitError(tracker, transit, timestamp));
+
+		//The people who have left are the first in the queue
+		int closer = 0;
+		for(int i = 0; i < leaving && queuedTransit(queue, i)->stage == TRANSIT_OUT; i++)
+			closer |= fabs(exitError(tracker, queuedTransit(queue, i), timestamp)) < error;
+
+		if(!closer)	{
+			transit->stage = TRANSIT_EXITING;
+			transit->exitingTime = timestamp;
+			return;
+		}
+	}
+
+	insertTransit(tracker, enteringDirection, laser, timestamp, 0, reports, numReports, maxReports);
+}
+
+//This function is called when a laser is no longer broken, which is when it is known how long it was broken for. That
+//and when it was broken are matched against the people who have just left through it, to see whether it fits one of
+//them better and whoever they were taken for was someone walking into the hall the other way, and against the first person who
+//could be leaving. Whichever fits best has left the hall, and if nobody fits it is a new person now fully in the hall.
+//People who have left are reported by the timers, once nobody else could be taken for them
+void laserRestored(struct transitTracker* tracker, int laser, timestamp_ns timestamp, struct trackerReport reports[], int* numReports, int maxReports)	{
+	timestamp_ns brokenSince = tracker->brokenSince[laser];
+	tracker->brokenSince[laser] = 0;
+
+	//A laser that was never seen being broken, such as one already broken when the program started, tells nothing
+	if(!brokenSince)
+		return;
+
+	enum travelDirection exitingDirection = laser ? MOVING_RIGHT : MOVING_LEFT;
+	enum travelDirection enteringDirection = laser ? MOVING_LEFT : MOVING_RIGHT;
+	struct transitQueue* queue = &tracker->queues[exitingDirection];
+	struct transitQueue* entering = &tracker->queues[enteringDirection];
+
+	//Whoever the laser was taken for when it was broken is put back the way they were
+	for(int i = 0; i < queue->count; i++)	{
+		if(queuedTransit(queue, i)->stage == TRANSIT_EXITING)	{
+			queuedTransit(queue, i)->stage = TRANSIT_IN_HALL;
+			queuedTransit(queue, i)->exitingTime = 0;
+		}
+	}
+	for(int i = 0; i < entering->count; i++)	{
+		if(queuedTransit(entering, i)->stage == TRANSIT_ENTERING)
+			removeTransit(entering, i--);
+	}
+
+	//The person who has just left it fits best, if it fits them better than the time they were taken to leave at. The
+	//people who have left are the first in the queue
+	struct transit* left = NULL;
+	double leftFit = -1;
+
+	for(int i = 0; i < queue->count && queuedTransit(queue, i)->stage == TRANSIT_OUT; i++)	{
+		struct transit* transit = queuedTransit(queue, i);
+		double fit = exitFit(tracker, transit, brokenSince, timestamp);
+
+		if(fit >= 0 && fit < exitFit(tracker, transit, transit->exitingTime, transit->leftTime) && (leftFit < 0 || fit < leftFit))	{
+			left = transit;
+			leftFit = fit;
+		}
+	}
+
+	//The first person who could be leaving
+	int leaving = exitCandidate(tracker, queue, brokenSince);
+	double leavingFit = (leaving >= 0) ? exitFit(tracker, queuedTransit(queue, leaving), brokenSince, timestamp) : -1;
+
+	if(leftFit >= 0 && (leavingFit < 0 || leftFit <= leavingFit))	{
+		timestamp_ns enteringTime = left->exitingTime;
+		timestamp_ns inHallTime = left->leftTime;
+
+		left->exitingTime = brokenSince;
+		left->leftTime = timestamp;
+		insertTransit(tracker, enteringDirection, laser, enteringTime, inHallTime, reports, numReports, maxReports);
+	}
+	else if(leavingFit >= 0)	{
+		//Everyone in front of them has left already, or was lost
+		for(int i = 0; i < leaving; i++)	{
+			if(queuedTransit(queue, i)->stage != TRANSIT_OUT)	{
+				addReport(tracker, reports, numReports, maxReports, TRANSIT_LOST, exitingDirection, laser, timestamp, 0, 0);
+				removeTransit(queue, i--);
+				leaving--;
+				tracker->lost++;
+			}
+		}
+
+		struct transit* transit = queuedTransit(queue, leaving);
+		transit->stage = TRANSIT_OUT;
+		transit->exitingTime = brokenSince;
+		transit->leftTime = timestamp;
+	}
+	else
+		insertTransit(tracker, enteringDirection, laser, brokenSince, timestamp, reports, numReports, maxReports);
+}
+
+//This function checks the tracker's timers: people who have left and can now be reported, lasers that have been
+//blocked for too long, people who have been in the hall for too long and people who have not been seen leaving and are
+//given up on. Whatever does not fit in the reports is left for the next event
+void checkTrackerTimers(struct transitTracker* tracker, timestamp_ns now, struct trackerReport reports[], int* numReports, int maxReports)	{
+	for(int laser = 0; laser < 2; laser++)	{
+		if(tracker->brokenSince[laser] && (now - tracker->blockWarningTime[laser]) > LASER_BLOCK_TIME * NS_PER_SECOND && *numReports < maxReports)	{
+			addReport(tracker, reports, numReports, maxReports, LASER_BLOCKED, MOVING_RIGHT, laser, now, 0, 0);
+			tracker->blockWarningTime[laser] = now;
+		}
+	}
+
+	for(int direction = 0; direction < 2; direction++)	{
+		struct transitQueue* queue = &tracker->queues[direction];
+
+		//The people who left are the first in the queue
+		while(queue->count && queuedTransit(queue, 0)->stage == TRANSIT_OUT && now >= exitDeadline(tracker, queuedTransit(queue, 0)) && *numReports < maxReports)
+			completeTransit(tracker, direction, 0, reports, numReports, maxReports);
+
+		//The people who entered first are the ones who will time out first
+		while(queue->count && queuedTransit(queue, 0)->stage < TRANSIT_EXITING && (now - queuedTransit(queue, 0)->enteringTime) > TRANSIT_TIMEOUT * NS_PER_SECOND && *numReports < maxReports)	{
+			addReport(tracker, reports, numReports, maxReports, TRANSIT_LOST, direction, -1, now, 0, 0);
+			removeTransit(queue, 0);
+			tracker->lost++;
+		}
+
+		for(int i = 0; i < queue->count; i++)	{
+			struct transit* transit = queuedTransit(queue, i);
+
+			if(transit->stage == TRANSIT_IN_HALL && !transit->warningIssued && (now - transit->enteringTime) > MAX_TIME_IN_HALL * NS_PER_SECOND && *numReports < maxReports)	{
+				addReport(tracker, reports, numReports, maxReports, HALL_BLOCKED, direction, -1, now, 0, 0);
+				transit->warningIssued = 1;
+			}
+		}
+	}
+}
+
+//This function gives the time the tracker will next be able to report someone who has left the hall, so that it can be
+//woken up for it, or 0 if nobody is waiting to be. They are reported in the order they came in
+timestamp_ns trackerDeadline(struct transitTracker* tracker)	{
+	timestamp_ns deadline = 0;
+
+	for(int direction = 0; direction < 2; direction++)	{
+		struct transitQueue* queue = &tracker->queues[direction];
+
+		if(queue->count && queuedTransit(queue, 0)->stage == TRANSIT_OUT)	{
+			timestamp_ns due = exitDeadline(tracker, queuedTransit(queue, 0));
+			if(!deadline || due < deadline)
+				deadline = due;
+		}
+	}
+
+	return deadline;
+}
+
+//This function hands the tracker the next event from the sampler. Every laser that changed is matched to
+//the people in the hall and then the timers are checked. What happened is written to reports, which must
+//have room for maxReports reports. Returns the number of reports written
+int trackEvent(struct transitTracker* tracker, const struct laserEvent* event, struct trackerReport reports[], int maxReports)	{
+	int numReports = 0;
+
+	for(int laser = 0; laser < 2; laser++)	{
+		uint32_t mask = tracker->laserMasks[laser];
+
+		//The edge is moved back to when the beam was really broken or restored, by the time the photodiode took to answer
+		if((event->levels ^ tracker->levels) & mask)	{
+			timestamp_ns timestamp = event->timestamp - tracker->latency[laser];
+
+			if(event->levels & mask)
+				laserRestored(tracker, laser, timestamp, reports, &numReports, maxReports);
+			else
+				laserBroken(tracker, laser, timestamp, reports, &numReports, maxReports);
+		}
+	}
+
+	tracker->levels = event->levels;
+	checkTrackerTimers(tracker, event->timestamp, reports, &numReports, maxReports);
+
+	return numReports;
+}
+
+//This function counts the people who are fully inside the hall, between the two lasers
+int trackerOccupancy(struct transitTracker* tracker)	{
+	int occupancy = 0;
+
+	for(int direction = 0; direction < 2; direction++)	{
+		for(int i = 0; i < tracker->queues[direction].count; i++)
+			occupancy += queuedTransit(&tracker->queues[direction], i)->stage == TRANSIT_IN_HALL;
+	}
+
+	return occupancy;
+}
+
+//This function gives the state the hall is in, which is the stage of whoever has made it the furthest through the hall.
+//The people who have left but not been reported yet are out of it
+enum hallState trackerHallState(struct transitTracker* tracker)	{
+	enum hallState state = HALL_EMPTY;
+
+	for(int direction = 0; direction < 2; direction++)	{
+		for(int i = 0; i < tracker->queues[direction].count; i++)	{
+			enum transitStage stage = queuedTransit(&tracker->queues[direction], i)->stage;
+			if(stage != TRANSIT_OUT && HALL_ENTERING + stage > state)
+				state = HALL_ENTERING + stage;
+		}
+	}
+
+	return state;
+}
+
+//This function gets the glitch filter of a lane ready. laserMasks are the bits of the level register of laser 1 and
+//laser 2, levels their levels when filtering starts and samplePeriod the time, in nanoseconds, between two reads of
+//them. It lets every edge straight through until setGlitchFilter is called
+void initGlitchFilter(struct glitchFilter* filter, const uint32_t laserMasks[2], uint32_t levels, timestamp_ns samplePeriod)	{
+	memset(filter, 0, sizeof(*filter));
+	filter->samplePeriod = samplePeriod;
+	filter->majoritySamples = 1;
+
+	for(int laser = 0; laser < 2; laser++)	{
+		struct glitchChannel* channel = &filter->channels[laser];
+		filter->laserMasks[laser] = laserMasks[laser];
+
+		channel->raw = (levels & laserMasks[laser]) != 0;
+		channel->level = channel->raw;
+		channel->majority = channel->raw;
+		channel->history = channel->raw ? ~0u : 0;
+	}
+
+	filter->levels = levels & (laserMasks[0] | laserMasks[1]);
+	filter->rawLevels = filter->levels;
+}
+
+//This function sets how many reads of a laser the glitch filter takes the majority of and how long, in microseconds,
+//a laser has to stay broken (minPulse[0]) and restored (minPulse[1]) before the tracker is told
+void setGlitchFilter(struct glitchFilter* filter, int majoritySamples, const float minPulse[2])	{
+	filter->majoritySamples = majoritySamples;
+	for(int level = 0; level < 2; level++)
+		filter->minPulse[level] = llround(minPulse[level] * 1000.0);
+}
+
+//This function gives the number of reads of a laser's raw level it takes for most of its last majoritySamples reads to
+//have that level, or 0 if it takes more than maxTicks. After n more reads those n and the newest majoritySamples - n
+//of the ones in history are counted, so it never takes more than majoritySamples
+int majorityTicks(const struct glitchChannel* channel, int majoritySamples, uint64_t maxTicks)	{
+	const uint32_t window = (1u << majoritySamples) - 1;
+	const uint32_t agreeing = channel->raw ? channel->history : ~channel->history;
+
+	for(int ticks = 1; ticks <= majoritySamples && ticks <= (int)maxTicks; ticks++)	{
+		if(ticks + __builtin_popcount(agreeing & (window >> ticks)) > majoritySamples / 2)
+			return ticks;
+	}
+
+	return 0;
+}
+
+//This function lets a change of a laser through to the tracker, as of commitTime
+void commitGlitch(struct glitchFilter* filter, int laser, timestamp_ns commitTime)	{
+	struct glitchChannel* channel = &filter->channels[laser];
+	channel->level = channel->majority;
+
+	if(filter->numCommits < MAX_GLITCH_COMMITS)
+		filter->commits[filter->numCommits++] = (struct glitchCommit){ commitTime, channel->candidateEdge, laser, channel->level };
+
+	//The laser may already have flickered away from its new level again
+	channel->excursion = channel->raw != channel->level;
+}
+
+//This function counts a flicker once a laser is back at the level the tracker has, both read and voted on, without
+//the change having been let through
+void settleGlitch(struct glitchFilter* filter, int laser)	{
+	struct glitchChannel* channel = &filter->channels[laser];
+
+	if(channel->excursion && channel->raw == channel->level && channel->majority == channel->level)	{
+		filter->glitches[laser]++;
+		channel->excursion = 0;
+	}
+}
+
+//This function is called when the majority of a laser's reads swing round to its raw level, at swingTime. If that is
+//not the level the tracker has it might be a real change, which is let through once it has lasted long enough.
+//Otherwise the change that was waiting was a flicker
+void swingMajority(struct glitchFilter* filter, int laser, timestamp_ns swingTime, timestamp_ns now)	{
+	struct glitchChannel* channel = &filter->channels[laser];
+	channel->majority = channel->raw;
+
+	if(channel->majority != channel->level)	{
+		channel->candidateSince = swingTime;
+		channel->candidateEdge = channel->rawSince;
+
+		if(swingTime + filter->minPulse[channel->majority] <= now)
+			commitGlitch(filter, laser, swingTime + filter->minPulse[channel->majority]);
+	}
+
+	settleGlitch(filter, laser);
+}
+
+//This function moves a laser of the glitch filter on to now, when nothing has changed since its last edge. Every
+//tick of the sample clock in between read the raw level, so the majority can only swing round to it, and only once.
+//Whatever can be worked out from the reads, however many, takes the same time
+void advanceGlitchFilter(struct glitchFilter* filter, int laser, timestamp_ns now)	{
+	struct glitchChannel* channel = &filter->channels[laser];
+	timestamp_ns swingTime = 0;
+
+	if(filter->majoritySamples > 1)	{
+		uint64_t tick = now / filter->samplePeriod;
+		uint64_t ticks = tick > channel->historyTick ? tick - channel->historyTick : 0;
+
+		if(ticks && channel->majority != channel->raw)	{
+			int swing = majorityTicks(channel, filter->majoritySamples, ticks);
+			if(swing)
+				swingTime = (channel->historyTick + swing) * filter->samplePeriod;
+		}
+
+		if(ticks >= 32)
+			channel->history = channel->raw ? ~0u : 0;
+		else if(ticks)
+			channel->history = (channel->history << ticks) | (channel->raw ? (1u << ticks) - 1 : 0);
+
+		if(ticks)
+			channel->historyTick = tick;
+	}
+
+	//A change that has lasted long enough is let through before the majority can swing back
+	if(channel->majority != channel->level)	{
+		timestamp_ns commitTime = channel->candidateSince + filter->minPulse[channel->majority];
+
+		if(commitTime <= (swingTime ? swingTime : now))
+			commitGlitch(filter, laser, commitTime);
+	}
+
+	if(swingTime)
+		swingMajority(filter, laser, swingTime, now);
+}
+
+//This function hands an event from the sampler to the glitch filter, which can be an edge or, when the wait for one
+//timed out, just the time. Both lasers are moved on to its time, and then their new levels are read. The changes it
+//lets through wait in the filter, in the order they were let through, for nextFilteredEvent
+void filterEvent(struct glitchFilter* filter, const struct laserEvent* event)	{
+	filter->numCommits = 0;
+	filter->nextCommit = 0;
+
+	for(int laser = 0; laser < 2; laser++)	{
+		struct glitchChannel* channel = &filter->channels[laser];
+		advanceGlitchFilter(filter, laser, event->timestamp);
+
+		int raw = (event->levels & filter->laserMasks[laser]) != 0;
+		if(raw == channel->raw)
+			continue;
+
+		channel->raw = raw;
+		channel->rawSince = event->timestamp;
+		if(raw != channel->level)
+			channel->excursion = 1;
+
+		//Without majority voting a laser's level is simply its last read
+		if(filter->majoritySamples <= 1)
+			swingMajority(filter, laser, event->timestamp, event->timestamp);
+		else
+			settleGlitch(filter, laser);
+	}
+
+	filter->rawLevels = event->levels & (filter->laserMasks[0] | filter->laserMasks[1]);
+
+	//The two lasers were moved on one after the other, so their changes are put in the order they happened in
+	for(int i = 1; i < filter->numCommits; i++)	{
+		struct glitchCommit commit = filter->commits[i];
+		int j = i;
+
+		for(; j > 0 && filter->commits[j - 1].commitTime > commit.commitTime; j--)
+			filter->commits[j] = filter->commits[j - 1];
+		filter->commits[j] = commit;
+	}
+}
+
+//This function hands out the next change of the lasers the glitch filter has let through, timed by the edge that
+//started it. Returns 1 if there was one and 0 if not, leaving the event as it was
+int nextFilteredEvent(struct glitchFilter* filter, struct laserEvent* event)	{
+	if(filter->nextCommit >= filter->numCommits)
+		return 0;
+
+	const struct glitchCommit* commit = &filter->commits[filter->nextCommit++];
+	if(commit->level)
+		filter->levels |= filter->laserMasks[commit->laser];
+	else
+		filter->levels &= ~filter->laserMasks[commit->laser];
+
+	event->timestamp = commit->edgeTime;
+	event->levels = filter->levels;
+	return 1;
+}
+
+//This function gives the time the glitch filter will next let a change through if the lasers stay as they are, so that
+//it can be woken up for it, or 0 if nothing is waiting
+timestamp_ns glitchDeadline(struct glitchFilter* filter)	{
+	timestamp_ns deadline = 0;
+
+	for(int laser = 0; laser < 2; laser++)	{
+		struct glitchChannel* channel = &filter->channels[laser];
+		timestamp_ns due = 0;
+
+		if(channel->majority != channel->level)
+			due = channel->candidateSince + filter->minPulse[channel->majority];
+		else if(channel->raw != channel->level && filter->majoritySamples > 1)
+			due = (channel->historyTick + majorityTicks(channel, filter->majoritySamples, filter->majoritySamples)) * filter->samplePeriod + filter->minPulse[channel->raw];
+
+		if(due && (!deadline || due < deadline))
+			deadline = due;
+	}
+
+	return deadline;
+}
+
+//This function is used by qsort to put the edges of the synthetic traffic in the order they happen
+int compareSyntheticEdges(const void* first, const void* second)	{
+	const struct syntheticEdge* a = first;
+	const struct syntheticEdge* b = second;
+
+	return (a->timestamp > b->timestamp) - (a->timestamp < b->timestamp);
+}
+
+//This function is used by qsort to put the people of the synthetic traffic in the order they left the hall
+int comparePeopleLeaving(const void* first, const void* second)	{
+	const struct syntheticPerson* a = first;
+	const struct syntheticPerson* b = second;
+
+	return (a->leaving > b->leaving) - (a->leaving < b->leaving);
+}
+
+//This function makes up the laser edges of numPeople walking through the hall in both directions. The time
+//between two people entering is random with an average of meanHeadway seconds, the speeds are between minSpeed
+//and maxSpeed m/s and every person blocks a laser for as long as it takes them to walk PERSON_DEPTH. Nobody breaks a
+//laser while someone else is breaking it, or overtakes someone in the hall, as the lasers could not tell them apart,
+//so people are held back until they can get through on their own. Returns the number of edges written to edges, which
+//must have room for 4 edges per person. If people is not NULL, who walked through is written to it, in the order
+//they entered
+int generateTraffic(struct syntheticEdge* edges, struct syntheticPerson* people, int numPeople, double meanHeadway, double minSpeed, double maxSpeed, double distance, unsigned int* seed)	{
+	const timestamp_ns gap = 50 * NS_PER_MS;
+	const timestamp_ns longestWalk = (distance + PERSON_DEPTH) / minSpeed * NS_PER_SECOND;
+	double entering = 1;
+
+	for(int i = 0; i < numPeople; i++)	{
+		int laser = rand_r(seed) & 1;
+		double speed = minSpeed + (maxSpeed - minSpeed) * rand_r(seed) / RAND_MAX;
+		timestamp_ns blocking = PERSON_DEPTH / speed * NS_PER_SECOND;
+		timestamp_ns walk = distance / speed * NS_PER_SECOND;
+
+		//Exponentially distributed gaps, but never less than 50 ms
+		entering += 0.05 - meanHeadway * log(1.0 - (double)rand_r(seed) / ((double)RAND_MAX + 1));
+		timestamp_ns start = entering * NS_PER_SECOND;
+
+		//The edges of everyone before are at 4 * j, their lasers being broken and restored on the way in and then on the
+		//way out. Whoever would get in the way of someone still in the hall waits until they no longer would
+		struct syntheticEdge* person = &edges[4 * i];
+		int moved = 1;
+
+		while(moved)	{
+			moved = 0;
+
+			for(int j = i - 1; j >= 0 && edges[4 * j].timestamp + longestWalk + gap > start; j--)	{
+				const struct syntheticEdge* other = &edges[4 * j];
+				timestamp_ns wait = 0;
+
+				for(int mine = 0; mine < 4; mine += 2)	{
+					for(int theirs = 0; theirs < 4; theirs += 2)	{
+						timestamp_ns from = start + (mine ? walk : 0);
+						if(other[theirs].laser == (mine ? !laser : laser) && from < other[theirs + 1].timestamp + gap && other[theirs].timestamp < from + blocking + gap && other[theirs + 1].timestamp + gap - from > wait)
+							wait = other[theirs + 1].timestamp + gap - from;
+					}
+				}
+
+				//Someone walking the same way has to be out of the far laser before this person gets to it
+				if(other[0].laser == laser && start + walk < other[3].timestamp + gap && other[3].timestamp + gap - (start + walk) > wait)
+					wait = other[3].timestamp + gap - (start + walk);
+
+				if(wait)	{
+					start += wait;
+					moved = 1;
+				}
+			}
+		}
+
+		entering = (double)start / NS_PER_SECOND;
+		person[0] = (struct syntheticEdge){ start, laser, 1 };
+		person[1] = (struct syntheticEdge){ start + blocking, laser, 0 };
+		person[2] = (struct syntheticEdge){ start + walk, !laser, 1 };
+		person[3] = (struct syntheticEdge){ start + walk + blocking, !laser, 0 };
+
+		if(people)
+			people[i] = (struct syntheticPerson){ laser ? MOVING_LEFT : MOVING_RIGHT, speed, start, start + walk + blocking };
+	}
+
+	qsort(edges, 4 * numPeople, sizeof(struct syntheticEdge), compareSyntheticEdges);
+	return 4 * numPeople;
+}
+
+//This function turns the synthetic edges into the laser events the sampler would have pushed. When two
+//people block the same laser at once the laser stays broken until both have passed, the same as in the hall.
+//laserMasks are the bits of the level register of laser 1 and laser 2. Returns the number of events written to events
+int syntheticEvents(const struct syntheticEdge* edges, int numEdges, const uint32_t laserMasks[2], struct laserEvent* events)	{
+	int blockers[2] = { 0, 0 };
+	uint32_t levels = laserMasks[0] | laserMasks[1];
+	int numEvents = 0;
+
+	for(int i = 0; i < numEdges; i++)	{
+		int laser = edges[i].laser;
+		blockers[laser] += edges[i].blocking ? 1 : -1;
+
+		uint32_t newLevels = blockers[laser] ? (levels & ~laserMasks[laser]) : (levels | laserMasks[laser]);
+		if(newLevels != levels)	{
+			levels = newLevels;
+			events[numEvents].timestamp = edges[i].timestamp;
+			events[numEvents].levels = levels;
+			numEvents++;
+		}
+	}
+
+	return numEvents;
+}
+
+//This function puts the events of synthetic traffic through a tracker and checks every person it measured against the
+//people who walked through, who are put in the order they left. A person measured is matched to whoever stopped
+//breaking the far laser at the time of the report. After the last event the hall is left alone until everyone still
+//in it has been given up on. Returns the number of people measured at a speed nobody walked at
+int checkTrackedTraffic(struct transitTracker* tracker, const struct laserEvent* events, int numEvents, struct syntheticPerson* people, int numPeople)	{
+	struct trackerReport reports[MAX_TRACKER_REPORTS];
+	int wrongSpeeds = 0;
+
+	qsort(people, numPeople, sizeof(struct syntheticPerson), comparePeopleLeaving);
+
+	for(int i = 0; i <= numEvents; i++)	{
+		struct laserEvent event = (i < numEvents) ? events[i] : (struct laserEvent){ events[numEvents - 1].timestamp + (TRANSIT_TIMEOUT + 1) * NS_PER_SECOND, events[numEvents - 1].levels };
+		int numReports;
+
+		do	{
+			numReports = trackEvent(tracker, &event, reports, MAX_TRACKER_REPORTS);
+
+			for(int r = 0; r < numReports; r++)	{
+				if(reports[r].outcome != TRANSIT_COMPLETED)
+					continue;
+
+				//People are reported once nobody else could be taken for them, so not quite in the order they left
+				int first = 0, last = numPeople;
+				while(first < last)	{
+					int middle = (first + last) / 2;
+					if(people[middle].leaving < reports[r].timestamp)
+						first = middle + 1;
+					else
+						last = middle;
+				}
+				int next = first;
+
+				if(next == numPeople || people[next].leaving != reports[r].timestamp || people[next].direction != reports[r].direction || fabs(reports[r].speed - people[next].speed) > BENCHMARK_SPEED_TOLERANCE * people[next].speed)
+					wrongSpeeds++;
+			}
+		} while(i == numEvents && numReports == MAX_TRACKER_REPORTS);
+	}
+
+	return wrongSpeeds;
+}
+
+//This function measures how many transits per second the tracker can follow on dense synthetic traffic,
+//from one person every 4 seconds down to one person every half a second, and prints the results. The same traffic is
+//then tracked again to check that everyone was either measured, at the speed they walked, or given up on. Returns 0 if
+//they were and -1 otherwise
+int runTrackerBenchmark(FILE* results)	{
+	const double headways[] = { 4.0, 2.0, 1.0, 0.5 };
+	const int numPeople = BENCHMARK_PEOPLE;
+	const double distance = DEFAULT_LASER_DISTANCE;
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+
+	struct syntheticEdge* edges = malloc(4 * numPeople * sizeof(struct syntheticEdge));
+	struct laserEvent* events = malloc(4 * numPeople * sizeof(struct laserEvent));
+	struct syntheticPerson* people = malloc(numPeople * sizeof(struct syntheticPerson));
+
+	if(!edges || !events || !people)	{
+		printf("The tracker benchmark could not be set up\n");
+		free(edges);
+		free(events);
+		free(people);
+		return -1;
+	}
+
+	int failed = 0;
+
+	for(int i = 0; i < (int)(sizeof(headways) / sizeof(headways[0])); i++)	{
+		unsigned int seed = 1;
+		int numEvents = syntheticEvents(edges, generateTraffic(edges, people, numPeople, headways[i], SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, distance, &seed), laserMasks, events);
+
+		struct transitTracker tracker;
+		struct trackerReport reports[MAX_TRACKER_REPORTS];
+		initTracker(&tracker, distance, laserMasks, LASER_PIN_MASK);
+
+		timestamp_ns start = getMonotonicTime();
+		for(int j = 0; j < numEvents; j++)
+			trackEvent(&tracker, &events[j], reports, MAX_TRACKER_REPORTS);
+
+		//The last people out are reported once nobody else could be taken for them
+		while(trackerDeadline(&tracker))
+			trackEvent(&tracker, &(struct laserEvent){ trackerDeadline(&tracker), tracker.levels }, reports, MAX_TRACKER_REPORTS);
+		timestamp_ns elapsed = getMonotonicTime() - start;
+
+		double seconds = (double)elapsed / NS_PER_SECOND;
+		printf("One person every %.1f s: %d people, %ld measured, %ld lost, %d edges in %.3f s (%.0f edges/s, %.0f transits/s)\n", headways[i], numPeople, tracker.completed, tracker.lost, numEvents, seconds, numEvents / seconds, tracker.completed / seconds);
+
+		initTracker(&tracker, distance, laserMasks, LASER_PIN_MASK);
+		int wrongSpeeds = checkTrackedTraffic(&tracker, events, numEvents, people, numPeople);
+		int correct = tracker.completed + tracker.lost == numPeople && wrongSpeeds == 0 && tracker.droppedReports == 0;
+
+		if(correct)
+			printf("    Everyone was measured at the speed they walked or given up on\n");
+		else
+			printf("    FAILED: %ld of %d people measured or given up on, %d at the wrong speed, %ld reports dropped\n", tracker.completed + tracker.lost, numPeople, wrongSpeeds, tracker.droppedReports);
+		failed |= !correct;
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"tracker\", \"headway_s\": %.2f, \"people\": %d, \"transits\": %ld, \"lost\": %ld, \"wrong_speeds\": %d, \"dropped_reports\": %ld, \"edges\": %d, \"seconds\": %.6f, \"edges_per_s\": %.0f, \"transits_per_s\": %.0f}\n", headways[i], numPeople, tracker.completed, tracker.lost, wrongSpeeds, tracker.droppedReports, numEvents, seconds, numEvents / seconds, tracker.completed / seconds);
+	}
+
+	free(edges);
+	free(events);
+	free(people);
+	return failed ? -1 : 0;
+}
+
+//This function adds flickers to the edges of synthetic traffic, the way dust, vibration or a bright light would break a
+//laser for a moment: GLITCH_BENCHMARK_RATE a minute on each laser at random and one just after every time a person
+//stops breaking a laser, as their bag swings through it. None of them is longer than GLITCH_BENCHMARK_WIDTH
+//microseconds. edges holds numEdges edges and has room for maxEdges, the flickers that do not fit being left out.
+//Returns the new number of edges, in order
+int addFlickers(struct syntheticEdge* edges, int numEdges, int maxEdges, unsigned int* seed)	{
+	timestamp_ns end = edges[numEdges - 1].timestamp;
+	int added = numEdges;
+
+	for(int laser = 0; laser < 2; laser++)	{
+		timestamp_ns flicker = 0;
+
+		while(added + 2 <= maxEdges)	{
+			flicker += (timestamp_ns)(-60.0 / GLITCH_BENCHMARK_RATE * log(1.0 - (double)rand_r(seed) / ((double)RAND_MAX + 1)) * NS_PER_SECOND);
+			if(flicker >= end)
+				break;
+
+			timestamp_ns width = (timestamp_ns)(1 + rand_r(seed) % GLITCH_BENCHMARK_WIDTH) * 1000;
+			edges[added++] = (struct syntheticEdge){ flicker, laser, 1 };
+			edges[added++] = (struct syntheticEdge){ flicker + width, laser, 0 };
+		}
+	}
+
+	for(int i = 0; i < numEdges && added + 2 <= maxEdges; i++)	{
+		if(edges[i].blocking)
+			continue;
+
+		timestamp_ns width = (timestamp_ns)(1 + rand_r(seed) % GLITCH_BENCHMARK_WIDTH) * 1000;
+		edges[added++] = (struct syntheticEdge){ edges[i].timestamp + width, edges[i].laser, 1 };
+		edges[added++] = (struct syntheticEdge){ edges[i].timestamp + 2 * width, edges[i].laser, 0 };
+	}
+
+	qsort(edges, added, sizeof(struct syntheticEdge), compareSyntheticEdges);
+	return added;
+}
+
+//This function puts the events of synthetic traffic through a glitch filter and a tracker, the way measureSpeed does,
+//and writes the people the tracker measured, up to maxMeasured of them, to measured. The filter is moved on a second
+//past the last event so that it lets through whatever it was waiting for, and the tracker on to when it can report the
+//last people out. Returns the number of people measured
+int filterTraffic(const struct laserEvent* events, int numEvents, const uint32_t laserMasks[2], struct glitchFilter* filter, struct transitTracker* tracker, struct speedMeasurement* measured, int maxMeasured)	{
+	struct trackerReport reports[MAX_TRACKER_REPORTS];
+	int numMeasured = 0;
+
+	for(int i = 0; i <= numEvents; i++)	{
+		struct laserEvent event = (i < numEvents) ? events[i] : (struct laserEvent){ events[numEvents - 1].timestamp + NS_PER_SECOND, laserMasks[0] | laserMasks[1] };
+		filterEvent(filter, &event);
+
+		struct laserEvent filtered;
+		for(;;)	{
+			int captured = nextFilteredEvent(filter, &filtered);
+
+			//Once the filter has nothing left, the tracker is woken up for the people who have left but not been reported
+			if(!captured && i == numEvents && trackerDeadline(tracker))	{
+				filtered = (struct laserEvent){ trackerDeadline(tracker), tracker->levels };
+				captured = 1;
+			}
+			if(!captured)
+				break;
+
+			int numReports = trackEvent(tracker, &filtered, reports, MAX_TRACKER_REPORTS);
+
+			for(int r = 0; r < numReports; r++)	{
+				if(reports[r].outcome == TRANSIT_COMPLETED && numMeasured < maxMeasured)
+					measured[numMeasured++] = (struct speedMeasurement){ reports[r].timestamp, reports[r].direction, reports[r].speed };
+			}
+		}
+	}
+
+	return numMeasured;
+}
+
+//This function is used by qsort to put measurements in the order of their times
+int compareMeasurementTimes(const void* first, const void* second)	{
+	const struct speedMeasurement* a = first;
+	const struct speedMeasurement* b = second;
+
+	return (a->timestamp > b->timestamp) - (a->timestamp < b->timestamp);
+}
+
+//This function counts the people measured in both lists, at the same time give or take 10 ms, walking the same way and
+//at the same speed give or take 1%. Both lists must be in the order of their times
+int matchTransits(const struct speedMeasurement* first, int numFirst, const struct speedMeasurement* second, int numSecond)	{
+	const timestamp_ns tolerance = 10 * NS_PER_MS;
+	int matched = 0;
+
+	for(int i = 0, j = 0; i < numFirst && j < numSecond; )	{
+		if(first[i].timestamp + tolerance < second[j].timestamp)
+			i++;
+		else if(second[j].timestamp + tolerance < first[i].timestamp)
+			j++;
+		else	{
+			matched += first[i].direction == second[j].direction && fabsf(first[i].speed - second[j].speed) <= 0.01f * fabsf(first[i].speed);
+			i++;
+			j++;
+		}
+	}
+
+	return matched;
+}
+
+//This function checks the glitch filter on noisy synthetic traffic. The same people are walked through the hall once
+//with clean lasers and once with flickering ones, and the tracker is given both, straight and through the filter.
+//Through the filter the flickering lasers should give the same people at the same speeds as the clean ones do, every
+//flicker having been thrown away. The filter also merges people who follow each other through a laser with a gap of
+//less than its widths, so the clean lasers are put through it too. It also times the filter. Returns 0 if at least
+//GLITCH_BENCHMARK_MATCHED of the people were measured the same, without many more, and -1 otherwise
+int runGlitchBenchmark(FILE* results)	{
+	const int numPeople = GLITCH_BENCHMARK_PEOPLE;
+	const double distance = DEFAULT_LASER_DISTANCE;
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+	const float minPulse[2] = { GLITCH_BENCHMARK_MIN_PULSE, GLITCH_BENCHMARK_MIN_PULSE };
+	const char* runNames[4] = { "clean", "flickering", "clean filtered", "flickering filtered" };
+
+	//Every person makes 4 edges, 2 of them followed by a bag swinging, and there are about 2 s of traffic for every
+	//person. Room is left for 4 times the flickers that should come in that time
+	int maxEdges = 8 * numPeople + 2 * 4 * (int)(2 * numPeople * (SIMULATION_HEADWAY + 0.05) * GLITCH_BENCHMARK_RATE / 60);
+	struct syntheticEdge* edges = malloc(maxEdges * sizeof(struct syntheticEdge));
+	struct laserEvent* events[2] = { malloc(4 * numPeople * sizeof(struct laserEvent)), malloc(maxEdges * sizeof(struct laserEvent)) };
+	struct speedMeasurement* measured[4];
+	int ready = edges && events[0] && events[1];
+	int failed = 0;
+
+	for(int run = 0; run < 4; run++)	{
+		measured[run] = malloc(numPeople * sizeof(struct speedMeasurement));
+		ready = ready && measured[run];
+	}
+
+	if(ready)	{
+		unsigned int seed = 1;
+		int numEdges = generateTraffic(edges, NULL, numPeople, SIMULATION_HEADWAY, SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, distance, &seed);
+		int numEvents[2];
+		numEvents[0] = syntheticEvents(edges, numEdges, laserMasks, events[0]);
+		numEdges = addFlickers(edges, numEdges, maxEdges, &seed);
+		numEvents[1] = syntheticEvents(edges, numEdges, laserMasks, events[1]);
+
+		//The clean and the flickering lasers, first straight into the tracker and then through the filter
+		struct transitTracker trackers[4];
+		int numMeasured[4];
+		uint64_t glitches = 0;
+		timestamp_ns elapsed = 0;
+
+		for(int run = 0; run < 4; run++)	{
+			struct glitchFilter filter;
+			initGlitchFilter(&filter, laserMasks, LASER_PIN_MASK, POLL_PERIOD_US * 1000ULL);
+			if(run >= 2)
+				setGlitchFilter(&filter, GLITCH_BENCHMARK_MAJORITY, minPulse);
+			initTracker(&trackers[run], distance, laserMasks, LASER_PIN_MASK);
+
+			timestamp_ns start = getMonotonicTime();
+			numMeasured[run] = filterTraffic(events[run & 1], numEvents[run & 1], laserMasks, &filter, &trackers[run], measured[run], numPeople);
+
+			if(run == 3)	{
+				elapsed = getMonotonicTime() - start;
+				glitches = filter.glitches[0] + filter.glitches[1];
+			}
+		}
+
+		//People are reported once nobody else could be taken for them, so not quite in the order they left
+		qsort(measured[2], numMeasured[2], sizeof(struct speedMeasurement), compareMeasurementTimes);
+		qsort(measured[3], numMeasured[3], sizeof(struct speedMeasurement), compareMeasurementTimes);
+		int matched = matchTransits(measured[2], numMeasured[2], measured[3], numMeasured[3]);
+		int flickers = (numEvents[1] - numEvents[0]) / 2;
+		double nsPerEdge = (double)elapsed / numEvents[1];
+
+		printf("Glitch filter, %d people and %d flickers:", numPeople, flickers);
+		for(int run = 0; run < 4; run++)
+			printf("%s %s %ld measured and %ld lost", run ? "," : "", runNames[run], trackers[run].completed, trackers[run].lost);
+		printf(". %d of the people measured on the clean lasers filtered were measured the same on the flickering ones, %llu flickers filtered out, %.1f ns an edge\n", matched, (unsigned long long)glitches, nsPerEdge);
+
+		//Flickers that get through are taken for more people, who are measured or lost
+		long extra = (trackers[3].completed + trackers[3].lost) - (trackers[2].completed + trackers[2].lost);
+
+		if(matched < GLITCH_BENCHMARK_MATCHED * numMeasured[2] || extra > (1 - GLITCH_BENCHMARK_MATCHED) * numPeople)	{
+			printf("    FAILED: %.1f%% of the people were measured the same and %ld more people came out of the flickering lasers, at least %.1f%% should be the same and no more than %.1f%% more\n", 100.0 * matched / (numMeasured[2] ? numMeasured[2] : 1), extra, 100 * GLITCH_BENCHMARK_MATCHED, 100 * (1 - GLITCH_BENCHMARK_MATCHED));
+			failed = 1;
+		}
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"glitch_filter\", \"people\": %d, \"flickers\": %d, \"clean_transits\": %ld, \"clean_lost\": %ld, \"noisy_transits\": %ld, \"noisy_lost\": %ld, \"clean_filtered_transits\": %ld, \"clean_filtered_lost\": %ld, \"noisy_filtered_transits\": %ld, \"noisy_filtered_lost\": %ld, \"matched\": %d, \"glitches\": %llu, \"ns_per_edge\": %.1f}\n", numPeople, flickers, trackers[0].completed, trackers[0].lost, trackers[1].completed, trackers[1].lost, trackers[2].completed, trackers[2].lost, trackers[3].completed, trackers[3].lost, matched, (unsigned long long)glitches, nsPerEdge);
+	}
+	else	{
+		printf("The glitch benchmark could not be set up\n");
+		failed = 1;
+	}
+
+	free(edges);
+	free(events[0]);
+	free(events[1]);
+	for(int run = 0; run < 4; run++)
+		free(measured[run]);
+
+	return failed ? -1 : 0;
+}
+
+//This is a thread of the lane benchmark. It follows the edges the sampler pushes into the ring of one lane, the way the
+//lane's own thread would, until the sampler has finished
+void* laneBenchmarkThread(void* argument)	{
+	struct laneBenchmark* lane = argument;
+	struct trackerReport reports[MAX_TRACKER_REPORTS];
+	struct laserEvent event;
+	int captured;
+
+	while((captured = samplerNextEvent(lane->sampler, lane->lane, &event, CAPTURE_TIMEOUT_MS)) >= 0)	{
+		if(captured)
+			trackEvent(&lane->tracker, &event, reports, MAX_TRACKER_REPORTS);
+	}
+
+	return NULL;
+}
+
+//This function measures what it costs to watch more lanes from one sampler. Synthetic traffic on 1, 2, 4 and 8 lanes
+//is sampled into one buffer, the way the level register would be read, and the buffer is scanned for edges of any
+//lane and every edge handed to the lanes it changed, first following them on the same thread and then the way the
+//program does, through the rings of a sampler to a thread a lane, which only helps if there are CPUs to spare. Returns 0
+//if both ways measured the same transits and -1 if they did not or the benchmark could not be set up
+int runLaneBenchmark(FILE* results)	{
+	const long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const int laneCounts[] = { 1, 2, 4, 8 };
+	const int lanePins[MAX_LANES][2] = { { 4, 18 }, { 5, 6 }, { 12, 13 }, { 19, 20 }, { 23, 24 }, { 25, 26 }, { 7, 8 }, { 9, 10 } };
+	const size_t numSamples = LANE_BENCHMARK_SAMPLES;
+	const timestamp_ns period = NS_PER_SECOND / LANE_BENCHMARK_RATE;
+	const int numPeople = numSamples / LANE_BENCHMARK_RATE / LANE_BENCHMARK_HEADWAY;
+	const double distance = DEFAULT_LASER_DISTANCE;
+
+	uint32_t* samples = aligned_alloc(64, numSamples * sizeof(uint32_t));
+	struct syntheticEdge* edges = malloc(4 * numPeople * sizeof(struct syntheticEdge));
+	struct laserEvent* traffic[MAX_LANES] = { NULL };
+	int numTraffic[MAX_LANES];
+	struct laneBenchmark lanes[MAX_LANES];
+	memset(lanes, 0, sizeof(lanes));
+
+	int ready = samples && edges;
+	for(int lane = 0; lane < MAX_LANES; lane++)	{
+		traffic[lane] = malloc(4 * numPeople * sizeof(struct laserEvent));
+		ready = ready && traffic[lane];
+	}
+
+	int failed = !ready;
+	if(!ready)
+		printf("The lane benchmark could not be set up\n");
+
+	//Every lane has its own people, walking at their own times
+	uint32_t laneMasks[MAX_LANES];
+	uint32_t laserMasks[MAX_LANES][2];
+	for(int lane = 0; ready && lane < MAX_LANES; lane++)	{
+		unsigned int seed = lane + 1;
+		laserMasks[lane][0] = 1u << lanePins[lane][0];
+		laserMasks[lane][1] = 1u << lanePins[lane][1];
+		laneMasks[lane] = laserMasks[lane][0] | laserMasks[lane][1];
+		numTraffic[lane] = syntheticEvents(edges, generateTraffic(edges, NULL, numPeople, LANE_BENCHMARK_HEADWAY, SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, distance, &seed), laserMasks[lane], traffic[lane]);
+	}
+
+	for(int i = 0; ready && i < (int)(sizeof(laneCounts) / sizeof(laneCounts[0])); i++)	{
+		int numLanes = laneCounts[i];
+		uint32_t allLasers = 0;
+		for(int lane = 0; lane < numLanes; lane++)
+			allLasers |= laneMasks[lane];
+
+		//The lasers of every lane are read at once, while the pins nobody uses flicker all the time
+		unsigned int seed = 1;
+		int nextEvent[MAX_LANES] = { 0 };
+		uint32_t levels = allLasers;
+
+		for(size_t j = 0; j < numSamples; j++)	{
+			timestamp_ns sampleTime = j * period;
+
+			for(int lane = 0; lane < numLanes; lane++)	{
+				while(nextEvent[lane] < numTraffic[lane] && traffic[lane][nextEvent[lane]].timestamp <= sampleTime)
+					levels = (levels & ~laneMasks[lane]) | traffic[lane][nextEvent[lane]++].levels;
+			}
+
+			samples[j] = levels | ((uint32_t)rand_r(&seed) & ~allLasers);
+		}
+
+		//The sampler scans for an edge of any lane and hands it to the lanes it changed, which follow it straight away
+		struct trackerReport reports[MAX_TRACKER_REPORTS];
+		for(int lane = 0; lane < numLanes; lane++)
+			initTracker(&lanes[lane].tracker, distance, laserMasks[lane], laneMasks[lane]);
+
+		size_t found = 0;
+		uint32_t previous = allLasers;
+		timestamp_ns start = getMonotonicTime();
+
+		for(size_t j = 0; j < numSamples; )	{
+			size_t edge = findEdge(&samples[j], numSamples - j, previous, allLasers);
+			if(edge == numSamples - j)
+				break;
+
+			j += edge;
+			uint32_t changed = (samples[j] ^ previous) & allLasers;
+			previous = samples[j];
+			found++;
+
+			for(int lane = 0; lane < numLanes; lane++)	{
+				if(changed & laneMasks[lane])	{
+					struct laserEvent event = { j * period, samples[j] & laneMasks[lane] };
+					trackEvent(&lanes[lane].tracker, &event, reports, MAX_TRACKER_REPORTS);
+				}
+			}
+
+			j++;
+		}
+
+		timestamp_ns scanTime = getMonotonicTime() - start;
+
+		long transits = 0;
+		for(int lane = 0; lane < numLanes; lane++)
+			transits += lanes[lane].tracker.completed;
+
+		//The same samples again, the way the program watches the lanes: the sampler pushes every edge into the rings of the
+		//lanes it changed and wakes them up, while a thread for each lane, already waiting, follows its own edges
+		struct laserCapture capture;
+		memset(&capture, 0, sizeof(capture));
+		capture.levels = allLasers;
+
+		struct samplerThread sampler;
+		if(initSampler(&sampler, &capture, -1, 0, laneMasks, numLanes) < 0)	{
+			printf("The lane benchmark could not be set up\n");
+			failed = 1;
+			break;
+		}
+
+		pthread_t threads[MAX_LANES];
+		int started[MAX_LANES];
+		for(int lane = 0; lane < numLanes; lane++)	{
+			initTracker(&lanes[lane].tracker, distance, laserMasks[lane], laneMasks[lane]);
+			lanes[lane].sampler = &sampler;
+			lanes[lane].lane = lane;
+			started[lane] = pthread_create(&threads[lane], NULL, laneBenchmarkThread, &lanes[lane]) == 0;
+		}
+
+		previous = allLasers;
+		start = getMonotonicTime();
+
+		for(size_t j = 0; j < numSamples; )	{
+			size_t edge = findEdge(&samples[j], numSamples - j, previous, allLasers);
+			if(edge == numSamples - j)
+				break;
+
+			j += edge;
+
+			//The samples are played back far faster than they would be read, so the sampler waits for room in the rings
+			//rather than dropping the edges the lanes have not got round to yet
+			for(int lane = 0; lane < numLanes; lane++)	{
+				struct eventRing* ring = &sampler.lanes[lane].ring;
+				while(atomic_load(&ring->head) - atomic_load(&ring->tail) >= EVENT_RING_SIZE)
+					sched_yield();
+			}
+
+			struct laserEvent event = { j * period, samples[j] & allLasers };
+			fanOutEvent(&sampler, &event);
+			previous = samples[j];
+			j++;
+		}
+
+		//Let the lanes know that there will not be any more edges, the same as samplerMain does, and wait for them to
+		//follow what is left in their rings. A lane whose thread could not be started follows its edges here
+		uint64_t one = 1;
+		atomic_store(&sampler.finished, 1);
+		for(int lane = 0; lane < numLanes; lane++)
+			write(sampler.lanes[lane].wakeFd, &one, sizeof(one));
+
+		for(int lane = 0; lane < numLanes; lane++)	{
+			if(started[lane])
+				pthread_join(threads[lane], NULL);
+			else
+				laneBenchmarkThread(&lanes[lane]);
+		}
+
+		timestamp_ns threadedTime = getMonotonicTime() - start;
+
+		long threadedTransits = 0;
+		size_t overflows = 0;
+		for(int lane = 0; lane < numLanes; lane++)	{
+			threadedTransits += lanes[lane].tracker.completed;
+			overflows += atomic_load(&sampler.lanes[lane].ring.overflows);
+		}
+		stopSampler(&sampler);
+
+		double perSample = (double)scanTime / numSamples;
+		double threadedPerSample = (double)threadedTime / numSamples;
+		double speedup = threadedTime ? (double)scanTime / threadedTime : 0;
+		printf("%d lane%s: %zu samples with %zu edges and %ld transits, %.2f ns a sample (%.2f ns a sample for each lane) on one thread and %.2f ns a sample (%.2f ns a sample for each lane) through the sampler to a thread a lane, %.2f times as fast on %ld CPU%s\n", numLanes, numLanes > 1 ? "s" : "", numSamples, found, transits, perSample, perSample / numLanes, threadedPerSample, threadedPerSample / numLanes, speedup, numCpus, numCpus > 1 ? "s" : "");
+
+		if(threadedTransits != transits)	{
+			failed = 1;
+			printf("    FAILED: %ld transits on a thread a lane, %zu edges lost to full rings\n", threadedTransits, overflows);
+		}
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"lanes\", \"lanes\": %d, \"cpus\": %ld, \"samples\": %zu, \"edges\": %zu, \"transits\": %ld, \"ns_per_sample\": {\"one_thread\": %.3f, \"thread_per_lane\": %.3f}, \"ns_per_sample_per_lane\": {\"one_thread\": %.3f, \"thread_per_lane\": %.3f}, \"thread_per_lane_transits\": %ld, \"ring_overflows\": %zu, \"thread_speedup\": %.3f}\n", numLanes, numCpus, numSamples, found, transits, perSample, threadedPerSample, perSample / numLanes, threadedPerSample / numLanes, threadedTransits, overflows, speedup);
+	}
+
+	for(int lane = 0; lane < MAX_LANES; lane++)
+		free(traffic[lane]);
+	free(edges);
+	free(samples);
+
+	return failed ? -1 : 0;
+}
+
+//This function gives the jitter of the loop of measureSpeed, the standard deviation of its period in nanoseconds
+double loopJitter(const struct pipelineMetrics* metrics)	{
+	uint64_t periods = metrics->loopPeriod.count;
+	if(periods < 2)
+		return 0;
+
+	double mean = metrics->loopPeriodSum / periods;
+	double variance = (metrics->loopPeriodSquares - periods * mean * mean) / (periods - 1);
+	return variance > 0 ? sqrt(variance) : 0;
+}
+
+//This function adds text to the end of a buffer of the given size, length being how much of it is already used.
+//Anything that does not fit is cut off
+void appendText(char* buffer, size_t size, size_t* length, const char* format, ...)	{
+	if(*length + 1 >= size)
+		return;
+
+	va_list arguments;
+	va_start(arguments, format);
+	int written = vsnprintf(buffer + *length, size - *length, format, arguments);
+	va_end(arguments);
+
+	if(written > 0)
+		*length = (*length + written < size) ? *length + written : size - 1;
+}
+
+//This function adds a latency histogram of every lane to the metrics as a Prometheus histogram in seconds, each with
+//the lane as a label. offset is where the histogram is in the pipelineMetrics. Every bucket holds the count of the
+//latencies up to its le, so they only ever grow
+void formatHistogram(char* buffer, size_t size, size_t* length, const char* name, const char* help, const struct pipelineMetrics metrics[], int numLanes, size_t offset)	{
+	appendText(buffer, size, length, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+	for(int lane = 0; lane < numLanes; lane++)	{
+		const struct latencyHistogram* histogram = (const struct latencyHistogram*)((const char*)&metrics[lane] + offset);
+
+		uint64_t count = 0;
+		for(int i = 0; i < LATENCY_BUCKETS; i++)	{
+			count += histogram->buckets[i];
+			if(i >= METRICS_FIRST_BUCKET - 1 && i < METRICS_LAST_BUCKET)
+				appendText(buffer, size, length, "%s_bucket{lane=\"%d\",le=\"%.9g\"} %llu\n", name, lane + 1, (double)(2ULL << i) / NS_PER_SECOND, (unsigned long long)count);
+		}
+
+		appendText(buffer, size, length, "%s_bucket{lane=\"%d\",le=\"+Inf\"} %llu\n%s_sum{lane=\"%d\"} %.9f\n%s_count{lane=\"%d\"} %llu\n", name, lane + 1, (unsigned long long)histogram->count, name, lane + 1, histogram->sum / NS_PER_SECOND, name, lane + 1, (unsigned long long)histogram->count);
+	}
+}
+
+//This function writes everything the program measures about itself to a buffer, in the Prometheus text format so that
+//it can be collected by a node exporter. Everything about the lanes has the lane, from 1, as a label. Nothing is
+//allocated, anything past the end of the buffer being cut off. Returns the length of the text
+size_t formatMetrics(char* buffer, size_t size, const struct pipelineMetrics metrics[], int numLanes, struct samplerThread* sampler)	{
+	const char* stateNames[HALL_STATES] = { "empty", "entering", "in_hall", "exiting" };
+	const char* directionNames[2] = { "right", "left" };
+	struct laserCapture* capture = sampler->capture;
+	size_t length = 0;
+	buffer[0] = 0;
+
+	appendText(buffer, size, &length, "# HELP speedometer_uptime_seconds Time since the state machine started.\n# TYPE speedometer_uptime_seconds gauge\nspeedometer_uptime_seconds %.3f\n", metrics[0].started ? (double)(getMonotonicTime() - metrics[0].started) / NS_PER_SECOND : 0);
+
+	appendText(buffer, size, &length, "# HELP speedometer_loop_iterations_total Turns of the state machine loop.\n# TYPE speedometer_loop_iterations_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_loop_iterations_total{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)metrics[lane].iterations);
+
+	formatHistogram(buffer, size, &length, "speedometer_loop_period_seconds", "Time between the starts of two turns of the state machine loop.", metrics, numLanes, offsetof(struct pipelineMetrics, loopPeriod));
+	appendText(buffer, size, &length, "# HELP speedometer_loop_jitter_seconds Standard deviation of the loop period.\n# TYPE speedometer_loop_jitter_seconds gauge\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_loop_jitter_seconds{lane=\"%d\"} %.9f\n", lane + 1, loopJitter(&metrics[lane]) / NS_PER_SECOND);
+
+	formatHistogram(buffer, size, &length, "speedometer_loop_busy_seconds", "Time each turn of the loop spent working rather than waiting for an edge.", metrics, numLanes, offsetof(struct pipelineMetrics, busyTime));
+	appendText(buffer, size, &length, "# HELP speedometer_loop_max_stall_seconds Longest time the loop has spent working in one turn.\n# TYPE speedometer_loop_max_stall_seconds gauge\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_loop_max_stall_seconds{lane=\"%d\"} %.9f\n", lane + 1, (double)metrics[lane].busyTime.max / NS_PER_SECOND);
+
+	formatHistogram(buffer, size, &length, "speedometer_decision_latency_seconds", "Time from an edge being captured to everything it caused being done.", metrics, numLanes, offsetof(struct pipelineMetrics, decisionLatency));
+
+	appendText(buffer, size, &length, "# HELP speedometer_edges_total Laser edges handled.\n# TYPE speedometer_edges_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_edges_total{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)metrics[lane].edges);
+
+	appendText(buffer, size, &length, "# HELP speedometer_suspected_missed_edges_total Edges that changed no laser or both, so that an edge before them was probably missed.\n# TYPE speedometer_suspected_missed_edges_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_suspected_missed_edges_total{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)metrics[lane].missedEdges);
+
+	appendText(buffer, size, &length, "# HELP speedometer_glitches_total Flickers of a laser thrown away by the glitch filter.\n# TYPE speedometer_glitches_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)	{
+		for(int laser = 0; laser < 2; laser++)
+			appendText(buffer, size, &length, "speedometer_glitches_total{lane=\"%d\",laser=\"%d\"} %llu\n", lane + 1, laser + 1, (unsigned long long)metrics[lane].glitches[laser]);
+	}
+
+	//What has been happening in the hall, for each direction
+	appendText(buffer, size, &length, "# HELP speedometer_transits_total People who made it through the hall.\n# TYPE speedometer_transits_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)	{
+		for(int direction = 0; direction < 2; direction++)
+			appendText(buffer, size, &length, "speedometer_transits_total{lane=\"%d\",direction=\"%s\"} %llu\n", lane + 1, directionNames[direction], (unsigned long long)metrics[lane].directionTransits[direction]);
+	}
+
+	appendText(buffer, size, &length, "# HELP speedometer_speeders_total People who went through the hall over the speed limit of their direction.\n# TYPE speedometer_speeders_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)	{
+		for(int direction = 0; direction < 2; direction++)
+			appendText(buffer, size, &length, "speedometer_speeders_total{lane=\"%d\",direction=\"%s\"} %llu\n", lane + 1, directionNames[direction], (unsigned long long)metrics[lane].speeders[direction]);
+	}
+
+	appendText(buffer, size, &length, "# HELP speedometer_lost_total People who walked into the hall and were never seen leaving it, such as those who turned back.\n# TYPE speedometer_lost_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)	{
+		for(int direction = 0; direction < 2; direction++)
+			appendText(buffer, size, &length, "speedometer_lost_total{lane=\"%d\",direction=\"%s\"} %llu\n", lane + 1, directionNames[direction], (unsigned long long)metrics[lane].lost[direction]);
+	}
+
+	appendText(buffer, size, &length, "# HELP speedometer_off_the_charts_total Transits too fast to be a person.\n# TYPE speedometer_off_the_charts_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_off_the_charts_total{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)metrics[lane].offTheCharts);
+
+	appendText(buffer, size, &length, "# HELP speedometer_laser_blocked_total Times a laser was blocked for too long.\n# TYPE speedometer_laser_blocked_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_laser_blocked_total{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)metrics[lane].laserBlocked);
+
+	appendText(buffer, size, &length, "# HELP speedometer_hall_blocked_total Times someone stayed in the hall for too long.\n# TYPE speedometer_hall_blocked_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_hall_blocked_total{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)metrics[lane].hallBlocked);
+
+	appendText(buffer, size, &length, "# HELP speedometer_occupancy People between the lasers right now.\n# TYPE speedometer_occupancy gauge\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_occupancy{lane=\"%d\"} %d\n", lane + 1, metrics[lane].occupancy);
+
+	//The speeds, in the same bins as the histogram of the stats file
+	appendText(buffer, size, &length, "# HELP speedometer_speed_meters_per_second Speeds of the people measured.\n# TYPE speedometer_speed_meters_per_second histogram\n");
+	for(int lane = 0; lane < numLanes; lane++)	{
+		uint64_t measured = 0;
+		for(int bin = 0; bin < HISTOGRAM_BINS; bin++)	{
+			measured += metrics[lane].speedBins[bin];
+			if(bin < HISTOGRAM_BINS - 1)
+				appendText(buffer, size, &length, "speedometer_speed_meters_per_second_bucket{lane=\"%d\",le=\"%g\"} %llu\n", lane + 1, (bin + 1) * HISTOGRAM_BIN_WIDTH, (unsigned long long)measured);
+		}
+		appendText(buffer, size, &length, "speedometer_speed_meters_per_second_bucket{lane=\"%d\",le=\"+Inf\"} %llu\nspeedometer_speed_meters_per_second_sum{lane=\"%d\"} %.3f\nspeedometer_speed_meters_per_second_count{lane=\"%d\"} %llu\n", lane + 1, (unsigned long long)measured, lane + 1, metrics[lane].speedSum, lane + 1, (unsigned long long)measured);
+	}
+
+	appendText(buffer, size, &length, "# HELP speedometer_hall_state_seconds_total Time the hall has spent in each state.\n# TYPE speedometer_hall_state_seconds_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)	{
+		for(int state = 0; state < HALL_STATES; state++)
+			appendText(buffer, size, &length, "speedometer_hall_state_seconds_total{lane=\"%d\",state=\"%s\"} %.3f\n", lane + 1, stateNames[state], (double)metrics[lane].stateTime[state] / NS_PER_SECOND);
+	}
+
+	appendText(buffer, size, &length, "# HELP speedometer_ring_high_water Most edges that have been waiting for the state machine at once.\n# TYPE speedometer_ring_high_water gauge\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_ring_high_water{lane=\"%d\"} %zu\n", lane + 1, atomic_load(&sampler->lanes[lane].ring.highWater));
+
+	appendText(buffer, size, &length, "# HELP speedometer_ring_overflows_total Edges dropped because the state machine could not keep up.\n# TYPE speedometer_ring_overflows_total counter\n");
+	for(int lane = 0; lane < numLanes; lane++)
+		appendText(buffer, size, &length, "speedometer_ring_overflows_total{lane=\"%d\"} %zu\n", lane + 1, atomic_load(&sampler->lanes[lane].ring.overflows));
+
+	//The reads of the level register only happen when polling
+	if(capture->mode == CAPTURE_POLL)	{
+		appendText(buffer, size, &length, "# HELP speedometer_polls_total Reads of the level register.\n# TYPE speedometer_polls_total counter\nspeedometer_polls_total %llu\n", (unsigned long long)atomic_load_explicit(&capture->polls, memory_order_relaxed));
+		appendText(buffer, size, &length, "# HELP speedometer_late_polls_total Reads of the level register that came late enough for an edge to be missed.\n# TYPE speedometer_late_polls_total counter\nspeedometer_late_polls_total %llu\n", (unsigned long long)atomic_load_explicit(&capture->latePolls, memory_order_relaxed));
+		appendText(buffer, size, &length, "# HELP speedometer_longest_poll_gap_seconds Longest time between two reads of the level register.\n# TYPE speedometer_longest_poll_gap_seconds gauge\nspeedometer_longest_poll_gap_seconds %.9f\n", (double)atomic_load_explicit(&capture->longestPollGap, memory_order_relaxed) / NS_PER_SECOND);
+		appendText(buffer, size, &length, "# HELP speedometer_poll_rate_seconds_total Time the level register has been read at each rate.\n# TYPE speedometer_poll_rate_seconds_total counter\nspeedometer_poll_rate_seconds_total{rate=\"idle\"} %.3f\nspeedometer_poll_rate_seconds_total{rate=\"active\"} %.3f\n", (double)atomic_load_explicit(&capture->idleTime, memory_order_relaxed) / NS_PER_SECOND, (double)atomic_load_explicit(&capture->activeTime, memory_order_relaxed) / NS_PER_SECOND);
+		appendText(buffer, size, &length, "# HELP speedometer_poll_wake_latency_seconds How late the sampler woke up for the reads of the level register.\n# TYPE speedometer_poll_wake_latency_seconds summary\nspeedometer_poll_wake_latency_seconds_sum %.9f\nspeedometer_poll_wake_latency_seconds_count %llu\n", (double)atomic_load_explicit(&capture->wakeLatency, memory_order_relaxed) / NS_PER_SECOND, (unsigned long long)atomic_load_explicit(&capture->wakeups, memory_order_relaxed));
+		appendText(buffer, size, &length, "# HELP speedometer_sampler_cpu_seconds_total CPU time used by the sampler thread.\n# TYPE speedometer_sampler_cpu_seconds_total counter\nspeedometer_sampler_cpu_seconds_total %.6f\n", (double)atomic_load_explicit(&capture->cpuTime, memory_order_relaxed) / NS_PER_SECOND);
+	}
+
+	//And the stream of the level register only when streaming
+	if(capture->mode == CAPTURE_STREAM)	{
+		appendText(buffer, size, &length, "# HELP speedometer_stream_samples_total Samples of the level register streamed.\n# TYPE speedometer_stream_samples_total counter\nspeedometer_stream_samples_total %zu\n", atomic_load(&capture->stream->head));
+		appendText(buffer, size, &length, "# HELP speedometer_stream_late_samples_total Samples of the level register taken more than a period late.\n# TYPE speedometer_stream_late_samples_total counter\nspeedometer_stream_late_samples_total %llu\n", (unsigned long long)atomic_load_explicit(&capture->stream->lateSamples, memory_order_relaxed));
+		appendText(buffer, size, &length, "# HELP speedometer_stream_gaps_total Times the streamer fell a whole block behind and started again.\n# TYPE speedometer_stream_gaps_total counter\nspeedometer_stream_gaps_total %llu\n", (unsigned long long)atomic_load_explicit(&capture->stream->gaps, memory_order_relaxed));
+		appendText(buffer, size, &length, "# HELP speedometer_stream_overruns_total Times the scanner fell a whole buffer behind and skipped samples.\n# TYPE speedometer_stream_overruns_total counter\nspeedometer_stream_overruns_total %llu\n", (unsigned long long)atomic_load_explicit(&capture->overruns, memory_order_relaxed));
+	}
+
+	return length;
+}
+
+//This function writes the metrics to the metrics file. They are written to <name>.tmp first and moved over the file,
+//so whatever reads it never sees half of them. Returns 0 on success and -1 if the file could not be written
+int writeMetricsFile(const char* fileName, const char* text, size_t length)	{
+	char tempName[PATH_MAX];
+	snprintf(tempName, sizeof(tempName), "%s.tmp", fileName);
+
+	int fd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		return -1;
+
+	size_t written = 0;
+	while(written < length)	{
+		ssize_t result = write(fd, text + written, length - written);
+		if(result < 0 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			break;
+		written += result;
+	}
+
+	close(fd);
+
+	if(written < length || rename(tempName, fileName) < 0)	{
+		unlink(tempName);
+		return -1;
+	}
+
+	return 0;
+}
+
+//This function starts the metrics server for a metrics file and a socket, either of which can be empty for none.
+//The server is not started at all without either. Returns 0 on success and -1 if the socket could not be opened
+//or the thread could not be started
+int startMetricsServer(struct metricsServer* server, struct samplerThread* sampler, int numLanes, struct asyncLogger* logFile, const char* fileName, const char* socketName)	{
+	memset(server, 0, sizeof(*server));
+	server->sampler = sampler;
+	server->numLanes = numLanes;
+	server->logFile = logFile;
+	server->listenFd = -1;
+	server->stopFd = -1;
+	snprintf(server->fileName, sizeof(server->fileName), "%s", fileName);
+	snprintf(server->socketName, sizeof(server->socketName), "%s", socketName);
+	pthread_mutex_init(&server->lock, NULL);
+
+	if(!server->fileName[0] && !server->socketName[0])
+		return 0;
+
+	if(server->socketName[0] && openMetricsSocket(server) < 0)
+		return -1;
+
+	server->stopFd = eventfd(0, EFD_NONBLOCK);
+	if(server->stopFd < 0)
+		return -1;
+
+	atomic_store(&server->running, 1);
+
+	if(pthread_create(&server->thread, NULL, metricsServerMain, server) != 0)	{
+		atomic_store(&server->running, 0);
+		return -1;
+	}
+
+	server->started = 1;
+	return 0;
+}
+
+//This function opens the Unix domain socket the metrics are served on, replacing whatever was left there by a
+//program that did not stop cleanly. Returns 0 on success and -1 on an error
+int openMetricsSocket(struct metricsServer* server)	{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	size_t length = strlen(server->socketName);
+	if(length >= sizeof(address.sun_path))
+		return -1;
+	memcpy(address.sun_path, server->socketName, length + 1);
+
+	server->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(server->listenFd < 0)
+		return -1;
+
+	unlink(server->socketName);
+
+	if(bind(server->listenFd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(server->listenFd, 8) < 0)	{
+		close(server->listenFd);
+		server->listenFd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+//This function hands the metrics server a copy of the metrics of a lane. Unless asked to wait, it gives up straight
+//away if the server is busy taking its own copy, so the state machine never waits on a scrape; the next copy is only
+//METRICS_PUBLISH_INTERVAL milliseconds away
+void publishMetrics(struct metricsServer* server, int lane, const struct pipelineMetrics* metrics, int wait)	{
+	if(!server->started)
+		return;
+
+	if(wait)
+		pthread_mutex_lock(&server->lock);
+	else if(pthread_mutex_trylock(&server->lock) != 0)
+		return;
+
+	server->published[lane] = *metrics;
+	pthread_mutex_unlock(&server->lock);
+}
+
+//This function formats the latest metrics handed to the server by every lane into its buffer. Returns the length of
+//the text
+size_t formatServerMetrics(struct metricsServer* server)	{
+	pthread_mutex_lock(&server->lock);
+	memcpy(server->snapshot, server->published, server->numLanes * sizeof(struct pipelineMetrics));
+	pthread_mutex_unlock(&server->lock);
+
+	return formatMetrics(server->buffer, sizeof(server->buffer), server->snapshot, server->numLanes, server->sampler);
+}
+
+//This function answers one scraper. Whatever it asks for, it gets the metrics as an HTTP response, so that both
+//Prometheus and curl --unix-socket can read them. A scraper that is too slow is given up on after
+//METRICS_SCRAPE_TIMEOUT milliseconds
+void serveScrape(struct metricsServer* server, int fd)	{
+	struct timeval timeout = { METRICS_SCRAPE_TIMEOUT / 1000, (METRICS_SCRAPE_TIMEOUT % 1000) * 1000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	//The request is read so that the scraper does not see the connection reset, but it is not looked at
+	char request[512];
+	struct pollfd waiting = { fd, POLLIN, 0 };
+	if(poll(&waiting, 1, METRICS_SCRAPE_TIMEOUT) > 0)
+		recv(fd, request, sizeof(request), MSG_DONTWAIT);
+
+	size_t length = formatServerMetrics(server);
+
+	char header[128];
+	int headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", length);
+
+	struct iovec response[2] = { { header, headerLength }, { server->buffer, length } };
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = response;
+	message.msg_iovlen = 2;
+
+	size_t left = headerLength + length;
+	while(left)	{
+		ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+			break;
+
+		//Move past whatever was sent
+		left -= sent;
+		while(message.msg_iovlen && (size_t)sent >= message.msg_iov->iov_len)	{
+			sent -= message.msg_iov->iov_len;
+			message.msg_iov++;
+			message.msg_iovlen--;
+		}
+		if(message.msg_iovlen)	{
+			message.msg_iov->iov_base = (char*)message.msg_iov->iov_base + sent;
+			message.msg_iov->iov_len -= sent;
+		}
+	}
+
+	close(fd);
+}
+
+//This is the metrics server thread. It waits for scrapers on the socket and writes the metrics file every
+//METRICS_INTERVAL seconds, and once more when it is stopped
+void* metricsServerMain(void* argument)	{
+	struct metricsServer* server = argument;
+	timestamp_ns nextWrite = getMonotonicTime();
+
+	while(atomic_load(&server->running))	{
+		//Sleep until a scraper turns up, it is time to write the file or the server is stopped
+		int timeoutMs = -1;
+		if(server->fileName[0])	{
+			timestamp_ns now = getMonotonicTime();
+			timeoutMs = (nextWrite > now) ? (nextWrite - now) / NS_PER_MS + 1 : 0;
+		}
+
+		struct pollfd waiting[2] = { { server->stopFd, POLLIN, 0 }, { server->listenFd, POLLIN, 0 } };
+		int ready = poll(waiting, 2, timeoutMs);
+
+		if(ready > 0 && (waiting[1].revents & POLLIN))	{
+			int fd;
+			while((fd = accept4(server->listenFd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+				serveScrape(server, fd);
+		}
+
+		if(server->fileName[0] && getMonotonicTime() >= nextWrite)	{
+			nextWrite += METRICS_INTERVAL * NS_PER_SECOND;
+
+			size_t length = formatServerMetrics(server);
+			if(writeMetricsFile(server->fileName, server->buffer, length) < 0)	{
+				char time[TIME_BUFFER_SIZE];
+				getTime(time);
+				PRINT_MSG(server->logFile, time, "metricsServer", SEVERITY_ERROR, "The metrics file could not be written, no more metrics will be written to it\n\n");
+				server->fileName[0] = 0;
+			}
+		}
+	}
+
+	//Leave the metrics of the whole run behind
+	if(server->fileName[0])	{
+		size_t length = formatServerMetrics(server);
+		writeMetricsFile(server->fileName, server->buffer, length);
+	}
+
+	return NULL;
+}
+
+//This function stops the metrics server, after the last of the metrics have been published to it, and removes its socket
+void stopMetricsServer(struct metricsServer* server)	{
+	if(server->started)	{
+		uint64_t one = 1;
+		atomic_store(&server->running, 0);
+		write(server->stopFd, &one, sizeof(one));
+		pthread_join(server->thread, NULL);
+		server->started = 0;
+	}
+
+	if(server->listenFd >= 0)	{
+		close(server->listenFd);
+		unlink(server->socketName);
+		server->listenFd = -1;
+	}
+
+	if(server->stopFd >= 0)	{
+		close(server->stopFd);
+		server->stopFd = -1;
+	}
+
+	pthread_mutex_destroy(&server->lock);
+}
+
+//This function reads back the people measured in an event log and checks them against the people who walked through,
+//who are put in the order they left. Every transit logged is matched, the way the tracker benchmark does it, to whoever
+//stopped breaking the far laser at the time it was reported. The times in the log are wall clock times, so they are
+//turned back the same way the event log turned them, less traceStart, when the people started walking on the virtual
+//clock. The person has to have left within PIPELINE_MATCH_TOLERANCE of it, have walked the same way, within
+//PIPELINE_SPEED_TOLERANCE of the speed logged, and not have been logged already. Returns the number of people not
+//logged at the speed they walked at, or not at all, and of the transits logged beyond one for each of them, and -1 if
+//the event log could not be read
+int checkLoggedSpeeds(const char* eventLogName, struct syntheticPerson* people, int numPeople, timestamp_ns traceStart)	{
+	FILE* eventLog = fopen(eventLogName, "rb");
+	char* logged = calloc(numPeople, 1);
+	struct speedlogHeader header;
+
+	if(!eventLog || !logged || fread(&header, sizeof(header), 1, eventLog) != 1 || header.recordSize != sizeof(struct speedlogRecord))	{
+		if(eventLog)
+			fclose(eventLog);
+		free(logged);
+		return -1;
+	}
+
+	qsort(people, numPeople, sizeof(struct syntheticPerson), comparePeopleLeaving);
+
+	struct timespec wallClock;
+	clock_gettime(CLOCK_REALTIME, &wallClock);
+	int64_t clockOffset = ((int64_t)wallClock.tv_sec * NS_PER_SECOND + wallClock.tv_nsec) - (int64_t)getMonotonicTime();
+
+	int numMeasured = 0;
+	int numCorrect = 0;
+	struct speedlogRecord record;
+
+	while(fread(&record, sizeof(record), 1, eventLog) == 1)	{
+		if(record.type != SPEEDLOG_TRANSIT)
+			continue;
+		numMeasured++;
+
+		//Whoever left closest to when the transit was reported
+		int64_t reported = (int64_t)record.timestamp - clockOffset - (int64_t)traceStart;
+		int first = 0, last = numPeople;
+		while(first < last)	{
+			int middle = (first + last) / 2;
+			if((int64_t)people[middle].leaving < reported)
+				first = middle + 1;
+			else
+				last = middle;
+		}
+
+		int next = first;
+		if(next > 0 && (next == numPeople || reported - (int64_t)people[next - 1].leaving < (int64_t)people[next].leaving - reported))
+			next--;
+
+		if(next < numPeople && !logged[next] && llabs(reported - (int64_t)people[next].leaving) <= PIPELINE_MATCH_TOLERANCE && people[next].direction == record.direction && fabs(record.speed - people[next].speed) <= PIPELINE_SPEED_TOLERANCE * people[next].speed)	{
+			logged[next] = 1;
+			numCorrect++;
+		}
+	}
+	fclose(eventLog);
+
+	free(logged);
+	return numPeople - numCorrect + (numMeasured > numPeople ? numMeasured - numPeople : 0);
+}
+
+//This function plays the trace of a replay backend back through the whole of measureSpeed, as the only lane, with a
+//logger writing to logFd and the given stats file and event log. The messages measureSpeed prints are thrown away while
+//it runs. The event log is closed and the stats file flushed once it is done. Returns how long it took, in seconds
+double replayPipeline(struct replayBackend* replay, const struct speedometerConfig* config, int logFd, FILE* statsFile, struct eventLog* eventLog, struct pipelineMetrics* metrics)	{
+	const uint32_t laneMasks[1] = { LASER_PIN_MASK };
+	static struct asyncLogger logger;
+	struct laserCapture capture;
+	struct samplerThread sampler;
+
+	startLogger(&logger, logFd, &config->logSettings);
+	openCapture(&capture, &replay->backend, LASER_PIN_MASK, 0);
+	initSampler(&sampler, &capture, -1, 0, laneMasks, 1);
+
+	fflush(stdout);
+	int console = dup(STDOUT_FILENO);
+	int devNull = open("/dev/null", O_WRONLY);
+	if(devNull >= 0)
+		dup2(devNull, STDOUT_FILENO);
+
+	timestamp_ns start = getMonotonicTime();
+	measureSpeed(&replay->backend, &sampler, 0, NULL, config, NULL, &logger, statsFile, eventLog, metrics, NULL);
+	closeEventLog(eventLog);
+	stopLogger(&logger);
+	fflush(statsFile);
+	double seconds = (double)(getMonotonicTime() - start) / NS_PER_SECOND;
+
+	fflush(stdout);
+	if(console >= 0)	{
+		dup2(console, STDOUT_FILENO);
+		close(console);
+	}
+	if(devNull >= 0)
+		close(devNull);
+
+	stopSampler(&sampler);
+	closeCapture(&capture);
+	return seconds;
+}
+
+//This function runs PIPELINE_BENCHMARK_PEOPLE people of synthetic traffic through the whole of measureSpeed, with
+//the tracker, the stats, the logger and the event log, on the virtual clock of a replay backend. The log, stats and
+//event log go to temporary files that are deleted afterwards, after checking that the event log has everyone at the
+//speed they walked at. It prints how it went and adds it to results as JSON. Returns 0 on success and -1 if it could
+//not be set up or someone was measured at the wrong speed
+int runPipelineScenario(double meanHeadway, double minSpeed, double maxSpeed, FILE* results)	{
+	struct speedometerConfig config;
+	defaultConfig(&config);
+	config.lanes[0].speedLimits[MOVING_RIGHT] = 2;
+	config.lanes[0].speedLimits[MOVING_LEFT] = 2;
+	config.logSettings.overflowPolicy = LOG_BLOCK_WHEN_FULL;
+
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+	static struct replayBackend replay;
+	initReplayBackend(&replay, LASER_PIN_MASK);
+
+	struct syntheticPerson* people = malloc(PIPELINE_BENCHMARK_PEOPLE * sizeof(struct syntheticPerson));
+	if(!people || loadSyntheticTrace(&replay, people, PIPELINE_BENCHMARK_PEOPLE, meanHeadway, minSpeed, maxSpeed, config.lanes[0].distance, laserMasks, 1) < 0)	{
+		printf("The pipeline benchmark could not be set up\n");
+		free(people);
+		return -1;
+	}
+
+	//Everything measureSpeed writes goes to temporary files, so that the bytes it writes can be counted
+	char logName[] = "/tmp/speedometer-log-XXXXXX";
+	char statsName[] = "/tmp/speedometer-stats-XXXXXX";
+	char eventLogName[] = "/tmp/speedometer-events-XXXXXX";
+	int logFd = mkstemp(logName);
+	int statsFd = mkstemp(statsName);
+	int eventFd = mkstemp(eventLogName);
+	FILE* statsFile = statsFd >= 0 ? fdopen(statsFd, "w") : NULL;
+
+	struct eventLog eventLog;
+	int result = -1;
+
+	if(logFd >= 0 && statsFile && eventFd >= 0 && openEventLog(&eventLog, eventLogName, 0, config.logSettings.overflowPolicy) == 0)	{
+		struct pipelineMetrics metrics;
+		memset(&metrics, 0, sizeof(metrics));
+
+		double seconds = replayPipeline(&replay, &config, logFd, statsFile, &eventLog, &metrics);
+
+		//The bytes written for every person measured
+		struct stat fileInfo;
+		double transits = metrics.transits ? metrics.transits : 1;
+		double logBytes = fstat(logFd, &fileInfo) == 0 ? fileInfo.st_size / transits : 0;
+		double statsBytes = fstat(statsFd, &fileInfo) == 0 ? fileInfo.st_size / transits : 0;
+		double eventBytes = stat(eventLogName, &fileInfo) == 0 ? fileInfo.st_size / transits : 0;
+
+		printf("Pipeline, one person every %.2f s at %.1f to %.1f m/s: %llu transits in %.3f s (%.0f transits/s), edge to decision 50%% under %.1f us and 99%% under %.1f us, loop jitter %.1f us, %.1f bytes written a transit\n", meanHeadway, minSpeed, maxSpeed, (unsigned long long)metrics.transits, seconds, metrics.transits / seconds, latencyPercentile(&metrics.decisionLatency, 50) / 1000.0, latencyPercentile(&metrics.decisionLatency, 99) / 1000.0, loopJitter(&metrics) / 1000.0, logBytes + statsBytes + eventBytes);
+
+		int wrongSpeeds = checkLoggedSpeeds(eventLogName, people, PIPELINE_BENCHMARK_PEOPLE, replay.startTime);
+		if(wrongSpeeds == 0)
+			printf("    Everyone was logged within %.2f%% of the speed they walked at\n", PIPELINE_SPEED_TOLERANCE * 100);
+		else if(wrongSpeeds > 0)
+			printf("    FAILED: %d of %d people logged at the wrong speed or missing\n", wrongSpeeds, PIPELINE_BENCHMARK_PEOPLE);
+		else
+			printf("    FAILED: the event log could not be read back\n");
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"pipeline\", \"headway_s\": %.2f, \"min_speed\": %.2f, \"max_speed\": %.2f, \"people\": %d, \"edges\": %llu, \"transits\": %llu, \"wrong_speeds\": %d, \"seconds\": %.6f, \"transits_per_s\": %.0f, \"decision_latency_ns\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu}, \"loop_period_ns\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu}, \"loop_jitter_ns\": %.0f, \"bytes_per_transit\": {\"log\": %.1f, \"stats\": %.1f, \"events\": %.1f, \"total\": %.1f}}\n",
+				meanHeadway, minSpeed, maxSpeed, PIPELINE_BENCHMARK_PEOPLE, (unsigned long long)metrics.edges, (unsigned long long)metrics.transits, wrongSpeeds, seconds, metrics.transits / seconds,
+				(unsigned long long)latencyPercentile(&metrics.decisionLatency, 50), (unsigned long long)latencyPercentile(&metrics.decisionLatency, 90), (unsigned long long)latencyPercentile(&metrics.decisionLatency, 99), (unsigned long long)metrics.decisionLatency.max,
+				(unsigned long long)latencyPercentile(&metrics.loopPeriod, 50), (unsigned long long)latencyPercentile(&metrics.loopPeriod, 99), (unsigned long long)metrics.loopPeriod.max, loopJitter(&metrics),
+				logBytes, statsBytes, eventBytes, logBytes + statsBytes + eventBytes);
+
+		result = wrongSpeeds == 0 ? 0 : -1;
+	}
+	else
+		printf("The pipeline benchmark could not be set up\n");
+
+	if(statsFile)
+		fclose(statsFile);
+	else if(statsFd >= 0)
+		close(statsFd);
+	if(logFd >= 0)
+		close(logFd);
+	if(eventFd >= 0)
+		close(eventFd);
+
+	unlink(logName);
+	unlink(statsName);
+	unlink(eventLogName);
+	freeReplayBackend(&replay);
+	free(people);
+
+	return result;
+}
+
+//This function runs the pipeline benchmark on quiet, busy and packed halls, of walkers and of runners. Returns 0 if
+//everyone was measured at the speed they walked at in all of them and -1 otherwise
+int runPipelineBenchmark(FILE* results)	{
+	const double headways[] = { 4.0, 1.0, 0.25 };
+	const double speeds[2][2] = { { SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED }, { 2.5, 6.0 } };
+	int failed = 0;
+
+	for(int i = 0; i < (int)(sizeof(headways) / sizeof(headways[0])); i++)	{
+		for(int j = 0; j < 2; j++)
+			failed |= runPipelineScenario(headways[i], speeds[j][0], speeds[j][1], results) < 0;
+	}
+
+	runInstrumentationBenchmark(results);
+	return failed ? -1 : 0;
+}
+
+//This function plays a busy hall of walkers back through the whole of measureSpeed with the loop timing itself and
+//without, INSTRUMENTATION_BENCHMARK_RUNS times each, to find what the loop period, busy time and decision latency
+//cost. The log and stats go to /dev/null and there is no event log, and it is the CPU time of the thread running the
+//loop that is compared, so that the logger's thread does not get counted. The fastest run of each is compared
+void runInstrumentationBenchmark(FILE* results)	{
+	struct speedometerConfig config;
+	defaultConfig(&config);
+	config.lanes[0].speedLimits[MOVING_RIGHT] = 2;
+	config.lanes[0].speedLimits[MOVING_LEFT] = 2;
+
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+	static struct replayBackend replay;
+	double fastest[2] = { 0, 0 };
+	uint64_t transits = 0;
+
+	for(int run = 0; run < 2 * INSTRUMENTATION_BENCHMARK_RUNS; run++)	{
+		int untimed = run % 2;
+		initReplayBackend(&replay, LASER_PIN_MASK);
+
+		struct eventLog eventLog;
+		int logFd = open("/dev/null", O_WRONLY);
+		FILE* statsFile = fopen("/dev/null", "w");
+
+		if(loadSyntheticTrace(&replay, NULL, PIPELINE_BENCHMARK_PEOPLE, 1.0, SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, config.lanes[0].distance, laserMasks, 1) < 0 || logFd < 0 || !statsFile || openEventLog(&eventLog, "", 0, config.logSettings.overflowPolicy) < 0)	{
+			printf("The instrumentation benchmark could not be set up\n");
+			if(logFd >= 0)
+				close(logFd);
+			if(statsFile)
+				fclose(statsFile);
+			freeReplayBackend(&replay);
+			return;
+		}
+
+		struct pipelineMetrics metrics;
+		memset(&metrics, 0, sizeof(metrics));
+		metrics.untimed = untimed;
+
+		struct timespec cpuStart;
+		struct timespec cpuEnd;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+		replayPipeline(&replay, &config, logFd, statsFile, &eventLog, &metrics);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+
+		double seconds = (cpuEnd.tv_sec - cpuStart.tv_sec) + (double)(cpuEnd.tv_nsec - cpuStart.tv_nsec) / NS_PER_SECOND;
+		if(!fastest[untimed] || seconds < fastest[untimed])
+			fastest[untimed] = seconds;
+		transits = metrics.transits;
+
+		fclose(statsFile);
+		close(logFd);
+		freeReplayBackend(&replay);
+	}
+
+	double overhead = (fastest[0] / fastest[1] - 1) * 100;
+	printf("Instrumentation, one person every 1.00 s: %.0f transits/s timing the loop and %.0f without, %.1f%% slower timing it\n", transits / fastest[0], transits / fastest[1], overhead);
+
+	if(results)
+		fprintf(results, "{\"benchmark\": \"instrumentation\", \"transits\": %llu, \"timed_transits_per_s\": %.0f, \"untimed_transits_per_s\": %.0f, \"overhead_percent\": %.2f}\n", (unsigned long long)transits, transits / fastest[0], transits / fastest[1], overhead);
+}
+
+//This function checks the writes to an LED against the ones it should have had, which must all be within
+//LED_BENCHMARK_TOLERANCE of their time. Returns 1 if they match and 0 otherwise
+int checkLedWrites(const struct ledWrite* writes, int numWrites, const struct ledWrite* expected, int numExpected)	{
+	if(numWrites != numExpected)
+		return 0;
+
+	for(int i = 0; i < numWrites; i++)	{
+		timestamp_ns error = writes[i].timestamp > expected[i].timestamp ? writes[i].timestamp - expected[i].timestamp : expected[i].timestamp - writes[i].timestamp;
+		if(writes[i].on != expected[i].on || error > LED_BENCHMARK_TOLERANCE)
+			return 0;
+	}
+
+	return 1;
+}
+
+//This function walks LED_BENCHMARK_PEOPLE people through the whole of measureSpeed on the virtual clock of a replay
+//backend, half of them over the speed limit, and reads the warning LED back from the LED recorder. The LED has to come
+//on as someone steps into the hall and go off as they reach the far laser, and for everyone who was speeding it then
+//has to blink WARNING_BLINKS times, on and off for WARNING_BLINK_PERIOD each time, after they have left. It prints how
+//it went and adds it to results as JSON. Returns 0 on success and -1 if it could not be set up or the LED was wrong
+int runLedBenchmark(FILE* results)	{
+	struct speedometerConfig config;
+	defaultConfig(&config);
+	config.lanes[0].speedLimits[MOVING_RIGHT] = 2;
+	config.lanes[0].speedLimits[MOVING_LEFT] = 2;
+
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+	const int warningLedPin = config.lanes[0].warningLedPin;
+	const double distance = config.lanes[0].distance;
+	static struct replayBackend replay;
+	initReplayBackend(&replay, LASER_PIN_MASK);
+
+	//Walkers and runners, each way. Everyone breaks the laser they come in through, then the one they leave through,
+	//for as long as it takes them to walk PERSON_DEPTH
+	size_t capacity = 0;
+	uint32_t levels = LASER_PIN_MASK;
+	int failed = 0;
+
+	for(int i = 0; i < LED_BENCHMARK_PEOPLE && !failed; i++)	{
+		int entering = i % 2;
+		double speed = (i / 2) % 2 ? 4.0 : 1.0;
+		timestamp_ns start = replay.startTime + (timestamp_ns)(i + 1) * LED_BENCHMARK_HEADWAY * NS_PER_SECOND;
+		timestamp_ns blocking = PERSON_DEPTH / speed * NS_PER_SECOND;
+		timestamp_ns walk = distance / speed * NS_PER_SECOND;
+
+		failed |= addReplayEdge(&replay, &capacity, start, levels &= ~laserMasks[entering]) < 0;
+		failed |= addReplayEdge(&replay, &capacity, start + blocking, levels |= laserMasks[entering]) < 0;
+		failed |= addReplayEdge(&replay, &capacity, start + walk, levels &= ~laserMasks[!entering]) < 0;
+		failed |= addReplayEdge(&replay, &capacity, start + walk + blocking, levels |= laserMasks[!entering]) < 0;
+	}
+
+	//The replay stops at the last edge, so the trace ends with one that changes nothing a headway later, to play back the
+	//blinking of the last person too
+	failed |= addReplayEdge(&replay, &capacity, replay.startTime + (timestamp_ns)(LED_BENCHMARK_PEOPLE + 1) * LED_BENCHMARK_HEADWAY * NS_PER_SECOND, levels) < 0;
+
+	//Everything measureSpeed writes is thrown away
+	struct eventLog eventLog;
+	int logFd = open("/dev/null", O_WRONLY);
+	FILE* statsFile = fopen("/dev/null", "w");
+
+	if(failed || logFd < 0 || !statsFile || openEventLog(&eventLog, "", 0, config.logSettings.overflowPolicy) < 0)	{
+		printf("The LED benchmark could not be set up\n");
+		if(logFd >= 0)
+			close(logFd);
+		if(statsFile)
+			fclose(statsFile);
+		freeReplayBackend(&replay);
+		return -1;
+	}
+
+	struct pipelineMetrics metrics;
+	memset(&metrics, 0, sizeof(metrics));
+
+	replayPipeline(&replay, &config, logFd, statsFile, &eventLog, &metrics);
+	fclose(statsFile);
+	close(logFd);
+
+	//The writes to the warning LED, in the order they were made. LED_BENCHMARK_PEOPLE is small enough for the recorder
+	//to keep every one of them
+	struct ledWrite writes[LED_RECORDER_SIZE];
+	int numWrites = 0;
+	int wrongPeople = 0;
+	int blinks = 0;
+
+	for(int i = 0; i < (int)replay.leds.numWrites && i < LED_RECORDER_SIZE; i++)	{
+		if(replay.leds.writes[i].pin == warningLedPin)
+			writes[numWrites++] = replay.leds.writes[i];
+	}
+
+	//Everyone's writes are the ones from when they came in until the next person did
+	for(int i = 0, first = 0; i < LED_BENCHMARK_PEOPLE; i++)	{
+		const struct laserEvent* edges = &replay.edges[4 * i];
+		timestamp_ns nextStart = i + 1 < LED_BENCHMARK_PEOPLE ? edges[4].timestamp : UINT64_MAX;
+		int last = first;
+
+		while(last < numWrites && writes[last].timestamp < nextStart)
+			last++;
+
+		struct ledWrite expected[2 + 2 * WARNING_BLINKS];
+		int numExpected = 0;
+		int speeding = (i / 2) % 2;
+		expected[numExpected++] = (struct ledWrite){ edges[1].timestamp, warningLedPin, 1 };
+		expected[numExpected++] = (struct ledWrite){ edges[2].timestamp, warningLedPin, 0 };
+
+		//The blinking starts whenever the tracker reports them, which has to be once they have left
+		if(speeding)	{
+			timestamp_ns blinkStart = edges[3].timestamp;
+			if(last - first > 2 && writes[first + 2].timestamp > blinkStart)
+				blinkStart = writes[first + 2].timestamp;
+
+			for(int blink = 0; blink < 2 * WARNING_BLINKS; blink++)
+				expected[numExpected++] = (struct ledWrite){ blinkStart + blink * WARNING_BLINK_PERIOD, warningLedPin, !(blink % 2) };
+		}
+
+		if(checkLedWrites(&writes[first], last - first, expected, numExpected))
+			blinks += speeding ? WARNING_BLINKS : 0;
+		else
+			wrongPeople++;
+		first = last;
+	}
+
+	printf("LEDs, %d people one every %d s: the warning LED was switched %d times and blinked %d times\n", LED_BENCHMARK_PEOPLE, LED_BENCHMARK_HEADWAY, numWrites, blinks);
+	if(wrongPeople)
+		printf("    FAILED: the warning LED was wrong for %d of %d people\n", wrongPeople, LED_BENCHMARK_PEOPLE);
+	else
+		printf("    The warning LED was on while everyone was in the hall and blinked %d times within %.1f ms for every speeder\n", WARNING_BLINKS, (double)LED_BENCHMARK_TOLERANCE / NS_PER_MS);
+
+	if(results)
+		fprintf(results, "{\"benchmark\": \"leds\", \"people\": %d, \"writes\": %d, \"blinks\": %d, \"wrong_people\": %d}\n", LED_BENCHMARK_PEOPLE, numWrites, blinks, wrongPeople);
+
+	freeReplayBackend(&replay);
+	return wrongPeople ? -1 : 0;
+}
+
+//This function measures the stream capture. The edge scanner is timed on a synthetic buffer whose other pins change
+//on every sample, against looking at one sample at a time, and synthetic traffic is then sampled into a stream and
+//scanned back, to check that every edge comes out at the first sample after it
+void runStreamBenchmark(FILE* results)	{
+	const size_t numSamples = STREAM_BENCHMARK_SAMPLES;
+	const size_t spacings[] = { 50000, 1000, 16 };
+
+	uint32_t* samples = aligned_alloc(64, numSamples * sizeof(uint32_t));
+	if(!samples)	{
+		printf("The stream benchmark could not be set up\n");
+		return;
+	}
+
+	for(int i = 0; i < (int)(sizeof(spacings) / sizeof(spacings[0])); i++)	{
+		//A laser changes every spacing samples, while the LEDs and the pins nobody uses flicker all the time
+		unsigned int seed = 1;
+		uint32_t levels = LASER_PIN_MASK;
+		size_t expected = 0;
+
+		for(size_t j = 0; j < numSamples; j++)	{
+			if(j && j % spacings[i] == 0)
+				levels ^= (expected++ & 1) ? LASER2_MASK : LASER1_MASK;
+			samples[j] = levels | ((uint32_t)rand_r(&seed) & ~LASER_PIN_MASK);
+		}
+
+		size_t found = 0;
+		uint32_t previous = LASER_PIN_MASK;
+		timestamp_ns start = getMonotonicTime();
+
+		for(size_t j = 0; j < numSamples; )	{
+			size_t edge = findEdge(&samples[j], numSamples - j, previous, LASER_PIN_MASK);
+			if(edge == numSamples - j)
+				break;
+
+			previous = samples[j + edge];
+			found++;
+			j += edge + 1;
+		}
+
+		timestamp_ns scanTime = getMonotonicTime() - start;
+
+		//The same scan a sample at a time, the way the polling loop looks at the level register
+		size_t naiveFound = 0;
+		previous = LASER_PIN_MASK;
+		start = getMonotonicTime();
+
+		for(size_t j = 0; j < numSamples; j++)	{
+			if((samples[j] ^ previous) & LASER_PIN_MASK)	{
+				naiveFound++;
+				previous = samples[j];
+			}
+		}
+
+		timestamp_ns naiveTime = getMonotonicTime() - start;
+
+		double scanRate = numSamples / ((double)scanTime / NS_PER_SECOND);
+		double naiveRate = numSamples / ((double)naiveTime / NS_PER_SECOND);
+		printf("Edge scanner, an edge every %zu samples: %zu of %zu edges found in %zu samples, %.0f Msamples/s (a sample at a time %.0f Msamples/s, %zu found)\n", spacings[i], found, expected, numSamples, scanRate / 1e6, naiveRate / 1e6, naiveFound);
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"edge_scanner\", \"spacing\": %zu, \"samples\": %zu, \"edges\": %zu, \"found\": %zu, \"samples_per_s\": %.0f, \"naive_samples_per_s\": %.0f}\n", spacings[i], numSamples, expected, found, scanRate, naiveRate);
+
+		//The same samples through the edge detector, in batches, and through the one pin at a time version of it. Both
+		//must find the same edges, with the same pins rising and falling, and the same first edge of every pin
+		size_t (*const detectors[2])(const uint32_t*, size_t, uint32_t, uint32_t, struct edgeBatch*) = { detectEdges, detectEdgesScalar };
+		size_t batchFound[2] = { 0, 0 };
+		uint64_t checksums[2] = { 0, 0 };
+		timestamp_ns batchTimes[2];
+
+		for(int k = 0; k < 2; k++)	{
+			struct edgeBatch batch;
+			previous = LASER_PIN_MASK;
+			start = getMonotonicTime();
+
+			for(size_t j = 0; j < numSamples; )	{
+				size_t scanned = detectors[k](&samples[j], numSamples - j, previous, LASER_PIN_MASK, &batch);
+
+				for(size_t e = 0; e < batch.numEdges; e++)
+					checksums[k] = checksums[k] * 31 + (j + batch.samples[e]) * 7 + batch.rising[e] * 3 + batch.falling[e];
+				for(uint32_t pins = batch.changedPins; pins; pins &= pins - 1)
+					checksums[k] = checksums[k] * 31 + j + batch.firstEdges[__builtin_ctz(pins)];
+
+				batchFound[k] += batch.numEdges;
+				previous = samples[j + scanned - 1];
+				j += scanned;
+			}
+
+			batchTimes[k] = getMonotonicTime() - start;
+		}
+
+		double batchRate = numSamples / ((double)batchTimes[0] / NS_PER_SECOND);
+		double scalarRate = numSamples / ((double)batchTimes[1] / NS_PER_SECOND);
+		int agree = batchFound[0] == batchFound[1] && checksums[0] == checksums[1];
+		printf("Edge detector (%s), an edge every %zu samples: %zu of %zu edges found, %.0f Msamples/s (one pin at a time %.0f Msamples/s, %zu found), %s\n", EDGE_KERNEL, spacings[i], batchFound[0], expected, batchRate / 1e6, scalarRate / 1e6, batchFound[1], agree ? "the same edges" : "DIFFERENT EDGES");
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"edge_detector\", \"kernel\": \"%s\", \"spacing\": %zu, \"samples\": %zu, \"edges\": %zu, \"found\": %zu, \"samples_per_s\": %.0f, \"scalar_samples_per_s\": %.0f, \"scalar_found\": %zu, \"agree\": %s}\n", EDGE_KERNEL, spacings[i], numSamples, expected, batchFound[0], batchRate, scalarRate, batchFound[1], agree ? "true" : "false");
+	}
+
+	free(samples);
+
+	//Synthetic traffic is sampled into a stream a block at a time, as the streamer thread would, and every block is
+	//scanned before the next is written, so the stream wraps around many times
+	static struct replayBackend replay;
+	struct sampleStream stream;
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+	initReplayBackend(&replay, LASER_PIN_MASK);
+
+	timestamp_ns period = NS_PER_SECOND / STREAM_BENCHMARK_RATE;
+	if(loadSyntheticTrace(&replay, NULL, STREAM_BENCHMARK_PEOPLE, SIMULATION_HEADWAY, SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, DEFAULT_LASER_DISTANCE, laserMasks, 1) < 0 || initStream(&stream, STREAM_SAMPLES, period) < 0)	{
+		printf("The stream benchmark could not be set up\n");
+		freeReplayBackend(&replay);
+		return;
+	}
+
+	struct laserCapture capture;
+	openStreamCapture(&capture, &stream, LASER_PIN_MASK, LASER_PIN_MASK);
+
+	size_t nextEdge = 0;
+	size_t checkedEdge = 0;
+	size_t found = 0;
+	size_t wrong = 0;
+	uint32_t levels = LASER_PIN_MASK;
+	timestamp_ns sampleTime = replay.startTime;
+	timestamp_ns worstError = 0;
+	timestamp_ns scanTime = 0;
+
+	while(nextEdge < replay.numEdges)	{
+		uint32_t* block = streamBlock(&stream);
+		timestamp_ns firstTime = sampleTime;
+
+		for(int i = 0; i < STREAM_BLOCK_SAMPLES; i++)	{
+			while(nextEdge < replay.numEdges && replay.edges[nextEdge].timestamp <= sampleTime)
+				levels = replay.edges[nextEdge++].levels;
+
+			block[i] = levels;
+			sampleTime += period;
+		}
+
+		publishStreamBlock(&stream, firstTime, sampleTime - period);
+
+		//Every edge that comes out must be the levels of the trace at the first sample after its edge
+		struct laserEvent event;
+		timestamp_ns start = getMonotonicTime();
+
+		while(streamNextEvent(&capture, &event, 0) > 0)	{
+			while(checkedEdge < replay.numEdges && replay.edges[checkedEdge].timestamp <= event.timestamp)
+				checkedEdge++;
+
+			timestamp_ns error = checkedEdge ? event.timestamp - replay.edges[checkedEdge - 1].timestamp : period;
+			if(error >= period || replay.edges[checkedEdge - 1].levels != event.levels)
+				wrong++;
+			else if(error > worstError)
+				worstError = error;
+
+			found++;
+		}
+
+		scanTime += getMonotonicTime() - start;
+	}
+
+	size_t streamed = atomic_load(&stream.head);
+	printf("Stream capture at %d samples/s: %zu edges of the trace, %zu found and %zu wrong, timed at most %.1f us after the trace, %zu samples scanned at %.0f Msamples/s\n", STREAM_BENCHMARK_RATE, replay.numEdges, found, wrong, (double)worstError / 1000, streamed, scanTime ? streamed / ((double)scanTime / NS_PER_SECOND) / 1e6 : 0);
+
+	if(results)
+		fprintf(results, "{\"benchmark\": \"stream_capture\", \"rate\": %d, \"edges\": %zu, \"found\": %zu, \"wrong\": %zu, \"worst_error_ns\": %llu, \"samples\": %zu, \"seconds\": %.6f}\n", STREAM_BENCHMARK_RATE, replay.numEdges, found, wrong, (unsigned long long)worstError, streamed, (double)scanTime / NS_PER_SECOND);
+
+	freeStream(&stream);
+	freeReplayBackend(&replay);
+}
+
+//This function gives the levels of the lasers of a replay backend at the real time instead of on its virtual clock,
+//playing back every edge of the trace up to now, so that the trace can be polled the way the lasers are
+uint32_t liveReadLevels(struct gpioBackend* backend)	{
+	struct replayBackend* replay = (struct replayBackend*)backend;
+
+	replay->now = getMonotonicTime();
+	while(replay->nextEdge < replay->numEdges && replay->edges[replay->nextEdge].timestamp <= replay->now)
+		replay->levels = replay->edges[replay->nextEdge++].levels;
+
+	return replay->levels;
+}
+
+//This function polls a few people walking through the hall, played back on the real clock, reading the level register
+//every millisecond all the time and then less often while nobody is in the hall, sleeping or spinning between the reads
+//while someone is. The tracker tells the sampler when the hall is not empty, the same as the state machine does. It
+//reports the edges found and how late they were timed, the share of the time spent at the active rate, how late the
+//sampler woke up and the CPU time it used
+void runPollBenchmark(FILE* results)	{
+	const uint32_t laserMasks[2] = { LASER1_MASK, LASER2_MASK };
+	const struct { const char* name; float idlePeriod; int spin; } runs[] = {
+		{ "every 1 ms", POLL_PERIOD_US, 0 },
+		{ "adaptive", POLL_BENCHMARK_IDLE_US, 0 },
+		{ "adaptive, spinning", POLL_BENCHMARK_IDLE_US, 1 }
+	};
+	double fixedCpuTime = 0;
+
+	for(int run = 0; run < (int)(sizeof(runs) / sizeof(runs[0])); run++)	{
+		static struct replayBackend replay;
+		initReplayBackend(&replay, LASER_PIN_MASK);
+
+		if(loadSyntheticTrace(&replay, NULL, POLL_BENCHMARK_PEOPLE, POLL_BENCHMARK_HEADWAY, SYNTHETIC_MIN_SPEED, SYNTHETIC_MAX_SPEED, POLL_BENCHMARK_DISTANCE, laserMasks, 1) < 0)	{
+			printf("The poll benchmark could not be set up\n");
+			freeReplayBackend(&replay);
+			return;
+		}
+
+		//The trace is polled on the real clock, so it has no edges of its own to hand out
+		replay.backend.readLevels = liveReadLevels;
+		replay.backend.nextEdge = NULL;
+
+		struct laserCapture capture;
+		openCapture(&capture, &replay.backend, LASER_PIN_MASK, 1);
+		setPollRates(&capture, runs[run].idlePeriod, POLL_PERIOD_US, runs[run].spin);
+
+		struct samplerThread sampler;
+		initSampler(&sampler, &capture, -1, 0, laserMasks, 1);
+
+		struct transitTracker tracker;
+		initTracker(&tracker, POLL_BENCHMARK_DISTANCE, laserMasks, LASER_PIN_MASK);
+
+		size_t checkedEdge = 0;
+		size_t found = 0;
+		timestamp_ns totalError = 0;
+		timestamp_ns worstError = 0;
+		struct timespec cpuStart;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+
+		//Carry on for a moment after the last edge, so that the tracker sees the hall empty again
+		while(replay.nextEdge < replay.numEdges || trackerHallState(&tracker) != HALL_EMPTY)	{
+			struct laserEvent event;
+			int captured = pollNextEvent(&capture, &event, CAPTURE_TIMEOUT_MS);
+
+			if(captured)	{
+				while(checkedEdge < replay.numEdges && replay.edges[checkedEdge].timestamp <= event.timestamp)
+					checkedEdge++;
+
+				timestamp_ns error = event.timestamp - replay.edges[checkedEdge - 1].timestamp;
+				totalError += error;
+				if(error > worstError)
+					worstError = error;
+				found++;
+			}
+
+			struct trackerReport reports[MAX_TRACKER_REPORTS];
+			trackEvent(&tracker, &event, reports, MAX_TRACKER_REPORTS);
+			setLaneBusy(&sampler, 0, trackerHallState(&tracker) != HALL_EMPTY);
+		}
+
+		struct timespec cpuEnd;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+		double cpuTime = (double)(cpuEnd.tv_sec - cpuStart.tv_sec) * NS_PER_SECOND + (cpuEnd.tv_nsec - cpuStart.tv_nsec);
+		if(run == 0)
+			fixedCpuTime = cpuTime;
+
+		double idleTime = atomic_load(&capture.idleTime);
+		double activeTime = atomic_load(&capture.activeTime);
+		double dutyCycle = 100.0 * activeTime / (idleTime + activeTime);
+		unsigned long long wakeups = atomic_load(&capture.wakeups);
+		double wakeLatency = wakeups ? (double)atomic_load(&capture.wakeLatency) / wakeups : 0;
+
+		printf("Polling %s, %d people: %zu of %zu edges found, timed %.1f us late on average and %.1f us at the most, %llu reads, %.1f%% of the time at the active rate, waking up %.1f us late on average and %.1f us at the most, %.1f ms of CPU, %.0f%% of what reading every 1 ms took\n", runs[run].name, POLL_BENCHMARK_PEOPLE, found, replay.numEdges, found ? (double)totalError / found / 1000 : 0, (double)worstError / 1000, (unsigned long long)atomic_load(&capture.polls), dutyCycle, wakeLatency / 1000, (double)atomic_load(&capture.longestWakeLatency) / 1000, cpuTime / NS_PER_MS, fixedCpuTime ? 100.0 * cpuTime / fixedCpuTime : 0);
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"poll_scheduler\", \"mode\": \"%s\", \"idle_period_us\": %.0f, \"active_period_us\": %d, \"edges\": %zu, \"found\": %zu, \"mean_error_ns\": %.0f, \"worst_error_ns\": %llu, \"polls\": %llu, \"duty_cycle\": %.4f, \"mean_wake_latency_ns\": %.0f, \"worst_wake_latency_ns\": %llu, \"cpu_seconds\": %.6f}\n", runs[run].name, runs[run].idlePeriod, POLL_PERIOD_US, replay.numEdges, found, found ? (double)totalError / found : 0, (unsigned long long)worstError, (unsigned long long)atomic_load(&capture.polls), dutyCycle / 100, wakeLatency, (unsigned long long)atomic_load(&capture.longestWakeLatency), cpuTime / NS_PER_SECOND);
+
+		stopSampler(&sampler);
+		freeReplayBackend(&replay);
+	}
+}
+
+//This is the thread of one run of the jitter benchmark. It wakes up JITTER_BENCHMARK_WAKEUPS times, every
+//JITTER_BENCHMARK_PERIOD_US, sleeping the way the run asks for, and counts how late every wake-up was
+void* jitterBenchmarkThread(void* argument)	{
+	struct jitterRun* run = argument;
+	const timestamp_ns period = JITTER_BENCHMARK_PERIOD_US * 1000ULL;
+
+	if(makeRealtime(run->cpu, run->mode == JITTER_REALTIME ? JITTER_BENCHMARK_PRIORITY : 0) < 0)	{
+		run->realtime = -1;
+		return NULL;
+	}
+
+	timestamp_ns last = getMonotonicTime();
+	timestamp_ns due = last + period;
+
+	for(int i = 0; i < JITTER_BENCHMARK_WAKEUPS; i++)	{
+		if(run->mode == JITTER_USLEEP)
+			usleep(JITTER_BENCHMARK_PERIOD_US);
+		else	{
+			struct timespec wakeup = { due / NS_PER_SECOND, due % NS_PER_SECOND };
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR)
+				;
+		}
+
+		timestamp_ns now = getMonotonicTime();
+		addLatency(&run->lateness, now > due ? now - due : 0);
+		run->periodSum += now - last;
+		run->periodSquares += (double)(now - last) * (now - last);
+		last = now;
+
+		//usleep sleeps from whenever it is called, so its next wake-up is meant for a period after this one, while the
+		//grid stays where it is
+		due = (run->mode == JITTER_USLEEP) ? now + period : due + period;
+	}
+
+	return NULL;
+}
+
+//This is the thread that keeps the CPU of a run of the jitter benchmark busy, at normal priority, until it is told to
+//stop
+void* jitterLoadThread(void* argument)	{
+	struct jitterRun* run = argument;
+	makeRealtime(run->cpu, 0);
+
+	while(atomic_load_explicit(&run->loading, memory_order_relaxed))
+		;
+
+	return NULL;
+}
+
+//This function compares how evenly a thread wakes up every millisecond sleeping with usleep after every wake-up, the
+//way the polling loop used to, until the next time on a grid with clock_nanosleep, and the same at real-time priority
+//with the memory of the program locked, the way -P runs the sampler. Every way is run on its own and then next to a
+//thread that spins on the same CPU. It reports the average time between the wake-ups, its jitter and how late they were
+void runJitterBenchmark(FILE* results)	{
+	const char* const modeNames[JITTER_MODES] = { "usleep", "clock_nanosleep", "clock_nanosleep at real-time priority" };
+	const char* const modeKeys[JITTER_MODES] = { "usleep", "absolute", "realtime" };
+	int cpu = sched_getcpu();
+
+	for(int loaded = 0; loaded < 2; loaded++)	{
+		for(int mode = 0; mode < JITTER_MODES; mode++)	{
+			static struct jitterRun run;
+			memset(&run, 0, sizeof(run));
+			run.mode = mode;
+			run.cpu = cpu;
+
+			int locked = mode == JITTER_REALTIME && mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+
+			pthread_t load;
+			int loadStarted = 0;
+			if(loaded)	{
+				atomic_store(&run.loading, 1);
+				loadStarted = pthread_create(&load, NULL, jitterLoadThread, &run) == 0;
+			}
+
+			pthread_t thread;
+			if(pthread_create(&thread, NULL, jitterBenchmarkThread, &run) == 0)
+				pthread_join(thread, NULL);
+
+			atomic_store(&run.loading, 0);
+			if(loadStarted)
+				pthread_join(load, NULL);
+			if(locked)
+				munlockall();
+
+			if(run.realtime < 0 || !run.lateness.count)	{
+				printf("Sleeping with %s%s: could not be run, real-time priority needs the benchmarks to be run as root\n", modeNames[mode], loaded ? " next to a busy thread" : "");
+				continue;
+			}
+
+			double count = run.lateness.count;
+			double meanPeriod = run.periodSum / count;
+			double jitter = sqrt(fmax(run.periodSquares / count - meanPeriod * meanPeriod, 0));
+
+			printf("Sleeping with %s%s: %llu wake-ups %.1f us apart on average, with %.1f us of jitter, woken up 50%% under %.1f us late, 99%% under %.1f us and %.1f us at the most\n", modeNames[mode], loaded ? " next to a busy thread" : "", (unsigned long long)run.lateness.count, meanPeriod / 1000, jitter / 1000, latencyPercentile(&run.lateness, 50) / 1000.0, latencyPercentile(&run.lateness, 99) / 1000.0, run.lateness.max / 1000.0);
+
+			if(results)
+				fprintf(results, "{\"benchmark\": \"jitter\", \"mode\": \"%s\", \"loaded\": %s, \"memory_locked\": %s, \"wakeups\": %llu, \"period_ns\": %d, \"mean_period_ns\": %.0f, \"jitter_ns\": %.0f, \"p50_late_ns\": %llu, \"p99_late_ns\": %llu, \"max_late_ns\": %llu}\n", modeKeys[mode], loaded ? "true" : "false", locked ? "true" : "false", (unsigned long long)run.lateness.count, JITTER_BENCHMARK_PERIOD_US * 1000, meanPeriod, jitter, (unsigned long long)latencyPercentile(&run.lateness, 50), (unsigned long long)latencyPercentile(&run.lateness, 99), (unsigned long long)run.lateness.max);
+		}
+	}
+}
+
+//This function works out the speed, in m/s, of a person who broke the first laser at enteringTime and the
+//second one at exitingTime. Both times are taken at the leading edge of the person, so the length of their
+//body does not end up in the travel time. Returns -1 if the times cannot belong to a real person
+float computeSpeed(float distance, timestamp_ns enteringTime, timestamp_ns exitingTime)	{
+	if(exitingTime <= enteringTime)
+		return -1;
+
+	double travelTime = (double)(exitingTime - enteringTime) / NS_PER_SECOND;
+
+	return distance / travelTime;
+}
+
+//This function adds a walk-through made at speed, in m/s, to a calibration run. travelTime is the one measured by the
+//tracker, with the latencies of the lasers, in microseconds, already taken off, so they are put back on. That way the
+//run is not thrown off when the latencies are changed by reloading the config file part way through it
+void addCalibrationWalk(struct calibrationRun* run, enum travelDirection direction, float speed, int64_t travelTime, const float latencies[2])	{
+	double x = 1.0 / speed;
+	double s = (direction == MOVING_RIGHT) ? 1 : -1;
+	double t = (double)travelTime / NS_PER_SECOND + s * (latencies[1] - latencies[0]) / 1e6;
+
+	run->walks[direction]++;
+	run->sumXX += x * x;
+	run->sumXS += x * s;
+	run->sumXT += x * t;
+	run->sumST += s * t;
+	run->sumTT += t * t;
+}
+
+//This function fits the distance between the lasers, in metres, and the offset of laser 2 from laser 1, in seconds, to
+//the walks of a calibration run. Walks in both directions or at two different speeds are needed to tell the two apart;
+//with only one direction at one speed, the distance is taken to be the configured one. residual is the root mean square,
+//in seconds, of what the fit leaves unexplained. Returns 1 if the distance was fitted, 0 if it was not and -1 if there
+//are no walks
+int solveCalibration(const struct calibrationRun* run, float distance, double* fittedDistance, double* offset, double* residual)	{
+	double n = run->walks[MOVING_RIGHT] + run->walks[MOVING_LEFT];
+	if(!n)
+		return -1;
+
+	//The normal equations are distance * sumXX + offset * sumXS = sumXT and distance * sumXS + offset * n = sumST
+	double determinant = run->sumXX * n - run->sumXS * run->sumXS;
+	int fitted = determinant > 1e-9 * run->sumXX * n;
+
+	double a = fitted ? (run->sumXT * n - run->sumXS * run->sumST) / determinant : distance;
+	double b = fitted ? (run->sumXX * run->sumST - run->sumXS * run->sumXT) / determinant : (run->sumST - a * run->sumXS) / n;
+
+	double squares = run->sumTT - 2 * a * run->sumXT - 2 * b * run->sumST + a * a * run->sumXX + 2 * a * b * run->sumXS + b * b * n;
+
+	*fittedDistance = a;
+	*offset = b;
+	*residual = sqrt(squares > 0 ? squares / n : 0);
+	return fitted;
+}
+
+//This function writes out what a calibration run of a lane has found so far, as the settings to put in the config file
+void printCalibration(FILE* output, const struct calibrationRun* run, const struct speedometerConfig* config, int lane)	{
+	const struct laneConfig* laneConfig = &config->lanes[lane];
+	double distance;
+	double offset;
+	double residual;
+
+	//The settings of the lanes after the first have LANE<n>_ in front of them
+	char prefix[16] = "";
+	if(lane > 0)
+		snprintf(prefix, sizeof(prefix), "LANE%d_", lane + 1);
+
+	int fitted = solveCalibration(run, laneConfig->distance, &distance, &offset, &residual);
+	if(fitted < 0)	{
+		fprintf(output, "CALIBRATION: no one has walked through the hall at %.2f m/s yet\n\n", config->calibrationSpeed);
+		return;
+	}
+
+	fprintf(output, "CALIBRATION: %ld walks right and %ld walks left. Laser 2 answers %.1f us later than laser 1", run->walks[MOVING_RIGHT], run->walks[MOVING_LEFT], offset * 1e6);
+	if(fitted)
+		fprintf(output, " and the lasers are %.4f m apart", distance);
+	else
+		fprintf(output, ", taking the lasers to be %.4f m apart (walk in both directions or at two speeds to measure it)", distance);
+	fprintf(output, ", leaving %.1f us of each walk unexplained\n", residual * 1e6);
+
+	fprintf(output, "Set %sDISTANCE_BETWEEN_LASERS = %.4f m, %sLASER1_LATENCY = %.1f us and %sLASER2_LATENCY = %.1f us\n\n", prefix, distance, prefix, laneConfig->laserLatency[0], prefix, laneConfig->laserLatency[0] + offset * 1e6);
+}
+
+//This function writes the header of a new event log file if it is empty, and finds out how big it is. Returns 0 on
+//success and -1 if the file could not be written to
+int startEventLogFile(struct eventLog* log)	{
+	log->size = lseek(log->fd, 0, SEEK_END);
+	if(log->size < 0)
+		return -1;
+
+	if(log->size == 0)	{
+		struct speedlogHeader header;
+		memcpy(header.magic, SPEEDLOG_MAGIC, sizeof(header.magic));
+		header.version = SPEEDLOG_VERSION;
+		header.recordSize = sizeof(struct speedlogRecord);
+
+		if(write(log->fd, &header, sizeof(header)) != sizeof(header))
+			return -1;
+		log->size = sizeof(header);
+	}
+
+	return 0;
+}
+
+//This function opens the binary event log for appending and starts its writer thread. maxSize is in kilobytes and
+//overflowPolicy says what happens to an event when the event log is full, the same as for the logger. An empty
+//fileName leaves the event log switched off. Returns 0 on success and -1 if the file could not be opened
+int openEventLog(struct eventLog* log, const char* fileName, int maxSize, int overflowPolicy)	{
+	memset(log, 0, sizeof(*log));
+	pthread_mutex_init(&log->lock, NULL);
+	pthread_cond_init(&log->recordsWaiting, NULL);
+	pthread_cond_init(&log->spaceFree, NULL);
+	log->fd = -1;
+	log->maxSize = (off_t)maxSize * 1024;
+	log->overflowPolicy = overflowPolicy;
+
+	if(!fileName[0])
+		return 0;
+
+	strncpy(log->fileName, fileName, sizeof(log->fileName) - 1);
+
+	log->fd = open(log->fileName, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if(log->fd < 0)
+		return -1;
+
+	if(startEventLogFile(log) < 0 || pthread_create(&log->thread, NULL, eventLogMain, log) != 0)	{
+		close(log->fd);
+		log->fd = -1;
+		return -1;
+	}
+
+	log->started = 1;
+	return 0;
+}
+
+//This function moves the full event log out of the way and starts a new one. Returns 0 on success and -1 if the new
+//file could not be started
+int rotateEventLog(struct eventLog* log)	{
+	char oldName[CONFIG_NAME_SIZE + 8];
+	char newName[CONFIG_NAME_SIZE + 8];
+
+	close(log->fd);
+
+	//Every old log moves up one, the oldest one being written over
+	for(int i = EVENT_LOG_ROTATIONS - 1; i > 0; i--)	{
+		snprintf(oldName, sizeof(oldName), "%s.%d", log->fileName, i);
+		snprintf(newName, sizeof(newName), "%s.%d", log->fileName, i + 1);
+		rename(oldName, newName);
+	}
+
+	snprintf(newName, sizeof(newName), "%s.1", log->fileName);
+	rename(log->fileName, newName);
+
+	log->fd = open(log->fileName, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if(log->fd < 0)
+		return -1;
+
+	return startEventLogFile(log);
+}
+
+//This function writes the count records waiting in the ring from record first to the event log, rotating it first if
+//they would make it too big. Their CLOCK_MONOTONIC times are turned into wall clock times just before, so that when the
+//wall clock is stepped every record written afterwards follows it. Only the writer thread calls it. Returns the number
+//of records that could not be written, which are cut off the end of the file so that every record is still whole
+int writeEventBatch(struct eventLog* log, uint64_t first, int count)	{
+	if(log->fd < 0)
+		return count;
+
+	size_t length = count * sizeof(struct speedlogRecord);
+
+	if(log->maxSize > 0 && log->size + (off_t)length > log->maxSize && log->size > (off_t)sizeof(struct speedlogHeader))	{
+		if(rotateEventLog(log) < 0)	{
+			#ifndef RUN_AS_SERVICE
+			perror("Could not start a new event log");
+			#endif
+
+			if(log->fd >= 0)
+				close(log->fd);
+			log->fd = -1;
+			return count;
+		}
+	}
+
+	struct timespec wallClock;
+	clock_gettime(CLOCK_REALTIME, &wallClock);
+	int64_t clockOffset = ((int64_t)wallClock.tv_sec * NS_PER_SECOND + wallClock.tv_nsec) - (int64_t)getMonotonicTime();
+
+	for(int i = 0; i < count; i++)
+		log->records[(first + i) % EVENT_LOG_RECORDS].timestamp += clockOffset;
+
+	//The records may go round the end of the ring
+	struct iovec pieces[2];
+	int start = first % EVENT_LOG_RECORDS;
+	int untilEnd = EVENT_LOG_RECORDS - start;
+
+	pieces[0].iov_base = &log->records[start];
+	pieces[0].iov_len = (count < untilEnd ? count : untilEnd) * sizeof(struct speedlogRecord);
+	pieces[1].iov_base = &log->records[0];
+	pieces[1].iov_len = length - pieces[0].iov_len;
+
+	//writev() may write only part of the batch, so keep going from wherever it stopped
+	struct iovec* piece = pieces;
+	int piecesLeft = pieces[1].iov_len ? 2 : 1;
+	size_t done = 0;
+
+	while(piecesLeft > 0)	{
+		ssize_t written = writev(log->fd, piece, piecesLeft);
+
+		if(written < 0)	{
+			if(errno == EINTR)
+				continue;
+
+			#ifndef RUN_AS_SERVICE
+			perror("Could not write to the event log");
+			#endif
+			break;
+		}
+
+		done += written;
+		while(piecesLeft > 0 && (size_t)written >= piece->iov_len)	{
+			written -= piece->iov_len;
+			piece++;
+			piecesLeft--;
+		}
+
+		if(piecesLeft > 0)	{
+			piece->iov_base = (char*)piece->iov_base + written;
+			piece->iov_len -= written;
+		}
+	}
+
+	//speedlog-dump reads the records as an array, so a record that was only partly written would throw out every one
+	//after it
+	int whole = done / sizeof(struct speedlogRecord);
+	log->size += (off_t)whole * sizeof(struct speedlogRecord);
+
+	if(done % sizeof(struct speedlogRecord) && ftruncate(log->fd, log->size) < 0)	{
+		#ifndef RUN_AS_SERVICE
+		perror("Could not cut a broken record off the event log");
+		#endif
+
+		close(log->fd);
+		log->fd = -1;
+	}
+
+	return count - whole;
+}
+
+//This function is the event log writer thread. It waits until a batch of EVENT_LOG_BATCH records is waiting, or the
+//lanes have asked for what is waiting to be written, writes them a batch at a time, and keeps going until the event log is closed and
+//everything has been written. The lanes never wait for the SD card, or for the log to be rotated
+void* eventLogMain(void* argument)	{
+	struct eventLog* log = argument;
+
+	pthread_mutex_lock(&log->lock);
+
+	while(1)	{
+		uint64_t waiting = log->head - log->tail;
+
+		if(!waiting && log->stopping)
+			break;
+
+		if(!waiting || (waiting < EVENT_LOG_BATCH && log->flushed <= log->tail && !log->stopping))	{
+			pthread_cond_wait(&log->recordsWaiting, &log->lock);
+			continue;
+		}
+
+		//The log is only rotated between batches, so they are never written more than a batch at a time
+		uint64_t first = log->tail;
+		int count = (waiting < EVENT_LOG_BATCH) ? waiting : EVENT_LOG_BATCH;
+		pthread_mutex_unlock(&log->lock);
+
+		int lost = writeEventBatch(log, first, count);
+
+		pthread_mutex_lock(&log->lock);
+		log->dropped += lost;
+		log->tail += count;
+		pthread_cond_broadcast(&log->spaceFree);
+	}
+
+	pthread_mutex_unlock(&log->lock);
+	return NULL;
+}
+
+//This function hands every record waiting to the writer thread, without waiting for them to be written
+void flushEventLog(struct eventLog* log)	{
+	pthread_mutex_lock(&log->lock);
+	log->flushed = log->head;
+	pthread_cond_signal(&log->recordsWaiting);
+	pthread_mutex_unlock(&log->lock);
+}
+
+//This function adds one event of a lane to the event log. direction is a travelDirection or SPEEDLOG_NO_DIRECTION and
+//timestamp is the CLOCK_MONOTONIC time of the event. When the ring is full the event is dropped and counted, unless
+//the event log was opened with LOG_BLOCK_WHEN_FULL
+void logEvent(struct eventLog* log, int lane, int type, int direction, int flags, float speed, timestamp_ns timestamp)	{
+	if(!log->started)
+		return;
+
+	pthread_mutex_lock(&log->lock);
+
+	while(log->head - log->tail >= EVENT_LOG_RECORDS)	{
+		if(log->overflowPolicy != LOG_BLOCK_WHEN_FULL)	{
+			log->dropped++;
+			pthread_mutex_unlock(&log->lock);
+			return;
+		}
+
+		pthread_cond_wait(&log->spaceFree, &log->lock);
+	}
+
+	struct speedlogRecord* record = &log->records[log->head % EVENT_LOG_RECORDS];
+	record->timestamp = timestamp;
+	record->type = type;
+	record->direction = direction;
+	record->flags = flags | (lane << SPEEDLOG_LANE_SHIFT);
+	record->speed = speed;
+	log->head++;
+
+	//The writer only has to be woken up when there is a full batch for it
+	if(log->head - log->tail == EVENT_LOG_BATCH)
+		pthread_cond_signal(&log->recordsWaiting);
+
+	pthread_mutex_unlock(&log->lock);
+}
+
+//This function gives the number of events dropped because the event log was full or could not be written
+uint64_t eventLogDropped(struct eventLog* log)	{
+	pthread_mutex_lock(&log->lock);
+	uint64_t dropped = log->dropped;
+	pthread_mutex_unlock(&log->lock);
+
+	return dropped;
+}
+
+//This function writes whatever is still waiting, stops the writer thread and closes the event log
+void closeEventLog(struct eventLog* log)	{
+	if(log->started)	{
+		pthread_mutex_lock(&log->lock);
+		log->stopping = 1;
+		pthread_cond_signal(&log->recordsWaiting);
+		pthread_mutex_unlock(&log->lock);
+
+		pthread_join(log->thread, NULL);
+		log->started = 0;
+	}
+
+	if(log->fd >= 0)
+		close(log->fd);
+	log->fd = -1;
+	pthread_cond_destroy(&log->recordsWaiting);
+	pthread_cond_destroy(&log->spaceFree);
+	pthread_mutex_destroy(&log->lock);
+}
+
+
+//This function gets the measurement store ready, filling its pool with numPages pages up front so that
+//windows with up to numPages * MEASUREMENTS_PER_PAGE measurements never need to allocate anything
+void initMeasurementStore(struct measurementStore* store, int numPages)	{
+	memset(store, 0, sizeof(*store));
+
+	for(int i = 0; i < numPages; i++)	{
+		struct measurementPage* page = malloc(sizeof(struct measurementPage));
+		if(page == NULL)
+			break;
+
+		page->next = store->freePages;
+		store->freePages = page;
+		store->pagesAllocated++;
+	}
+}
+
+//This function adds a measurement to the store. A new page is only taken when the last one is full, and it
+//only has to be allocated if the pool has run out, which happens only when a window is busier than all the
+//ones before it. Returns 0 on success and -1 if a page was needed but could not be allocated
+int storeMeasurement(struct measurementStore* store, const struct speedMeasurement* measurement)	{
+	if(store->lastPage == NULL || store->usedInLastPage == MEASUREMENTS_PER_PAGE)	{
+		struct measurementPage* page = store->freePages;
+
+		if(page != NULL)
+			store->freePages = page->next;
+		else	{
+			page = malloc(sizeof(struct measurementPage));
+			if(page == NULL)
+				return -1;
+
+			store->pagesAllocated++;
+		}
+
+		//Add the page to the end of the pages in use
+		page->next = NULL;
+		if(store->lastPage)
+			store->lastPage->next = page;
+		else
+			store->firstPage = page;
+
+		store->lastPage = page;
+		store->usedInLastPage = 0;
+
+		store->pagesInUse++;
+		if(store->pagesInUse > store->peakPagesInUse)
+			store->peakPagesInUse = store->pagesInUse;
+	}
+
+	store->lastPage->measurements[store->usedInLastPage++] = *measurement;
+	store->count++;
+
+	return 0;
+}
+
+//This function empties the store at the end of a stats window. The pages are handed back to the pool as a
+//whole, without touching the measurements in them
+void recycleMeasurements(struct measurementStore* store)	{
+	if(store->lastPage)	{
+		store->lastPage->next = store->freePages;
+		store->freePages = store->firstPage;
+	}
+
+	store->firstPage = NULL;
+	store->lastPage = NULL;
+	store->usedInLastPage = 0;
+	store->pagesInUse = 0;
+	store->count = 0;
+}
+
+//This function gives back all of the memory held by the store
+void freeMeasurementStore(struct measurementStore* store)	{
+	recycleMeasurements(store);
+
+	while(store->freePages)	{
+		struct measurementPage* page = store->freePages;
+		store->freePages = page->next;
+		free(page);
+	}
+
+	store->pagesAllocated = 0;
+}
+
+//This function empties an accumulator at the start of a stats window
+void resetAccumulator(struct speedAccumulator* accumulator)	{
+	memset(accumulator, 0, sizeof(*accumulator));
+}
+
+//This function adds one person's speed to an accumulator
+void accumulateSpeed(struct speedAccumulator* accumulator, float speed)	{
+	accumulator->count++;
+
+	if(accumulator->count == 1 || speed > accumulator->maxSpeed)
+		accumulator->maxSpeed = speed;
+	if(accumulator->count == 1 || speed < accumulator->minSpeed)
+		accumulator->minSpeed = speed;
+
+	double delta = speed - accumulator->mean;
+	accumulator->mean += delta / accumulator->count;
+	accumulator->m2 += delta * (speed - accumulator->mean);
+}
+
+//This function reads the stats out of an accumulator. An empty accumulator gives all zeros
+void readAccumulator(const struct speedAccumulator* accumulator, struct directionStats* stats)	{
+	stats->count = accumulator->count;
+	stats->maxSpeed = accumulator->maxSpeed;
+	stats->minSpeed = accumulator->minSpeed;
+	stats->averageSpeed = accumulator->mean;
+	stats->standardDeviation = (accumulator->count > 1) ? sqrt(accumulator->m2 / (accumulator->count - 1)) : 0;
+}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
-					timeInState = time(NULL);
-				}
+//This function empties a sketch
+void resetSketch(struct speedSketch* sketch)	{
+	memset(sketch, 0, sizeof(*sketch));
+}
 
-				break;
+//This function finds the bucket a speed is counted in. A speed too big for the sketch is clamped while it is still a
+//float, as one too big for a uint32_t could not be converted to one
+int sketchBucket(float speed)	{
+	float millimetres = (speed > 0) ? speed * 1000 + 0.5f : 0;
+	uint32_t value = (millimetres < (1u << SKETCH_MAX_BITS)) ? (uint32_t)millimetres : (1u << SKETCH_MAX_BITS) - 1;
 
-			case IN_HALL_MOVE_LEFT:
-				
-				//The first time a person enters the state, this basically starts a timer. 
-				if(enteringNewState)	{
-					timeInState = time(NULL);
-					enteringNewState = 0;
-				}
+	if(value < SKETCH_SUB_BUCKETS)
+		return value;
 
-				//If someone enters the hall but does not leave
-				if((time(NULL) - timeInState) > MAX_TIME_IN_HALL && !warningIssued)	{
-					getTime(curTime);
+	//The highest set bit picks the power of two and the bits under it pick the bucket inside it
+	int shift = (31 - __builtin_clz(value)) - SKETCH_SUB_BUCKET_BITS;
+	return SKETCH_SUB_BUCKETS * (shift + 1) + (value >> shift) - SKETCH_SUB_BUCKETS;
+}
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the hallway!\n");
-					#endif
+//This function gives the speed in the middle of a bucket, in m/s
+float sketchBucketSpeed(int bucket)	{
+	if(bucket < SKETCH_SUB_BUCKETS)
+		return bucket / 1000.0f;
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the hallway!\n\n");
-					warningIssued = 1;
-				}
-								
-				//Person is leaving the hall in the right direction
-				if(!laser1Status)	{
-					currentLocation = LASER1_BROKEN_GOING_OUT_CORRECT;
-					timeInState = time(NULL);
-					outputOff(gpio, WARNING_LED_PIN);
-				}
+	int shift = bucket / SKETCH_SUB_BUCKETS - 1;
+	uint32_t lowest = (uint32_t)(SKETCH_SUB_BUCKETS + bucket % SKETCH_SUB_BUCKETS) << shift;
+	return (lowest + ((1u << shift) - 1) / 2.0f) / 1000.0f;
+}
 
-				//Person leaves the hall in the wrong direction
-				if(!laser2Status)	{
-					currentLocation = LASER2_BROKEN_GOING_OUT_INCORRECT;
-					enteringTime = 0;
-					getTime(curTime);
+//This function counts one person's speed in a sketch. A speed that is not a number is not counted
+void addToSketch(struct speedSketch* sketch, float speed)	{
+	if(isnan(speed))
+		return;
 
-					#ifndef RUN_AS_SERVICE
-					printf("This hallway is one way only! Pick a direction to walk, buddy!\n");
-					#endif
+	sketch->buckets[sketchBucket(speed)]++;
+	sketch->total++;
+}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_INFO, "A person turned around in the hallway and walked back out!\n\n");
-					enteringNewState = 1;
-					timeInState = time(NULL);
-					outputOff(gpio, WARNING_LED_PIN);
-				}
+//This function adds everything counted in one sketch to another
+void mergeSketch(struct speedSketch* total, const struct speedSketch* sketch)	{
+	for(int i = 0; i < SKETCH_BUCKETS; i++)
+		total->buckets[i] += sketch->buckets[i];
+	total->total += sketch->total;
+}
 
-				break;
+//This function finds the speed that the given percent of the people counted were at or under. An empty sketch gives 0
+float sketchPercentile(const struct speedSketch* sketch, int percent)	{
+	if(!sketch->total)
+		return 0;
+
+	//The rank of the person whose speed is wanted, counting from 1
+	uint64_t rank = ((uint64_t)sketch->total * percent + 99) / 100;
+	if(rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for(int i = 0; i < SKETCH_BUCKETS; i++)	{
+		seen += sketch->buckets[i];
+		if(seen >= rank)
+			return sketchBucketSpeed(i);
+	}
 
-			case LASER1_BROKEN_GOING_OUT_CORRECT:
-				
-				if(laser1Status)	{
+	return sketchBucketSpeed(SKETCH_BUCKETS - 1);
+}
 
-					int travelTime = time(NULL) - enteringTime;
+//This function writes the percentiles of a sketch to the stats file on one line
+void printPercentiles(FILE* statsFile, const char* label, const struct speedSketch* sketch)	{
+	fprintf(statsFile, "%s: %u people, 50%% at or under %.2f m/s, 85%% at or under %.2f m/s, 95%% at or under %.2f m/s, 99%% at or under %.2f m/s\n", label, sketch->total, sketchPercentile(sketch, 50), sketchPercentile(sketch, 85), sketchPercentile(sketch, 95), sketchPercentile(sketch, 99));
+}
 
-					if(!travelTime)	
-						objectSpeed = -1;
-					else	
-						objectSpeed = distanceBetweenLasers / travelTime;
+//This function writes how many people went at each speed to the stats file, HISTOGRAM_BIN_WIDTH m/s at a time
+void printHistogram(FILE* statsFile, const struct speedSketch* sketch)	{
+	uint32_t bins[HISTOGRAM_BINS] = { 0 };
 
-					peoplePassedThrough++;
-					currentLocation = EXITED_HALL;
-				}
+	//Each bucket of the sketch goes in the bin its middle speed falls in
+	for(int i = 0; i < SKETCH_BUCKETS; i++)	{
+		if(!sketch->buckets[i])
+			continue;
 
-				if((time(NULL) - timeInState) > LASER_BLOCK_TIME)	{
-					getTime(curTime);
+		int bin = sketchBucketSpeed(i) / HISTOGRAM_BIN_WIDTH;
+		if(bin >= HISTOGRAM_BINS)
+			bin = HISTOGRAM_BINS - 1;
+		bins[bin] += sketch->buckets[i];
+	}
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the laser!\n");
-					#endif
+	for(int bin = 0; bin < HISTOGRAM_BINS - 1; bin++)
+		fprintf(statsFile, "  %.2f to %.2f m/s: %u\n", bin * HISTOGRAM_BIN_WIDTH, (bin + 1) * HISTOGRAM_BIN_WIDTH, bins[bin]);
+	fprintf(statsFile, "  %.2f m/s and over: %u\n", (HISTOGRAM_BINS - 1) * HISTOGRAM_BIN_WIDTH, bins[HISTOGRAM_BINS - 1]);
+}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
-					timeInState = time(NULL);
-				}
+//This function works out the same stats as the accumulators, but the slow way, by going over every measurement
+//of the window twice. It is kept to check the accumulators against, by the stats benchmark and by measureSpeed when
+//the program is built with CHECK_STATS.
+//The stats of each direction go in stats[MOVING_RIGHT] and stats[MOVING_LEFT] and those of the whole hall in
+//stats[BOTH_DIRECTIONS]
+void computeStats(struct directionStats stats[], struct measurementStore* store)	{
+	double sumOfSpeeds[BOTH_DIRECTIONS + 1] = { 0 };
+	double sumOfSquares[BOTH_DIRECTIONS + 1] = { 0 };
+
+	for(int i = 0; i <= BOTH_DIRECTIONS; i++)	{
+		stats[i].count = 0;
+		stats[i].maxSpeed = 0;
+		stats[i].minSpeed = FLT_MAX;
+		stats[i].averageSpeed = 0;
+		stats[i].standardDeviation = 0;
+	}
 
-				break;
+	//The first pass finds the count, the fastest and slowest speeds and the sums, the second one the spread
+	for(int pass = 0; pass < 2; pass++)	{
+		for(struct measurementPage* page = store->firstPage; page != NULL; page = page->next)	{
+			//Every page but the last one is full
+			int used = (page == store->lastPage) ? store->usedInLastPage : MEASUREMENTS_PER_PAGE;
 
-			case LASER2_BROKEN_GOING_OUT_INCORRECT:
+			for(int i = 0; i < used; i++)	{
+				const struct speedMeasurement* measurement = &page->measurements[i];
 
-				if(laser2Status)	
-					currentLocation = NOONE_IN_HALL;
+				//Every measurement counts towards its own direction and towards the whole hall
+				int indexes[2] = { measurement->direction, BOTH_DIRECTIONS };
 
-				if((time(NULL) - timeInState) > LASER_BLOCK_TIME)	{
-					getTime(curTime);
+				for(int j = 0; j < 2; j++)	{
+					struct directionStats* stat = &stats[indexes[j]];
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the laser!\n");
-					#endif
+					if(pass)	{
+						double difference = measurement->speed - stat->averageSpeed;
+						sumOfSquares[indexes[j]] += difference * difference;
+						continue;
+					}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
-					timeInState = time(NULL);
+					if(measurement->speed > stat->maxSpeed)
+						stat->maxSpeed = measurement->speed;
+					if(measurement->speed < stat->minSpeed)
+						stat->minSpeed = measurement->speed;
+
+					sumOfSpeeds[indexes[j]] += measurement->speed;
+					stat->count++;
 				}
+			}
+		}
 
-				break;
+		for(int i = 0; i <= BOTH_DIRECTIONS; i++)	{
+			if(!pass && stats[i].count)
+				stats[i].averageSpeed = sumOfSpeeds[i] / stats[i].count;
+			else if(!pass)
+				stats[i].minSpeed = 0;
+			else if(stats[i].count > 1)
+				stats[i].standardDeviation = sqrt(sumOfSquares[i] / (stats[i].count - 1));
+		}
+	}
+}
 
-			case IN_HALL_MOVE_RIGHT:
-				
-				//The first time a person enters the state, this basically starts a timer. 
-				if(enteringNewState)	{
-					timeInState = time(NULL);
-					enteringNewState = 0;
-				}
+//This function checks that two sets of stats agree, to within STATS_TOLERANCE for the ones that are worked out
+int statsMatch(const struct directionStats* first, const struct directionStats* second)	{
+	return first->count == second->count && first->maxSpeed == second->maxSpeed && first->minSpeed == second->minSpeed && fabsf(first->averageSpeed - second->averageSpeed) <= STATS_TOLERANCE * fabsf(second->averageSpeed) + 1e-6f && fabsf(first->standardDeviation - second->standardDeviation) <= STATS_TOLERANCE * second->standardDeviation + 1e-6f;
+}
 
-				//If someone enters the hall but does not leave
-				if((time(NULL) - timeInState) > MAX_TIME_IN_HALL && !warningIssued)	{
-					getTime(curTime);
+//This function checks the accumulators against computeStats on windows of synthetic speeds, from a single person up to
+//STATS_BENCHMARK_SPEEDS people, and on a window of people all walking within a millimetre a second of each other, where
+//the spread is easily lost. It also times both ways of working the stats out. Returns 0 if they agree on every window
+//and -1 otherwise
+int runStatsBenchmark(FILE* results)	{
+	const int windowSizes[] = { 1, 2, 1000, STATS_BENCHMARK_SPEEDS, STATS_BENCHMARK_SPEEDS };
+	const int numWindows = sizeof(windowSizes) / sizeof(windowSizes[0]);
+	float* speeds = malloc(STATS_BENCHMARK_SPEEDS * sizeof(float));
+	enum travelDirection* directions = malloc(STATS_BENCHMARK_SPEEDS * sizeof(enum travelDirection));
+	int failed = 0;
+
+	if(!speeds || !directions)	{
+		printf("The stats benchmark could not be set up\n");
+		free(speeds);
+		free(directions);
+		return -1;
+	}
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the hallway!\n");
-					#endif
+	for(int window = 0; window < numWindows; window++)	{
+		int numSpeeds = windowSizes[window];
+		int steady = window == numWindows - 1;
+		unsigned int seed = window + 1;
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the hallway!\n\n");
-					warningIssued = 1;
-				}
-				
-				//Person leaves the hall in the wrong direction
-				if(!laser1Status)	{					
-					currentLocation = LASER1_BROKEN_GOING_OUT_INCORRECT;
-					enteringTime = 0;
-					getTime(curTime);
+		for(int i = 0; i < numSpeeds; i++)	{
+			directions[i] = rand_r(&seed) & 1;
+			speeds[i] = steady ? 1.5f + 0.001f * rand_r(&seed) / RAND_MAX : SYNTHETIC_MIN_SPEED + (6.0f - SYNTHETIC_MIN_SPEED) * rand_r(&seed) / RAND_MAX;
+		}
 
-					#ifndef RUN_AS_SERVICE
-					printf("This hallway is one way only! Pick a direction to walk, buddy!\n");
-					#endif
+		//Every speed goes into the accumulators of its direction and of the whole hall, the way measureSpeed does it
+		struct speedAccumulator accumulators[BOTH_DIRECTIONS + 1];
+		struct directionStats stats[BOTH_DIRECTIONS + 1];
+		timestamp_ns start = getMonotonicTime();
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_INFO, "A person turned around in the hallway and walked back out!\n\n");
-					outputOff(gpio, WARNING_LED_PIN);
-				}
-				
-				//Person is leaving the hall in the right direction
-				if(!laser2Status)	{
-					currentLocation = LASER2_BROKEN_GOING_OUT_CORRECT;
-					timeInState = time(NULL);
-					outputOff(gpio, WARNING_LED_PIN);
-				}
+		for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+			resetAccumulator(&accumulators[i]);
+		for(int i = 0; i < numSpeeds; i++)	{
+			accumulateSpeed(&accumulators[directions[i]], speeds[i]);
+			accumulateSpeed(&accumulators[BOTH_DIRECTIONS], speeds[i]);
+		}
+		for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+			readAccumulator(&accumulators[i], &stats[i]);
+		timestamp_ns accumulated = getMonotonicTime() - start;
+
+		//And the slow way, keeping every speed and going back over them
+		struct measurementStore store;
+		struct directionStats checkedStats[BOTH_DIRECTIONS + 1];
+		initMeasurementStore(&store, PREALLOCATED_PAGES);
+		start = getMonotonicTime();
+
+		for(int i = 0; i < numSpeeds; i++)
+			storeMeasurement(&store, &(struct speedMeasurement){ i, directions[i], speeds[i] });
+		computeStats(checkedStats, &store);
+		timestamp_ns computed = getMonotonicTime() - start;
+		freeMeasurementStore(&store);
+
+		int matched = 1;
+		for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+			matched = matched && statsMatch(&stats[i], &checkedStats[i]);
+
+		printf("Stats of %d %s%s: %.1f ns a person with the accumulators and %.1f ns a person keeping every speed and going back over them, %s (average %.4f m/s, standard deviation %.4f m/s)\n", numSpeeds, numSpeeds == 1 ? "person" : "people", steady ? " within 1 mm/s of each other" : "", (double)accumulated / numSpeeds, (double)computed / numSpeeds, matched ? "the same stats" : "FAILED: the stats do not match", stats[BOTH_DIRECTIONS].averageSpeed, stats[BOTH_DIRECTIONS].standardDeviation);
+		failed |= !matched;
+
+		if(results)
+			fprintf(results, "{\"benchmark\": \"stats\", \"people\": %d, \"steady\": %d, \"accumulator_ns_per_person\": %.1f, \"stored_ns_per_person\": %.1f, \"matched\": %d}\n", numSpeeds, steady, (double)accumulated / numSpeeds, (double)computed / numSpeeds, matched);
+	}
 
-				break;
+	free(speeds);
+	free(directions);
+	return failed ? -1 : 0;
+}
 
-			case LASER2_BROKEN_GOING_OUT_CORRECT:
-				if(laser2Status)	{
+//This function counts a turn of a lane's state machine. The first lane pings the watchdog, but only if every lane has
+//turned since it last did, so that one lane getting stuck reboots the Pi the same as the whole program getting stuck
+void pingWatchdog(struct laneWatchdog* watchdog, int lane)	{
+	if(watchdog == NULL)
+		return;
 
-					int travelTime = time(NULL) - enteringTime;
-					if(!travelTime)
-						objectSpeed = -1;
-					// printf("time(NULL): %d \t enteringTime: %d \t travelTime: %d\n", time(NULL), enteringTime, travelTime);
-					else
-						objectSpeed = distanceBetweenLasers / travelTime;
-					// printf("ObjectSpeed: %.2f\n", objectSpeed);
-					currentLocation = EXITED_HALL;
-					peoplePassedThrough++;
-				}
+	atomic_fetch_add_explicit(&watchdog->turns[lane], 1, memory_order_relaxed);
+	if(lane != 0)
+		return;
 
-				if((time(NULL) - timeInState) > LASER_BLOCK_TIME)	{
-					getTime(curTime);
+	for(int i = 1; i < watchdog->numLanes; i++)	{
+		if(atomic_load_explicit(&watchdog->turns[i], memory_order_relaxed) == watchdog->lastTurns[i])
+			return;
+	}
 
-					#ifndef RUN_AS_SERVICE
-					printf("Hey! Watch out! You are blocking the laser!\n");
-					#endif
+	for(int i = 0; i < watchdog->numLanes; i++)
+		watchdog->lastTurns[i] = atomic_load_explicit(&watchdog->turns[i], memory_order_relaxed);
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
-					timeInState = time(NULL);
-				}
+	//This ioctl call will write to the watchdog file and prevent the pi from rebooting
+	if(watchdog->fd >= 0)
+		ioctl(watchdog->fd, WDIOC_KEEPALIVE, 0);
+}
 
-				break;
+//This is the thread of a lane other than the first. It runs the lane's state machine
+void* laneMain(void* argument)	{
+	struct laneThread* laneThread = argument;
+
+	measureSpeed(laneThread->gpio, laneThread->sampler, laneThread->lane, laneThread->watchdog, laneThread->config, laneThread->configWatcher, laneThread->logFile, laneThread->statsFile, laneThread->eventLog, laneThread->metrics, laneThread->metricsServer);
+	return NULL;
+}
 
-			case LASER1_BROKEN_GOING_OUT_INCORRECT:
+void measureSpeed(struct gpioBackend* gpio, struct samplerThread* sampler, int lane, struct laneWatchdog* watchdog, const struct speedometerConfig* settings, struct configWatcher* configWatcher, struct asyncLogger* logFile, FILE* statsFile, struct eventLog* eventLog, struct pipelineMetrics* metrics, struct metricsServer* metricsServer)	{
+	//The LED scheduler looks after the LEDs from here on, so that blinking them never stops the state machine
+	struct ledScheduler leds;
+	initLedScheduler(&leds, gpio);
 
-				if(laser1Status)	{
-					currentLocation = NOONE_IN_HALL;
-				}
+	//Indicates that the program is running, even when puTTy is not connected. Every lane is running once the first is
+	if(lane == 0)
+		ledSolid(&leds, RUNNING_LED_PIN, 1);
+
+	char curTime[TIME_BUFFER_SIZE];
+	char message[256];
+
+	//The config is copied, so that a reloaded one can be swapped in while the program runs
+	struct speedometerConfig config = *settings;
+	const struct laneConfig* laneSettings = &config.lanes[lane];
+	const float* speedLimits = laneSettings->speedLimits;
+	const int warningLedPin = laneSettings->warningLedPin;
+
+	//The bits of the level register of this lane's lasers
+	const uint32_t laserMasks[2] = { 1u << laneSettings->laserPins[0], 1u << laneSettings->laserPins[1] };
+	const uint32_t laneMask = laserMasks[0] | laserMasks[1];
+
+	//The name the messages of this lane are logged under, so that the lanes can be told apart
+	char laneName[32];
+	if(config.numLanes > 1)
+		snprintf(laneName, sizeof(laneName), "measureSpeed lane %d", lane + 1);
+	else
+		snprintf(laneName, sizeof(laneName), "measureSpeed");
+
+	//Take one snapshot of both lasers. Without a GPIO backend there is no level register to read,
+	//so the levels the capture engine starts out with are used instead
+	struct laserSample sample;
+	if(sampleLasers(gpio, laneMask, &sample) < 0)
+		sample.levels = sampler->lanes[lane].levels;
+
+	//If, initially either of the 2 photodiodes are disconnected, wait 1 second then check again. If either or both are still disconnected, exit the program
+	while(sample.levels != laneMask)	{
+		//This keeps the watchdog from rebooting the pi while the lasers are being set up
+		pingWatchdog(watchdog, lane);
+
+		#ifndef RUN_AS_SERVICE
+		printf("Distance: %.2f, Laser1: %d, Laser2: %d\n", laneSettings->distance, (sample.levels & laserMasks[0]) != 0, (sample.levels & laserMasks[1]) != 0);
+		#endif
+
+		sleep(2);
+		if(sampleLasers(gpio, laneMask, &sample) < 0)
+			sample.levels = sampler->lanes[lane].levels;
+
+		if(sample.levels != laneMask)	{
+			getTime(curTime);
+			PRINT_MSG(logFile, curTime, laneName, SEVERITY_ERROR, "There are no lasers connected to one or more of the photodiodes, exiting.\n\n");
+
+			#ifndef RUN_AS_SERVICE
+			perror("No lasers connected!\n");
+			#endif
+		}
+	}
+
+	//Logs that connections with the lasers has been established
+	getTime(curTime);
+
+	#ifndef RUN_AS_SERVICE
+	printf("Connection with both lasers has been established!\n");
+	#endif
+
+	PRINT_MSG(logFile, curTime, laneName, SEVERITY_INFO, "Connection with both lasers has been established!");
+
+	//Now that both lasers are there, hand the watching of them over to the sampler thread
+	if(startSampler(sampler) < 0)	{
+		getTime(curTime);
+
+		#ifndef RUN_AS_SERVICE
+		perror("The sampler thread could not be started; exiting\n");
+		#endif
+
+		PRINT_MSG(logFile, curTime, laneName, SEVERITY_ERROR, "The sampler thread could not be started\n\n");
+		return;
+	}
+	
+	//If either of the given speed limits is less than 0, exit with an error code
+	if(speedLimits[MOVING_RIGHT] < 0 || speedLimits[MOVING_LEFT] < 0)	{
+		getTime(curTime);
+
+		#ifndef RUN_AS_SERVICE
+		perror("Received an invalid speedLimit; exiting\n");
+		#endif
+
+		PRINT_MSG(logFile, curTime, laneName, SEVERITY_ERROR, "The measureSpeed function was given an invalid speed\n\n");
+		return;
+	}
 
-				if((time(NULL) - timeInState) > LASER_BLOCK_TIME && !warningIssued)	{
+	//If a speed limit is 0, allow the program to precede but note it in the log file
+	if(!speedLimits[MOVING_RIGHT] || !speedLimits[MOVING_LEFT])	{
+		getTime(curTime);
+
+		#ifndef RUN_AS_SERVICE
+		perror("Received a speedLimit as 0; running program but flagging all objects walking through hall in that direction\n");
+		#endif
+
+		PRINT_MSG(logFile, curTime, laneName, SEVERITY_WARNING, "A requested speedLimit is 0. Flagging any objects moving through hall in that direction\n\n");
+	}
+
+	//The tracker follows everyone in the hall. Both lasers are known to be reaching their photodiodes by now
+	struct transitTracker tracker;
+	initTracker(&tracker, laneSettings->distance, laserMasks, laneMask);
+	calibrateTracker(&tracker, laneSettings->distance, laneSettings->laserLatency);
+
+	//The glitch filter sits between the sampler and the tracker. Its majority is taken of the reads of the level
+	//register, or, for the capture engines that only see the edges, of the reads the polling loop would have made
+	struct glitchFilter filter;
+	timestamp_ns samplePeriod = (sampler->capture->mode == CAPTURE_STREAM) ? sampler->capture->stream->period : POLL_PERIOD_US * 1000ULL;
+	initGlitchFilter(&filter, laserMasks, laneMask, samplePeriod);
+	setGlitchFilter(&filter, laneSettings->majoritySamples, laneSettings->minPulse);
+
+	//While CALIBRATION_SPEED is set, everyone is taken to be walking at that speed and their travel times are used to
+	//work out the distance between the lasers and their latencies
+	struct calibrationRun calibration;
+	memset(&calibration, 0, sizeof(calibration));
+
+	//The names used for the two directions in the stats file
+	const char* directionNames[2] = { "right (from laser 1 to laser 2)", "left (from laser 2 to laser 1)" };
+
+	//Every measurement of the window is only kept to check the accumulators against, when the program is built with
+	//CHECK_STATS
+	#ifdef CHECK_STATS
+	struct measurementStore measurements;
+	initMeasurementStore(&measurements, PREALLOCATED_PAGES);
+	#endif
+
+	//The running stats of the window for each direction and for the whole hall
+	struct speedAccumulator windowSpeeds[BOTH_DIRECTIONS + 1];
+	for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+		resetAccumulator(&windowSpeeds[i]);
+
+	//The speed distributions of the window, the hour and the day, again for each direction and for the whole hall.
+	//They are big, so they are kept off the stack, with a set for each lane
+	static struct speedSketch laneWindowSketches[MAX_LANES][BOTH_DIRECTIONS + 1];
+	static struct speedSketch laneHourSketches[MAX_LANES][BOTH_DIRECTIONS + 1];
+	static struct speedSketch laneDaySketches[MAX_LANES][BOTH_DIRECTIONS + 1];
+	struct speedSketch* windowSketches = laneWindowSketches[lane];
+	struct speedSketch* hourSketches = laneHourSketches[lane];
+	struct speedSketch* daySketches = laneDaySketches[lane];
+	for(int i = 0; i <= BOTH_DIRECTIONS; i++)	{
+		resetSketch(&windowSketches[i]);
+		resetSketch(&hourSketches[i]);
+		resetSketch(&daySketches[i]);
+	}
+
+	int peoplePassedThrough = 0;
+	int numberOfSpeeders[2] = { 0, 0 };
+	int peopleLost[2] = { 0, 0 };
+
+	timestamp_ns startTime = gpioTime(gpio);
+	timestamp_ns hourStartTime = startTime;
+	timestamp_ns dayStartTime = startTime;
+
+	//The start time of the program
+	char sTime[TIME_BUFFER_SIZE];
+	getTime(sTime);
+
+	char hourTime[TIME_BUFFER_SIZE];
+	char dayTime[TIME_BUFFER_SIZE];
+	strcpy(hourTime, sTime);
+	strcpy(dayTime, sTime);
+
+	//Every lane writes to the same stats file, so the reports of the lanes after the first say which lane they are for
+	char lanePrefix[24] = "";
+	if(config.numLanes > 1)
+		snprintf(lanePrefix, sizeof(lanePrefix), "LANE %d ", lane + 1);
+
+	//The time the metrics were last handed to the metrics server, on the clock of the GPIO backend
+	timestamp_ns lastPublished = 0;
+
+	//The state the hall is in and since when, on the clock of the GPIO backend
+	enum hallState state = HALL_EMPTY;
+	timestamp_ns stateSince = startTime;
+
+	if(!metrics->started)
+		metrics->started = getMonotonicTime();
+
+	//When the last wait for an edge ended, in real time, which the busy time of the next turn is counted from
+	timestamp_ns lastWaitEnd = metrics->untimed ? 0 : getMonotonicTime();
+
+	//Always runs this, intermittently printing out stats. We acknowledge that a while(1) is not generally accepted but in this case, this illustrates that the program runs continuously.
+	while(1)	{
+		metrics->iterations++;
+
+		//The time on the clock of the GPIO backend, which the metrics, the stats window, the LEDs and the timers go by.
+		//It is only read again before the wait if the turn was slow
+		timestamp_ns now = gpioTime(gpio);
+		int publishDue = metricsServer && now - lastPublished >= METRICS_PUBLISH_INTERVAL * NS_PER_MS;
+		int configDue = configWatcher && atomic_load_explicit(&configWatcher->pending[lane], memory_order_relaxed);
+		int slowTurn = publishDue || configDue || (now - startTime) > config.statsFrequency * NS_PER_SECOND;
+
+		//Every turn is timed up to its wait for the busy time. Timing it from start to end as well, for the loop period
+		//and decision latency, costs about as much as the rest of a turn that only checks the timers, so that is only
+		//done on one turn in every METRICS_SAMPLE_TURNS
+		int sampled = !metrics->untimed && metrics->iterations % METRICS_SAMPLE_TURNS == 0;
+		timestamp_ns turnStart = sampled ? getMonotonicTime() : 0;
+
+		//Every METRICS_PUBLISH_INTERVAL milliseconds, hand the metrics server the latest metrics
+		if(publishDue)	{
+			metrics->occupancy = trackerOccupancy(&tracker);
+			publishMetrics(metricsServer, lane, metrics, 0);
+			lastPublished = now;
+		}
+
+		//Swap in the config file if it has been reloaded. The window carries on as it was
+		if(configDue)	{
+			struct speedometerConfig* newConfig = atomic_exchange(&configWatcher->pending[lane], NULL);
+			applyConfig(&config, newConfig, lane, &tracker, &filter, logFile, laneName);
+			free(newConfig);
+		}
+
+		//If enough time has elapsed since the last time stats were printed
+		if((now - startTime) > config.statsFrequency * NS_PER_SECOND)	{
+
+			//The accumulators already hold the stats, so they only have to be read out
+			struct directionStats stats[BOTH_DIRECTIONS + 1];
+			for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+				readAccumulator(&windowSpeeds[i], &stats[i]);
+
+			getTime(curTime);
+
+			//When asked to, make sure the accumulators agree with the stats worked out from every measurement
+			#ifdef CHECK_STATS
+			struct directionStats checkedStats[BOTH_DIRECTIONS + 1];
+			computeStats(checkedStats, &measurements);
+
+			for(int i = 0; i <= BOTH_DIRECTIONS; i++)	{
+				if(!statsMatch(&checkedStats[i], &stats[i]))
+					PRINT_MSG(logFile, curTime, laneName, SEVERITY_ERROR, "The running stats do not match the stats worked out from the measurements\n\n");
+			}
+			#endif
+
+			//Used instead of the macro to print a message with variables. Prints all statistics to the log file, all in one
+			//go so that the reports of the lanes are not mixed up
+			flockfile(statsFile);
+			fprintf(statsFile, "%sSTATS FOR THE TIME BETWEEN %s and %s", lanePrefix, sTime, curTime);
+			fprintf(statsFile, "The number of people that passed through the hall was: %d\n", peoplePassedThrough);
+			fprintf(statsFile, "The number of people speeding through the hall was: %d\n", numberOfSpeeders[MOVING_RIGHT] + numberOfSpeeders[MOVING_LEFT]);
+
+			fprintf(statsFile, "The fastest person that went through the hall travelled at a speed of approximately %.2f m/s\n", stats[BOTH_DIRECTIONS].maxSpeed);
+			fprintf(statsFile, "The slowest person that went through the hall travelled at a speed of approximately %.2f m/s\n", stats[BOTH_DIRECTIONS].minSpeed);
+			fprintf(statsFile, "The average speed of the people travelling through the hall was %.2f m/s\n", stats[BOTH_DIRECTIONS].averageSpeed);
+			fprintf(statsFile, "The standard deviation of the speeds was %.2f m/s\n", stats[BOTH_DIRECTIONS].standardDeviation);
+
+			//What the walk-throughs of calibration mode have found so far
+			if(config.calibrationSpeed > 0)	{
+				printCalibration(statsFile, &calibration, &config, lane);
+
+				#ifndef RUN_AS_SERVICE
+				printCalibration(stdout, &calibration, &config, lane);
+				#endif
+			}
+
+			//The same again for each direction on its own
+			for(int direction = 0; direction < 2; direction++)	{
+				fprintf(statsFile, "Walking %s: %d people measured, %d speeding over %.2f m/s and %d never seen leaving. Fastest %.2f m/s, slowest %.2f m/s, average %.2f m/s, standard deviation %.2f m/s\n", directionNames[direction], stats[direction].count, numberOfSpeeders[direction], speedLimits[direction], peopleLost[direction], stats[direction].maxSpeed, stats[direction].minSpeed, stats[direction].averageSpeed, stats[direction].standardDeviation);
+			}
+
+			//The percentiles the speed limits are set from, and how the speeds were spread out
+			printPercentiles(statsFile, "Everyone", &windowSketches[BOTH_DIRECTIONS]);
+			printPercentiles(statsFile, "Walking right", &windowSketches[MOVING_RIGHT]);
+			printPercentiles(statsFile, "Walking left", &windowSketches[MOVING_LEFT]);
+			fprintf(statsFile, "The number of people at each speed was:\n");
+			printHistogram(statsFile, &windowSketches[BOTH_DIRECTIONS]);
+
+			//How close the sampler came to losing edges because the state machine could not keep up
+			fprintf(statsFile, "The most laser edges waiting to be handled at once was %zu and %zu edges were dropped\n", atomic_load(&sampler->lanes[lane].ring.highWater), atomic_load(&sampler->lanes[lane].ring.overflows));
+
+			//How often the level register is being read. The sampler is shared by the lanes, so only the first one
+			//reports on it
+			if(lane == 0 && sampler->capture->mode == CAPTURE_POLL)
+				printPollStats(statsFile, sampler->capture);
+
+			//And whether the thread reading the lasers got the real-time priority it was asked for
+			int realtime = (sampler->capture->mode == CAPTURE_STREAM) ? atomic_load(&sampler->capture->stream->realtime) : atomic_load(&sampler->realtime);
+			if(lane == 0 && realtime)
+				fprintf(statsFile, "%s\n", realtime > 0 ? "The lasers are being read at real-time priority" : "The lasers could not be read at real-time priority, the program needs to be run as root for it");
+
+			//How long the state machine takes over each turn of its loop, and whether edges seem to be going missing
+			printLatencies(statsFile, "Time spent on each turn of the loop since the program started", &metrics->busyTime);
+			fprintf(statsFile, "%llu laser edges since the program started looked like an edge before them had been missed\n", (unsigned long long)metrics->missedEdges);
+			fprintf(statsFile, "%llu flickers of laser 1 and %llu of laser 2 have been filtered out since the program started\n", (unsigned long long)metrics->glitches[0], (unsigned long long)metrics->glitches[1]);
+
+			//How long logging is taking, and whether it has been keeping up
+			printLoggerStats(statsFile, logFile);
+
+			//The events of the window are written out with the stats, by the writer of the event log
+			if(eventLog->started)	{
+				flushEventLog(eventLog);
+				fprintf(statsFile, "The event log has dropped %llu events because it was full or could not be written\n", (unsigned long long)eventLogDropped(eventLog));
+			}
+
+			//How much memory the stats have needed. The accumulators and sketches never grow, however busy the window was,
+			//so the most they have ever needed is what they take up
+			size_t statsBytes = sizeof(windowSpeeds) + sizeof(laneWindowSketches[lane]) + sizeof(laneHourSketches[lane]) + sizeof(laneDaySketches[lane]);
+			fprintf(statsFile, "The stats of the window, the hour and the day are kept in %zu bytes, the most they have ever needed\n", statsBytes);
+			#ifdef CHECK_STATS
+			fprintf(statsFile, "The measurements of this window used %d pages, the most ever used was %zu bytes and %zu bytes are held\n", measurements.pagesInUse, measurements.peakPagesInUse * sizeof(struct measurementPage), measurements.pagesAllocated * sizeof(struct measurementPage));
+			#endif
+			fprintf(statsFile, "\n\n\n");
+
+			//Roll the window up into the hour and the day, and write those out once they are over
+			for(int i = 0; i <= BOTH_DIRECTIONS; i++)	{
+				mergeSketch(&hourSketches[i], &windowSketches[i]);
+				mergeSketch(&daySketches[i], &windowSketches[i]);
+			}
+
+			if(now - hourStartTime >= SECONDS_PER_HOUR * NS_PER_SECOND)	{
+				fprintf(statsFile, "%sHOURLY TOTALS FOR THE TIME BETWEEN %s and %s\n", lanePrefix, hourTime, curTime);
+				printPercentiles(statsFile, "Everyone", &hourSketches[BOTH_DIRECTIONS]);
+				printPercentiles(statsFile, "Walking right", &hourSketches[MOVING_RIGHT]);
+				printPercentiles(statsFile, "Walking left", &hourSketches[MOVING_LEFT]);
+				fprintf(statsFile, "The number of people at each speed was:\n");
+				printHistogram(statsFile, &hourSketches[BOTH_DIRECTIONS]);
+				fprintf(statsFile, "\n\n\n");
+
+				for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+					resetSketch(&hourSketches[i]);
+				hourStartTime = now;
+				strcpy(hourTime, curTime);
+			}
+
+			if(now - dayStartTime >= SECONDS_PER_DAY * NS_PER_SECOND)	{
+				fprintf(statsFile, "%sDAILY TOTALS FOR THE TIME BETWEEN %s and %s\n", lanePrefix, dayTime, curTime);
+				printPercentiles(statsFile, "Everyone", &daySketches[BOTH_DIRECTIONS]);
+				printPercentiles(statsFile, "Walking right", &daySketches[MOVING_RIGHT]);
+				printPercentiles(statsFile, "Walking left", &daySketches[MOVING_LEFT]);
+				fprintf(statsFile, "The number of people at each speed was:\n");
+				printHistogram(statsFile, &daySketches[BOTH_DIRECTIONS]);
+				fprintf(statsFile, "\n\n\n");
+
+				for(int i = 0; i <= BOTH_DIRECTIONS; i++)
+					resetSketch(&daySketches[i]);
+				dayStartTime = now;
+				strcpy(dayTime, curTime);
+			}
+			fflush(statsFile);
+			funlockfile(statsFile);
+
+			//Resets the number of people that passed through, their measurements and the start time
+			#ifdef CHECK_STATS
+			recycleMeasurements(&measurements);
+			#endif
+			for(int i = 0; i <= BOTH_DIRECTIONS; i++)	{
+				resetAccumulator(&windowSpeeds[i]);
+				resetSketch(&windowSketches[i]);
+			}
+			peoplePassedThrough = 0;
+			for(int direction = 0; direction < 2; direction++)	{
+				numberOfSpeeders[direction] = 0;
+				peopleLost[direction] = 0;
+			}
+			startTime = gpioTime(gpio);
+			getTime(sTime);
+		}
+		
+		//Wait for the sampler's next edge on the lasers, but at most CAPTURE_TIMEOUT_MS so that the tracker's
+		//timers keep being checked
+		struct laserEvent event;
+		int timeoutMs = CAPTURE_TIMEOUT_MS;
+
+		//Switch the LEDs that are due and make sure the wait ends in time for the next one
+		if(slowTurn)
+			now = gpioTime(gpio);
+		timestamp_ns ledDeadline = runLedScheduler(&leds, now);
+
+		if(ledDeadline && timeoutMs > (int)((ledDeadline - now) / NS_PER_MS))
+			timeoutMs = (ledDeadline - now) / NS_PER_MS + 1;
+
+		//The same for the next change the glitch filter is waiting to let through
+		timestamp_ns filterDeadline = glitchDeadline(&filter);
+
+		if(filterDeadline && filterDeadline <= now)
+			timeoutMs = 0;
+		else if(filterDeadline && timeoutMs > (int)((filterDeadline - now) / NS_PER_MS))
+			timeoutMs = (filterDeadline - now) / NS_PER_MS + 1;
+
+		//And for the next person the tracker will be able to report as having left
+		timestamp_ns exitTime = trackerDeadline(&tracker);
+
+		if(exitTime && exitTime <= now)
+			timeoutMs = 0;
+		else if(exitTime && timeoutMs > (int)((exitTime - now) / NS_PER_MS))
+			timeoutMs = (exitTime - now) / NS_PER_MS + 1;
+
+		//Everything since the last wait ended was work, however long it took. Changes the glitch filter let through on
+		//the last turn are handed to the tracker before waiting again
+		timestamp_ns waitStart = metrics->untimed ? 0 : getMonotonicTime();
+		timestamp_ns waitEnd = waitStart;
+		if(!metrics->untimed)
+			addLatency(&metrics->busyTime, waitStart - lastWaitEnd);
+		int captured = nextFilteredEvent(&filter, &event);
+
+		if(!captured)	{
+			captured = samplerNextEvent(sampler, lane, &event, timeoutMs);
+
+			//The sampler only reads the clock when it had to wait, so a turn that found an edge waiting is timed by
+			//one read of the clock
+			if(sampled)
+				waitEnd = getMonotonicTime();
+			else if(!metrics->untimed && sampler->lanes[lane].wokenAt)
+				waitEnd = sampler->lanes[lane].wokenAt;
+
+			//Once the lasers have stopped, whatever the glitch filter was waiting for has lasted long enough
+			if(captured < 0 && filterDeadline)	{
+				event.timestamp = filterDeadline;
+				event.levels = filter.rawLevels;
+				captured = 0;
+			}
+			//And nobody else can be taken for the people who have left but not been reported yet
+			else if(captured < 0 && exitTime)	{
+				event.timestamp = exitTime;
+				event.levels = filter.levels;
+				captured = 0;
+			}
+
+			//Every edge should change exactly one laser. One that changes neither or both means the edge in between
+			//was lost
+			if(captured > 0)	{
+				uint32_t changed = (event.levels ^ filter.rawLevels) & laneMask;
+				if(!changed || (changed & (changed - 1)))
+					metrics->missedEdges++;
+				metrics->edges++;
+			}
+
+			//The edge goes through the glitch filter, and the tracker only sees the changes it lets through. When it
+			//lets none through the tracker just checks its timers
+			if(captured >= 0)	{
+				filterEvent(&filter, &event);
+				captured = nextFilteredEvent(&filter, &event);
+				if(!captured)
+					event.levels = filter.levels;
+
+				metrics->glitches[0] = filter.glitches[0];
+				metrics->glitches[1] = filter.glitches[1];
+			}
+		}
+
+		if(captured < 0)	{
+			getTime(curTime);
+			PRINT_MSG(logFile, curTime, laneName, SEVERITY_INFO, "There are no more laser events to capture, stopping.\n\n");
+
+			//A trace of calibration walks is only useful for what they found
+			if(config.calibrationSpeed > 0)	{
+				printCalibration(statsFile, &calibration, &config, lane);
+				fflush(statsFile);
+
+				#ifndef RUN_AS_SERVICE
+				printCalibration(stdout, &calibration, &config, lane);
+				#endif
+			}
+
+			//Leave the metrics of the whole run with the metrics server
+			if(metricsServer)	{
+				metrics->occupancy = trackerOccupancy(&tracker);
+				publishMetrics(metricsServer, lane, metrics, 1);
+			}
+
+			#ifdef CHECK_STATS
+			freeMeasurementStore(&measurements);
+			#endif
+			return;
+		}
+
+		//The time the edge was captured, which the decision latency is counted from. The edges of a trace are timed on the
+		//virtual clock, so for those it is when they were handed over instead
+		timestamp_ns edgeTime = (sampler->capture->mode == CAPTURE_REPLAY) ? waitEnd : event.timestamp;
+
+		//This keeps the watchdog from rebooting the pi, as long as every lane is turning
+		pingWatchdog(watchdog, lane);
+
+		//Hand the event to the tracker and deal with everything it reports back
+		struct trackerReport reports[MAX_TRACKER_REPORTS];
+		int numReports = trackEvent(&tracker, &event, reports, MAX_TRACKER_REPORTS);
+
+		//The time up to this event was spent in the state the hall was in before it. Only an edge or a report can
+		//change the state, so it is not looked at again on the turns that just check the timers
+		if(event.timestamp > stateSince)	{
+			metrics->stateTime[state] += event.timestamp - stateSince;
+			stateSince = event.timestamp;
+		}
+		if(captured || numReports)	{
+			state = trackerHallState(&tracker);
+
+			//The sampler reads the lasers at the active rate while anyone is in the hall
+			setLaneBusy(sampler, lane, state != HALL_EMPTY);
+		}
+
+		//The warning LED stays on while anyone is in the hall
+		if(warningLedPin >= 0)
+			ledSolid(&leds, warningLedPin, trackerOccupancy(&tracker) > 0);
+
+		for(int r = 0; r < numReports; r++)	{
+			float objectSpeed = reports[r].speed;
+			enum travelDirection direction = reports[r].direction;
+			float speedLimit = speedLimits[direction];
+
+			switch(reports[r].outcome)	{
+
+				case LASER_BLOCKED:
 					getTime(curTime);
 
 					#ifndef RUN_AS_SERVICE
 					printf("Hey! Watch out! You are blocking the laser!\n");
-					#endif
-
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
-					timeInState = time(NULL);
-				}
+					#endif 
 
-				break;
+					PRINT_MSG(logFile, curTime, laneName, SEVERITY_WARNING, "Someone is blocking the laser!\n\n");
+					metrics->laserBlocked++;
+					logEvent(eventLog, lane, SPEEDLOG_LASER_BLOCKED, SPEEDLOG_NO_DIRECTION, 0, 0, reports[r].timestamp);
+					break;
 
-			case EXITED_HALL:
-				if(objectSpeed < 0)	{
+				case HALL_BLOCKED:
 					getTime(curTime);
 
 					#ifndef RUN_AS_SERVICE
-					printf("Is that even a person? The speed was off the charts!!\n");
+					printf("Hey! Watch out! You are blocking the hallway!\n");
 					#endif
-					
-					for(int i = 0; i < 3; i++)	{
-						outputOn(gpio, WARNING_LED_PIN);
-						usleep(200000);
-						outputOff(gpio, WARNING_LED_PIN);
-						usleep(200000);
-					}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_INFO, "An extremely fast... thing just went through the hall\n");
-				}
-				else if(objectSpeed > speedLimit)	{
+					PRINT_MSG(logFile, curTime, laneName, SEVERITY_WARNING, "Someone is blocking the hallway!\n\n");
+					metrics->hallBlocked++;
+					logEvent(eventLog, lane, SPEEDLOG_HALL_BLOCKED, direction, 0, 0, reports[r].timestamp);
+					break;
+
+				//Someone came into the hall but was never seen leaving through the other laser
+				case TRANSIT_LOST:
+					peopleLost[direction]++;
+					metrics->lost[direction]++;
 					getTime(curTime);
 
 					#ifndef RUN_AS_SERVICE
-					printf("SLOW DOWN! You are travelling at %.2f m/s over the speed limit!\n", (objectSpeed - speedLimit));
+					printf("Someone walked into the hall and never came out the other side!\n");
 					#endif
 
-					for(int i = 0; i < 3; i++)	{
-						outputOn(gpio, WARNING_LED_PIN);
-						usleep(200000);
-						outputOff(gpio, WARNING_LED_PIN);
-						usleep(200000);
+					PRINT_MSG(logFile, curTime, laneName, SEVERITY_INFO, "A person entered the hall but was never seen leaving it, they may have turned around\n\n");
+					logEvent(eventLog, lane, SPEEDLOG_LOST, direction, 0, 0, reports[r].timestamp);
+					break;
+
+				case TRANSIT_COMPLETED:
+					peoplePassedThrough++;
+					metrics->transits++;
+					metrics->directionTransits[direction]++;
+
+					if(objectSpeed < 0)	{
+						getTime(curTime);
+
+						#ifndef RUN_AS_SERVICE
+						printf("Is that even a person? The speed was off the charts!!\n");
+						#endif
+						
+						if(warningLedPin >= 0)
+							ledBlink(&leds, warningLedPin, WARNING_BLINKS, WARNING_BLINK_PERIOD, event.timestamp);
+
+						PRINT_MSG(logFile, curTime, laneName, SEVERITY_INFO, "An extremely fast... thing just went through the hall\n");
+						logEvent(eventLog, lane, SPEEDLOG_TRANSIT, direction, SPEEDLOG_OFF_THE_CHARTS, 0, reports[r].timestamp);
+						metrics->offTheCharts++;
+					}
+					else if(objectSpeed > speedLimit)	{
+						getTime(curTime);
+
+						#ifndef RUN_AS_SERVICE
+						printf("SLOW DOWN! You are travelling at %.2f m/s over the speed limit!\n", (objectSpeed - speedLimit));
+						#endif
+
+						if(warningLedPin >= 0)
+							ledBlink(&leds, warningLedPin, WARNING_BLINKS, WARNING_BLINK_PERIOD, event.timestamp);
+
+						//The speed goes in the same message, so that the message of another lane cannot end up between them
+						snprintf(message, sizeof(message), "A person walking %s just speed through the hall at a speed of: %f\n", direction == MOVING_RIGHT ? "right" : "left", objectSpeed);
+						PRINT_MSG(logFile, curTime, laneName, SEVERITY_WARNING, message);
+						logEvent(eventLog, lane, SPEEDLOG_TRANSIT, direction, SPEEDLOG_SPEEDING, objectSpeed, reports[r].timestamp);
+						numberOfSpeeders[direction]++;
+						metrics->speeders[direction]++;
+					}
+					else	{
+						getTime(curTime);
+
+						#ifndef RUN_AS_SERVICE
+						printf("The speed of the person passing through the hall was: %.2f\n", objectSpeed);
+						#endif
+
+						//Everyone under the speed limit is only written to the event log when there is one, as that is
+						//most of the writing to the SD card
+						if(!eventLog->started)	{
+							snprintf(message, sizeof(message), "A person walking %s just passed through the hall with a speed of: %f\n", direction == MOVING_RIGHT ? "right" : "left", objectSpeed);
+							PRINT_MSG(logFile, curTime, laneName, SEVERITY_INFO, message);
+						}
+						logEvent(eventLog, lane, SPEEDLOG_TRANSIT, direction, 0, objectSpeed, reports[r].timestamp);
+					}
+
+					//Every speed that could be measured counts towards the stats of the window
+					if(objectSpeed >= 0)	{
+						#ifdef CHECK_STATS
+						storeMeasurement(&measurements, &(struct speedMeasurement){ reports[r].timestamp, direction, objectSpeed });
+						#endif
+						accumulateSpeed(&windowSpeeds[direction], objectSpeed);
+						accumulateSpeed(&windowSpeeds[BOTH_DIRECTIONS], objectSpeed);
+						addToSketch(&windowSketches[direction], objectSpeed);
+						addToSketch(&windowSketches[BOTH_DIRECTIONS], objectSpeed);
+
+						//A speed too big for an int goes in the top bin before it is ever turned into one
+						int bin = (objectSpeed < HISTOGRAM_BINS * HISTOGRAM_BIN_WIDTH) ? (int)(objectSpeed / HISTOGRAM_BIN_WIDTH) : HISTOGRAM_BINS - 1;
+						metrics->speedBins[bin < HISTOGRAM_BINS ? bin : HISTOGRAM_BINS - 1]++;
+						metrics->speedSum += objectSpeed;
 					}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_WARNING, "A person just speed through the hall at a speed of: ");
-					PRINT_VALUE(logFile, objectSpeed);
-					objectSpeeds[peoplePassedThrough - 1] = objectSpeed;
-					numberOfSpeeders++;
-				}
-				else	{
-					getTime(curTime);
+					//In calibration mode, the walk is compared with how long it should have taken at the known speed
+					if(config.calibrationSpeed > 0 && objectSpeed >= 0)	{
+						addCalibrationWalk(&calibration, direction, config.calibrationSpeed, reports[r].travelTime, laneSettings->laserLatency);
 
-					#ifndef RUN_AS_SERVICE
-					printf("The speed of the person passing through the hall was: %.2f\n", objectSpeed);
-					#endif
+						#ifndef RUN_AS_SERVICE
+						printf("Calibration walk %s took %.4f s, at %.2f m/s it should have taken %.4f s\n", direction == MOVING_RIGHT ? "right" : "left", (double)reports[r].travelTime / NS_PER_SECOND, config.calibrationSpeed, laneSettings->distance / config.calibrationSpeed);
+						#endif
+					}
 
-					PRINT_MSG(logFile, curTime, "measureSpeed", SEVERITY_INFO, "A person just passed through the hall with a speed of: ");
-					PRINT_VALUE(logFile, objectSpeed);
-					objectSpeeds[peoplePassedThrough - 1] = objectSpeed;
-				}
+					break;
+			}
+		}
+
+		lastWaitEnd = waitEnd;
 
-				objectSpeed = 0;
-				currentLocation = NOONE_IN_HALL;
-				break;			
+		//The next turn starts right after this one, so the time it took is the period of the loop
+		if(sampled)	{
+			timestamp_ns turnEnd = getMonotonicTime();
+			timestamp_ns period = turnEnd - turnStart;
+
+			if(captured)
+				addLatency(&metrics->decisionLatency, turnEnd - edgeTime);
+			addLatency(&metrics->loopPeriod, period);
+			metrics->loopPeriodSum += period;
+			metrics->loopPeriodSquares += (double)period * period;
 		}
 	}
-}
\ No newline at end of file
+}